@@ -0,0 +1,374 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "lexer.h"
+#include "parser.h"
+#include "launch.h"
+#include "job_control.h"
+#include "prompt.h"
+#include "executor.h"
+#include "shell.h"
+
+// Бенчмарки горячих путей shell: make bench
+// Результаты - JSON в stdout (одна запись на измерение), ход работы - в stderr.
+// Аргументы - имена бенчмарков, которые нужно запустить (по умолчанию все).
+
+#define BENCH_INPUT_LINES 100000// Строк в сгенерированном скрипте для лексера и парсера
+#define BENCH_LEX_ROUNDS 5
+#define BENCH_SPAWN_COUNT 2000
+#define BENCH_PIPE_BYTES (256L * 1024 * 1024)
+#define BENCH_PIPE_MIN_STAGES 2
+#define BENCH_PIPE_MAX_STAGES 8
+#define BENCH_JOBS 10000
+#define BENCH_JOB_PID_BASE 5000000// Выше pid_max - pidfd_open вернет ESRCH, чужие процессы не трогаем
+#define BENCH_PROMPT_RENDERS 1000000
+
+static int first_result = 1;
+
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void result_begin(const char *name) {// {"name": ..., поле, поле}
+    printf("%s\n  {\"name\": \"%s\"", first_result ? "[" : ",", name);
+    first_result = 0;
+}
+
+
+static void result_field(const char *key, double value) {
+    printf(", \"%s\": %.3f", key, value);
+}
+
+
+static void result_end(void) {
+    printf("}");
+    fflush(stdout);
+}
+
+
+static char *generate_script(int lines, size_t *length) {// Типичные строки скрипта: конвейеры, кавычки, перенаправления, списки
+    static const char *samples[] = {
+        "ls -la /usr/bin | grep sh | sort -r | head -n 20\n",
+        "echo \"hello world\" 'single quoted' plain\\ word > /tmp/out.txt\n",
+        "make -j8 all && ./bin/main --verbose || echo failed 2> errors.log\n",
+        "(cd /tmp; tar xzf archive.tar.gz) &> /dev/null &\n",
+        "cat < input.txt |& tee -a log.txt ; sleep 1\n",
+        "# комментарий до конца строки\n",
+        "find . -name '*.c' -newer Makefile | xargs wc -l >> stats.txt\n",
+    };
+    size_t count = sizeof(samples) / sizeof(samples[0]);
+
+    size_t capacity = 0;
+    for (int i = 0; i < lines; i++) {
+        capacity += strlen(samples[i % count]);
+    }
+    char *script = malloc(capacity + 1);
+    if (script == NULL) {
+        return NULL;
+    }
+
+    size_t used = 0;
+    for (int i = 0; i < lines; i++) {
+        size_t len = strlen(samples[i % count]);
+        memcpy(script + used, samples[i % count], len);
+        used += len;
+    }
+    script[used] = '\0';
+    *length = used;
+    return script;
+}
+
+
+static long count_nodes(ast_node_t *node) {// Узлы списка вложены влево - обходим левую ветвь циклом
+    long count = 0;
+    while (node != NULL) {
+        count++;
+        count += count_nodes(node->right);
+        node = node->left;
+    }
+    return count;
+}
+
+
+static void bench_lexer(void) {
+    size_t length;
+    char *script = generate_script(BENCH_INPUT_LINES, &length);
+    if (script == NULL) {
+        perror("malloc");
+        return;
+    }
+
+    long tokens = 0;
+    double start = now_seconds();
+    for (int round = 0; round < BENCH_LEX_ROUNDS; round++) {
+        lexer_t *lexer = lexer_create_len(script, length);
+        if (lexer == NULL || lexer_tokenize(lexer) == NULL) {
+            fprintf(stderr, "Ошибка: лексер не разобрал сгенерированный скрипт\n");
+            lexer_destroy(lexer);
+            free(script);
+            return;
+        }
+        tokens += lexer->token_count;
+        lexer_destroy(lexer);
+    }
+    double elapsed = now_seconds() - start;
+
+    result_begin("lexer");
+    result_field("input_bytes", (double)length);
+    result_field("tokens_per_sec", tokens / elapsed);
+    result_field("mb_per_sec", (double)length * BENCH_LEX_ROUNDS / elapsed / 1e6);
+    result_end();
+    free(script);
+}
+
+
+static void bench_parse(void) {// Время только разбора: токены готовы заранее
+    size_t length;
+    char *script = generate_script(BENCH_INPUT_LINES, &length);
+    if (script == NULL) {
+        perror("malloc");
+        return;
+    }
+
+    long nodes = 0;
+    double elapsed = 0;
+    for (int round = 0; round < BENCH_LEX_ROUNDS; round++) {
+        lexer_t *lexer = lexer_create_len(script, length);
+        if (lexer == NULL || lexer_tokenize(lexer) == NULL) {
+            lexer_destroy(lexer);
+            free(script);
+            return;
+        }
+
+        double start = now_seconds();
+        parser_t *parser = parser_create(lexer);
+        ast_node_t *ast = parse(parser);
+        elapsed += now_seconds() - start;
+
+        if (ast == NULL) {
+            fprintf(stderr, "Ошибка: парсер не разобрал сгенерированный скрипт\n");
+            lexer_destroy(lexer);
+            free(script);
+            return;
+        }
+        nodes += count_nodes(ast);
+        lexer_destroy(lexer);
+    }
+
+    result_begin("parse");
+    result_field("nodes_per_sec", nodes / elapsed);
+    result_field("mb_per_sec", (double)length * BENCH_LEX_ROUNDS / elapsed / 1e6);
+    result_end();
+    free(script);
+}
+
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+static void bench_spawn(void) {// Запуск и ожидание /bin/true тем же путем, что и launch_process
+    double *samples = malloc(BENCH_SPAWN_COUNT * sizeof(double));
+    if (samples == NULL) {
+        perror("malloc");
+        return;
+    }
+    char *argv[] = { "true", NULL };
+
+    double total = 0;
+    for (int i = 0; i < BENCH_SPAWN_COUNT; i++) {
+        spawn_options_t options;
+        spawn_options_init(&options);
+
+        double start = now_seconds();
+        pid_t pid;
+        int err = spawn_process("/bin/true", argv, &options, &pid);
+        if (err != 0) {
+            fprintf(stderr, "Ошибка: не удалось запустить /bin/true: %s\n", strerror(err));
+            free(samples);
+            return;
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        samples[i] = (now_seconds() - start) * 1e6;
+        total += samples[i];
+    }
+
+    qsort(samples, BENCH_SPAWN_COUNT, sizeof(double), compare_doubles);
+    result_begin("spawn_true");
+    result_field("mean_us", total / BENCH_SPAWN_COUNT);
+    result_field("p50_us", samples[BENCH_SPAWN_COUNT / 2]);
+    result_field("p99_us", samples[BENCH_SPAWN_COUNT * 99 / 100]);
+    result_end();
+    free(samples);
+}
+
+
+static void bench_pipeline(void) {// Конвейер из исполнителя shell: head | cat | ... | cat > /dev/null
+    setup_signal_handlers();// Статусы стадий забирает цикл событий, как в самом shell
+
+    for (int stages = BENCH_PIPE_MIN_STAGES; stages <= BENCH_PIPE_MAX_STAGES; stages++) {
+        char command[256];
+        int used = snprintf(command, sizeof(command), "head -c %ld /dev/zero", BENCH_PIPE_BYTES);
+        for (int i = 1; i < stages; i++) {
+            used += snprintf(command + used, sizeof(command) - used, " | cat");
+        }
+        snprintf(command + used, sizeof(command) - used, " > /dev/null");
+
+        double start = now_seconds();
+        int status = shell_execute_string(command);
+        double elapsed = now_seconds() - start;
+        if (status != 0) {
+            fprintf(stderr, "Ошибка: конвейер завершился с кодом %d\n", status);
+            return;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "pipeline_%d", stages);
+        result_begin(name);
+        result_field("stages", stages);
+        result_field("mb_per_sec", BENCH_PIPE_BYTES / elapsed / 1e6);
+        result_end();
+    }
+}
+
+
+static void bench_jobs(void) {// Таблица задач на 10k фоновых задач без настоящих процессов
+    job_t **jobs = malloc(BENCH_JOBS * sizeof(job_t*));
+    if (jobs == NULL) {
+        perror("malloc");
+        return;
+    }
+
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_JOBS; i++) {
+        jobs[i] = create_job(BENCH_JOB_PID_BASE + i, "bench");
+        if (jobs[i] == NULL || job_add_process(jobs[i], BENCH_JOB_PID_BASE + i, JOB_RUNNING) < 0 || add_job(jobs[i]) < 0) {
+            fprintf(stderr, "Ошибка: не удалось добавить задачу\n");
+            free(jobs);
+            return;
+        }
+    }
+    double add_time = now_seconds() - start;
+
+    start = now_seconds();
+    long found = 0;
+    for (int i = 0; i < BENCH_JOBS; i++) {
+        found += (find_job(BENCH_JOB_PID_BASE + i) == jobs[i]);
+    }
+    double find_time = now_seconds() - start;
+
+    start = now_seconds();
+    for (int i = 0; i < BENCH_JOBS; i++) {
+        found += (get_job_by_id(jobs[i]->job_id) == jobs[i]);
+    }
+    double id_time = now_seconds() - start;
+
+    start = now_seconds();
+    for (int i = 0; i < BENCH_JOBS; i++) {// Завершение процесса и удаление задачи, как после сообщения Done
+        job_update_process(BENCH_JOB_PID_BASE + i, 0, NULL);
+        remove_job(jobs[i]->job_id);
+    }
+    double remove_time = now_seconds() - start;
+
+    if (found != 2L * BENCH_JOBS || job_count() != 0) {
+        fprintf(stderr, "Ошибка: таблица задач вернула не те задачи\n");
+    }
+
+    result_begin("job_table");
+    result_field("jobs", BENCH_JOBS);
+    result_field("add_ns", add_time / BENCH_JOBS * 1e9);
+    result_field("find_pid_ns", find_time / BENCH_JOBS * 1e9);
+    result_field("find_id_ns", id_time / BENCH_JOBS * 1e9);
+    result_field("reap_remove_ns", remove_time / BENCH_JOBS * 1e9);
+    result_end();
+    free(jobs);
+}
+
+
+static void bench_prompt(void) {
+    prompt_init();
+
+    size_t length;
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_PROMPT_RENDERS; i++) {
+        prompt_render(&length);
+    }
+    double cached = now_seconds() - start;
+
+    start = now_seconds();
+    for (int i = 0; i < BENCH_PROMPT_RENDERS / 100; i++) {// После cd каталог перечитывается
+        prompt_cwd_changed();
+        prompt_render(&length);
+    }
+    double after_cd = now_seconds() - start;
+
+    result_begin("prompt_render");
+    result_field("cached_ns", cached / BENCH_PROMPT_RENDERS * 1e9);
+    result_field("after_cd_ns", after_cd / (BENCH_PROMPT_RENDERS / 100) * 1e9);
+    result_end();
+    prompt_cleanup();
+}
+
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} bench_t;
+
+static const bench_t benches[] = {
+    { "lexer",    bench_lexer },
+    { "parse",    bench_parse },
+    { "spawn",    bench_spawn },
+    { "pipeline", bench_pipeline },
+    { "jobs",     bench_jobs },
+    { "prompt",   bench_prompt },
+    { NULL, NULL }
+};
+
+
+static int selected(int argc, char **argv, const char *name) {
+    if (argc < 2) {
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        int known = 0;
+        for (int b = 0; benches[b].name != NULL; b++) {
+            known |= (strcmp(argv[i], benches[b].name) == 0);
+        }
+        if (!known) {
+            fprintf(stderr, "bench: неизвестный бенчмарк: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    for (int b = 0; benches[b].name != NULL; b++) {
+        if (selected(argc, argv, benches[b].name)) {
+            fprintf(stderr, "bench: %s...\n", benches[b].name);
+            benches[b].run();
+        }
+    }
+    printf("%s\n", first_result ? "[]" : "\n]");
+    return 0;
+}
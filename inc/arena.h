@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Арена (bump-аллокатор) для одной командной строки: токены, узлы AST, argv.
+// Память освобождается только целиком - arena_reset или arena_destroy.
+
+#define ARENA_DEFAULT_BLOCK 4096
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    char data[];
+} arena_block_t;
+
+typedef struct {
+    arena_block_t *head;// Текущий блок, из которого идет выделение
+    size_t block_size;// Размер следующего блока
+} arena_t;
+
+arena_t *arena_create(size_t block_size);
+void arena_destroy(arena_t *arena);
+void arena_reset(arena_t *arena);// Оставляет один блок для повторного использования
+
+void *arena_alloc(arena_t *arena, size_t size);
+char *arena_strndup(arena_t *arena, const char *str, size_t len);
+char *arena_strdup(arena_t *arena, const char *str);
+
+#endif
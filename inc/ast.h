@@ -1,6 +1,7 @@
 #ifndef AST_H
 #define AST_H
 #include "tokens.h"
+#include "arena.h"
 
 typedef enum {
     NODE_COMMAND,//
@@ -10,13 +11,15 @@ typedef enum {
     NODE_OR,
     NODE_SEMICOLON,
     NODE_BACKGROUND,
-    NODE_SUBSHELL
+    NODE_SUBSHELL,
+    NODE_TIME// time конвейер: left - конвейер (NULL у одиночного time)
 } node_type_t;
 
 
 typedef struct {// изм разделили данные на отдельные структуры
     char **argv;
     int argc;
+    unsigned char *word_flags;// WORD_* каждого слова; NULL - все слова буквальные
 } command_data_t;// Только для команд
 
 typedef struct {
@@ -24,6 +27,7 @@ typedef struct {
     char *out_file;
     char *err_file;
     int append;
+    int file_flags;// WORD_* имени файла
 } redirect_data_t;// Только для перенаправлений
 
 typedef struct {
@@ -43,9 +47,10 @@ typedef struct ast_node_t {
     } data;//для остальных типов не нужно дополнительных данных
 } ast_node_t;
 
-ast_node_t *ast_create_node(node_type_t type);
-void ast_destroy(ast_node_t *node);
-ast_node_t *ast_create_command_node(char **argv, int argc);
+// Узлы, argv и имена файлов выделяются в арене командной строки и
+// освобождаются вместе с ней - отдельного удаления дерева нет
+ast_node_t *ast_create_node(arena_t *arena, node_type_t type);
+ast_node_t *ast_create_command_node(arena_t *arena, char **argv, int argc);
 void ast_add_redirect(ast_node_t *node, char *file, int type, int is_append);
 void ast_print(ast_node_t *node, int depth);
 
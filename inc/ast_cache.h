@@ -0,0 +1,41 @@
+#ifndef AST_CACHE_H
+#define AST_CACHE_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "ast.h"
+#include "builtin_io.h"
+
+// LRU-кэш разобранных строк: точный текст команды -> готовое AST.
+// Запись владеет ареной лексера, в которой лежат токены, argv и узлы дерева.
+// Дерево после разбора не меняется, поэтому выполняется прямо из кэша без копирования.
+// Пока запись выполняется, она закреплена (refs > 0) и не освобождается при вытеснении -
+// это важно для source, который может заново войти в process_command.
+
+#define AST_CACHE_DEFAULT_SIZE 64
+#define AST_CACHE_MAX_KEY 4096// Длиннее (скрипты целиком) не кэшируем
+
+typedef struct ast_cache_entry {
+    unsigned long hash;
+    char *key;// Копия текста в арене записи
+    size_t key_len;
+    arena_t *arena;
+    ast_node_t *ast;
+    int refs;// Сколько выполнений сейчас используют дерево
+    int cached;// 0 - запись вытеснена или не попала в кэш, освобождается при последнем release
+    struct ast_cache_entry *chain;// Следующая запись в той же корзине
+    struct ast_cache_entry *lru_prev;// Список от самой свежей к самой старой
+    struct ast_cache_entry *lru_next;
+} ast_cache_entry_t;
+
+ast_cache_entry_t *ast_cache_lookup(const char *input, size_t length);// Закрепленная запись или NULL
+ast_cache_entry_t *ast_cache_insert(const char *input, size_t length, arena_t *arena, ast_node_t *ast);// Забирает арену себе
+void ast_cache_release(ast_cache_entry_t *entry);
+
+void ast_cache_set_capacity(size_t capacity);// 0 отключает кэш
+void ast_cache_clear(void);
+void ast_cache_print_stats(builtin_io_t *io);
+
+int builtin_astcache(char **argv, builtin_io_t *io);
+
+#endif
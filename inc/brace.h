@@ -0,0 +1,30 @@
+#ifndef BRACE_H
+#define BRACE_H
+
+#include <stddef.h>
+
+// Раскрытие фигурных скобок: a{b,c}d -> abd acd, {1..10}, {01..10..3}, {a..z}.
+// Это генератор: варианты по одному собираются в буфере и отдаются функции
+// emit, следующий вариант пишется на место предыдущего. {1..10000000}
+// не превращается в список из десяти миллионов строк - сколько памяти
+// нужно потребителю, решает он сам (подсчет размера не хранит ничего).
+// Варианты - исходный текст слова (кавычки и $ на месте), раскрытие
+// параметров и шаблонов идет уже по каждому варианту.
+// Несколько групп в слове дают все сочетания ({a,b}{1,2} -> a1 a2 b1 b2),
+// группы могут быть вложенными. ${...}, $(...) и скобки в кавычках не раскрываются.
+
+#define BRACE_INITIAL_BUFFER 256
+
+typedef struct {// Буфер варианта; принадлежит вызывающему, переиспользуется
+    char *text;
+    size_t length;
+    size_t capacity;
+} brace_buffer_t;
+
+typedef int (*brace_emit_t)(void *context, const char *word, size_t length);// Не 0 - остановить перебор
+
+// 0 - все варианты отданы (слово без групп - один вариант, само слово);
+// иначе то, что вернул emit, или -1 при нехватке памяти
+int brace_expand(brace_buffer_t *buffer, const char *word, size_t length, brace_emit_t emit, void *context);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef BUILTIN_IO_H
+#define BUILTIN_IO_H
+
+#include <stddef.h>
+
+// Ввод/вывод встроенной команды.
+// Встроенная команда пишет не через printf (глобальный stdout), а в дескрипторы
+// своей стадии: в основном потоке это 0/1/2 или файлы перенаправлений,
+// в конвейере - концы пайпов. Вывод копится в буфере и уходит write() целиком.
+// Для $(...) вместо дескриптора вывода может быть память (bio_sink_t) - тогда
+// команда выполняется без пайпа и без fork.
+
+#define BIO_BUFFER_SIZE 4096
+#define BIO_SINK_INITIAL 256
+
+typedef struct {// Растущий буфер вывода; принадлежит вызывающему, переиспользуется
+    char *data;
+    size_t length;
+    size_t capacity;
+} bio_sink_t;
+
+typedef struct {
+    int in_fd;
+    int out_fd;
+    int err_fd;
+    bio_sink_t *sink;// Не NULL - вывод дописывается сюда, out_fd не используется
+    int failed;// Запись не удалась (например EPIPE - читатель закрыл пайп)
+    size_t len;
+    char buf[BIO_BUFFER_SIZE];
+} builtin_io_t;
+
+void bio_init(builtin_io_t *io, int in_fd, int out_fd, int err_fd);
+int bio_write(builtin_io_t *io, const void *data, size_t length);// -1 если вывод уже некуда писать
+int bio_puts(builtin_io_t *io, const char *str);
+int bio_printf(builtin_io_t *io, const char *format, ...) __attribute__((format(printf, 2, 3)));
+int bio_flush(builtin_io_t *io);
+void bio_error(builtin_io_t *io, const char *format, ...) __attribute__((format(printf, 2, 3)));// Сразу в err_fd, без буфера
+void bio_perror(builtin_io_t *io, const char *what);// Аналог perror
+
+int write_all(int fd, const void *data, size_t length);
+int bio_sink_append(bio_sink_t *sink, const void *data, size_t length);// Всегда оставляет место под завершающий 0; -1 - нет памяти
+
+#endif
@@ -1,19 +1,45 @@
 #ifndef BUILTINS_H
 #define BUILTINS_H
 
+#include "builtin_io.h"
+
 // Встроенные команды shell
-int builtin_cd(char **argv);
-int builtin_pwd(char **argv);
-int builtin_echo(char **argv);
-int builtin_exit(char **argv);
-int builtin_help(char **argv);
-int builtin_jobs(char **argv);//добавила
-int builtin_fg(char **argv);
-int builtin_bg(char **argv);
-int builtin_kill(char **argv);
+// Каждая команда пишет через builtin_io_t, а не через stdout,
+// поэтому ее можно выполнить с любыми дескрипторами - в том числе в потоке.
+
+#define BUILTIN_PIPE_SAFE 0x1// Не меняет состояние shell: в конвейере выполняется потоком без fork
+#define BUILTIN_STREAM 0x2// Читает ввод до конца (cat, tee): без соседей-процессов - в копии shell, как задача со своей группой
+
+typedef int (*builtin_func_t)(char **argv, builtin_io_t *io);
+
+typedef struct {// Запись реестра встроенных команд
+    const char *name;
+    builtin_func_t func;
+    int flags;
+    int (*accepts)(char **argv);// 0 - таких аргументов встроенная версия не знает, запускаем внешнюю; NULL - любые
+} builtin_t;
+
+typedef struct builtin_task builtin_task_t;// Встроенная команда, запущенная потоком
+
+int builtin_cd(char **argv, builtin_io_t *io);
+int builtin_pwd(char **argv, builtin_io_t *io);
+int builtin_echo(char **argv, builtin_io_t *io);
+int builtin_true(char **argv, builtin_io_t *io);
+int builtin_false(char **argv, builtin_io_t *io);
+int builtin_exit(char **argv, builtin_io_t *io);
+int builtin_help(char **argv, builtin_io_t *io);
+int builtin_source(char **argv, builtin_io_t *io);
+int builtin_times(char **argv, builtin_io_t *io);
 
 // Функции для работы с встроенными командами
-int is_builtin_command(char *command);
-int handle_builtin(char **argv);
+const builtin_t *find_builtin(const char *name);// NULL если команда не встроенная
+const builtin_t *find_builtin_argv(char **argv);// То же с учетом аргументов: cat -n - внешняя команда
+const builtin_t *builtin_list(void);// Весь реестр, последняя запись с name == NULL
+int run_builtin(const builtin_t *builtin, char **argv, int fds[3]);// Выполняет в текущем потоке с заданными дескрипторами
+int run_builtin_sink(const builtin_t *builtin, char **argv, int fds[3], bio_sink_t *sink);// То же, но вывод в память (sink == NULL - в fds[1])
+
+builtin_task_t *builtin_start_thread(const builtin_t *builtin, char **argv, int fds[3], int copy_argv);// Дескрипторы > 2 дублируются для потока; copy_argv - argv может пережить вызывающего (поток отсоединят)
+int builtin_join_thread(builtin_task_t *task);// Ждет поток и возвращает статус команды
+void builtin_detach_thread(builtin_task_t *task);// Поток доработает сам (задача остановлена)
 
 #endif
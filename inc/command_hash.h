@@ -0,0 +1,22 @@
+#ifndef COMMAND_HASH_H
+#define COMMAND_HASH_H
+
+#include "builtin_io.h"
+
+// Кэш путей к исполняемым файлам (аналог hash в bash)
+// Имя команды -> абсолютный путь, промахи тоже кэшируются.
+// Кэш сбрасывается при присваивании PATH, hash -r или изменении mtime каталога
+// из PATH. Каталоги проверяются не при каждом поиске, а раз за поколение -
+// одну команду верхнего уровня (строку из приглашения или команду скрипта).
+// Результат, зависящий от текущего каталога (пустой или относительный элемент
+// PATH до найденного), не кэшируется и ищется каждый раз заново.
+
+const char *command_hash_lookup(const char *name);// Путь к команде или NULL если не найдена
+const char *command_hash_search(const char *name, const char *path_var);// Поиск по другому PATH (PATH=... cmd) без кэша; путь живет до следующего поиска
+void command_hash_clear(void);// Полный сброс, PATH разбирается заново (hash -r, присваивание PATH)
+void command_hash_next_generation(void);// Новая команда - mtime каталогов проверится заново
+void command_hash_print(builtin_io_t *io);
+
+int builtin_hash(char **argv, builtin_io_t *io);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// Дополнение по Tab.
+// Позиция курсора определяется по токенам лексера: в начале строки и после
+// |, |&, &&, ||, ;, & и ( дополняется имя команды, иначе - путь к файлу.
+// Имена команд - встроенные и все исполняемые файлы из PATH в префиксном
+// дереве; дерево строится при первом Tab и перестраивается, когда меняется
+// PATH или mtime одного из его каталогов. Пути берутся из dir_cache.
+
+typedef struct {
+    arena_t *arena;// Память вариантов; освобождается completion_free
+    size_t word_start;// Начало дополняемого слова в строке
+    size_t word_length;// Длина слова без кавычек и экранирования
+    const char **matches;// Слово целиком, без экранирования, по алфавиту; у каталогов в конце '/'
+    size_t count;
+    size_t capacity;
+    size_t common_length;// Длина общего префикса всех вариантов
+} completion_t;
+
+int completion_complete(const char *line, size_t cursor, completion_t *result);// -1 - дополнять нечего
+void completion_free(completion_t *result);
+void completion_clear(void);// Сбрасывает дерево команд
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef CORE_BUILTINS_H
+#define CORE_BUILTINS_H
+
+#include "builtin_io.h"
+
+// Команды, на которых держатся условия и скрипты: test/[, printf, read.
+// Внешние /usr/bin/[ и printf стоили бы fork+exec на каждое && и ||.
+// Код возврата test: 0 - истина, 1 - ложь, 2 - ошибка в выражении.
+
+#define READ_DEFAULT_NAME "REPLY"// read без имен кладет строку сюда
+#define READ_DEFAULT_IFS " \t\n"
+
+int builtin_test(char **argv, builtin_io_t *io);// test и [ (у [ последний аргумент - ])
+int builtin_printf(char **argv, builtin_io_t *io);
+int builtin_read(char **argv, builtin_io_t *io);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef DIR_CACHE_H
+#define DIR_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Кэш содержимого каталогов (дополнение по Tab, шаблоны имен).
+// Каталог читается getdents64 целиком: имена лежат в одном блоке,
+// массив записей отсортирован по имени - поиск по префиксу двоичный.
+// Кэш ключуется абсолютным путем. mtime каталога проверяется не чаще
+// раза в DIR_CACHE_RECHECK_MS, и каталог перечитывается только если
+// mtime изменился - на сетевой ФС частые Tab не читают каталог заново.
+// Шаблонам имен устаревший список не годится: для них mtime проверяется
+// один раз за поколение (раскрытие одной команды), и все шаблоны команды
+// по одному каталогу (cp *.c *.h dir) берут его из кэша без stat.
+// Каталог с mtime моложе DIR_CACHE_RACY_MS мог измениться в тот же тик
+// часов ФС после чтения - такой список при следующей проверке перечитывается.
+// Указатель на список действителен до следующего вызова dir_cache_get*.
+
+#define DIR_CACHE_MAX_DIRS 64// Самый давно не использованный каталог вытесняется
+#define DIR_CACHE_RECHECK_MS 1000
+#define DIR_CACHE_RACY_MS 20
+#define DIR_CACHE_READ_SIZE (256 * 1024)// Буфер одного вызова getdents64: каталог в 500 тысяч имен - сотни вызовов, а не тысячи
+
+typedef struct {
+    const char *name;
+    unsigned char type;// DT_* из getdents64; DT_UNKNOWN и DT_LNK уточняются через stat
+} dir_entry_t;
+
+typedef struct {
+    char *path;
+    struct timespec mtime;
+    uint64_t checked_ns;// Когда mtime проверялся последний раз
+    uint64_t last_used;
+    uint64_t generation;// Поколение, в котором mtime проверялся для шаблонов
+    int racy;// mtime слишком свежий, чтобы ему верить
+    char *names;
+    dir_entry_t *entries;// По возрастанию имени, без . и ..
+    size_t count;
+} dir_listing_t;
+
+const dir_listing_t *dir_cache_get(const char *path);// Абсолютный путь; NULL - каталог не читается
+const dir_listing_t *dir_cache_get_current(const char *path);// То же для шаблонов: актуален в текущем поколении
+void dir_cache_next_generation(void);// Новая команда - каталоги для шаблонов проверяются заново
+size_t dir_listing_lower_bound(const dir_listing_t *listing, const char *prefix);// Первая запись с именем >= prefix
+int dir_entry_is_dir(const dir_listing_t *listing, const dir_entry_t *entry);// Симлинк на каталог - тоже каталог
+void dir_cache_clear(void);
+
+#endif
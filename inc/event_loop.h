@@ -0,0 +1,19 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+// Цикл событий shell.
+// SIGCHLD заблокирован во всех потоках и приходит через signalfd, обработчика нет.
+// Все статусы дочерних процессов забирает одно место - event_loop_reap,
+// которое передает их в таблицу задач. Ожидание ввода (epoll по stdin и signalfd)
+// и ожидание задачи переднего плана по пути забирают завершившиеся процессы.
+// Если signalfd недоступен, SIGCHLD ждем через sigtimedwait и опрашиваем по таймауту.
+
+int event_loop_init(void);// Блокирует SIGCHLD, создает signalfd и epoll; вызывать до запуска потоков
+void event_loop_after_fork(void);// Копия shell после закрытия унаследованных дескрипторов - свой signalfd и epoll
+int event_loop_signal_fd(void);// signalfd для своих наборов epoll, -1 если его нет
+int event_loop_wait_readable(int fd);// Ждет данных в fd, попутно забирая процессы; -1 при ошибке
+void event_loop_wait_child(void);// Ждет следующего SIGCHLD (процессы забирает вызывающий)
+int event_loop_reap(void);// Забирает все готовые статусы без ожидания, возвращает их число
+int event_loop_wait_set(int epoll_set);// Ждет событий в наборе (pidfd, signalfd) и забирает процессы; -1 - ждать SIGCHLD
+
+#endif
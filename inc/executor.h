@@ -1,6 +1,7 @@
 #ifndef EXECUTOR_H
 #define EXECUTOR_H
 
+#include <sys/types.h>
 #include "ast.h"
 
 // Константы для пайпов
@@ -20,8 +21,17 @@ typedef struct {
     int append;// Флаг добавления в файл (>>)
     int in_pipe;// ДОБАВИЛА: Флаг выполнения в пайпе
     pid_t pipeline_pgid; // ДОБАВИЛА ID группы процессов для пайпа
+    char **envp;// Окружение для exec: NULL - общий кэш var_envp(), иначе с присваиваниями VAR=val cmd
+    const char *path_var;// PATH из присваивания PATH=... cmd: команда ищется по нему, а не через кэш
 } exec_context_t;
 
+typedef struct {// Одна стадия конвейера после разворачивания цепочки NODE_PIPE
+    ast_node_t *node;// Узел стадии (команда, перенаправление, подсекция)
+    int redirect_err;// stderr стадии тоже идет в пайп (|&)
+    pid_t pid;// PID процесса стадии (0 если стадия выполняется потоком)
+    struct builtin_task *task;// Встроенная команда, запущенная потоком
+} pipeline_stage_t;
+
 int execute_ast(ast_node_t *node);// Основные функции выполнения
 int execute_command(ast_node_t *node, exec_context_t *context);
 
@@ -33,11 +43,14 @@ int execute_or(ast_node_t *node, exec_context_t *context);
 int execute_sequence(ast_node_t *node, exec_context_t *context);
 int execute_background(ast_node_t *node, exec_context_t *context);
 int execute_subshell(ast_node_t *node, exec_context_t *context);  // ДОБАВИЛА для подстановок
+int execute_time(ast_node_t *node, exec_context_t *context);// time: время и ресурсы процессов конвейера
 
 exec_context_t *create_exec_context(void);// Вспомогательные функции
 void free_exec_context(exec_context_t *context);
 void setup_redirections(exec_context_t *context);
-int launch_process(char **argv, exec_context_t *context);  //ДОБАВИЛА всегда создает форк
+int open_redirections(exec_context_t *context, int fds[3]);// Открывает файлы перенаправлений с O_CLOEXEC, -1 при ошибке
+void close_redirections(int fds[3]);
+int launch_process(char **argv, exec_context_t *context);  //ДОБАВИЛА запуск через posix_spawn (fork - запасной путь)
 
 // Обработка сигналов
 void setup_signal_handlers(void);
@@ -0,0 +1,41 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "tokens.h"
+
+// Раскрытие слов перед выполнением команды.
+// Лексер оставляет слова с $ или * ? [...] как есть, вместе с кавычками (флаги
+// WORD_EXPAND, WORD_GLOB), а здесь за один проход по слову делается все сразу:
+// подстановка параметров, деление результата на поля по IFS и снятие кавычек.
+// Поле с метасимволами вне кавычек раскрывается по именам файлов (pathname.c),
+// символы из кавычек передаются шаблону экранированными; без совпадений
+// поле остается как было.
+// Поддерживается $имя, ${имя}, $? $$ $!, ${#имя} и ${имя-слово} ${имя=слово}
+// ${имя+слово} ${имя?слово} (с двоеточием - пустое значение как незаданное).
+// Все поля пишутся в один растущий буфер раскрывателя, буфер и массивы
+// переиспользуются между командами - в цикле раскрытие не выделяет память.
+// Буквальные слова не копируются: в argv попадает указатель из AST.
+// Скобки {a,b} {1..N} раскрываются первыми (brace.c): варианты по одному
+// проходят остальные шаги и сразу становятся полями.
+// $(команда) и `команда` заменяются выводом команды (subst.c) и делятся на
+// поля так же, как значение параметра.
+
+#define EXPAND_INITIAL_BUFFER 256
+#define EXPAND_INITIAL_FIELDS 16
+#define EXPAND_DEFAULT_IFS " \t\n"
+
+typedef struct expand expand_t;
+
+expand_t *expand_acquire(void);// Из пула; вложенное выполнение (source) получит другой
+void expand_release(expand_t *expand);// Буферы остаются для следующей команды; NULL можно
+
+// argv действителен до следующего раскрытия этим же expand_t или expand_release.
+// NULL - ошибка (уже выведена); *argc == 0 - все слова раскрылись в пустоту
+char **expand_command(expand_t *expand, char **words, const unsigned char *flags, int count, int *argc);
+int expand_status(expand_t *expand);// Статус последней $(...) в раскрытой команде, -1 - их не было
+char *expand_word(const char *word, int flags);// Имя файла перенаправления: ровно одно поле (и одно совпадение шаблона), malloc; NULL - ошибка
+// Оценка размера argv по исходным словам без раскрытия: {1..N} считается
+// генератором и бросается, как только сумма превысила limit
+int expand_exceeds(expand_t *expand, char **words, const unsigned char *flags, int count, size_t limit);
+
+#endif
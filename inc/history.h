@@ -0,0 +1,59 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// История команд: файл только на дописывание и индекс смещений к нему.
+// ~/.my_shell_history - команды, каждая заканчивается \n (формат прежней истории);
+// ~/.my_shell_history.idx - заголовок и смещения начала команд (uint64_t).
+// При загрузке оба файла отображаются в память и не читаются построчно,
+// новая команда дописывается в конец одним write сразу после ввода.
+// Видны последние capacity команд; когда файл вырастает больше чем вдвое,
+// при следующей загрузке он переписывается, и индекс строится заново.
+//
+// Для поиска (Ctrl-R) в памяти строится индекс триграмм: для каждых трех
+// подряд идущих байт - номера команд, в которых они встречаются. Поиск
+// проверяет только команды из самого короткого списка триграмм запроса.
+
+#define HISTORY_FILE_NAME ".my_shell_history"
+#define HISTORY_INDEX_SUFFIX ".idx"
+#define HISTORY_SIZE_ENV "MYSHELL_HISTSIZE"// Сколько последних команд доступно
+#define HISTORY_DEFAULT_SIZE 10000
+#define HISTORY_MAX_SIZE 1000000
+
+typedef struct {// Команды, содержащие триграмму; номера по возрастанию
+    uint32_t key;// Три байта + 1; 0 - пустая ячейка
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *entries;
+} history_trigram_t;
+
+typedef struct {
+    char *path;
+    int fd;// Файл истории, открыт с O_APPEND
+    int index_fd;
+
+    const char *map;// Файл истории на момент загрузки
+    size_t map_size;
+    const uint64_t *index_map;// Смещения из индекса (за заголовком)
+    size_t index_map_size;// Размер отображения индекса вместе с заголовком
+    size_t mapped_count;
+
+    uint64_t *added;// Смещения команд, которых нет в отображенном индексе
+    size_t added_count;
+    size_t added_capacity;
+
+    size_t first;// Первая видимая команда
+    size_t position;// Текущая позиция history_prev/history_next; count - новая строка
+    size_t capacity;
+
+    char *line;// Буфер для возвращаемой команды (в файле они без \0)
+    size_t line_capacity;
+
+    history_trigram_t *trigrams;// Хеш-таблица с открытой адресацией; NULL - искать перебором
+    size_t trigram_capacity;
+    size_t trigram_used;
+} history_t;
+
+#endif
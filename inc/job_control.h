@@ -2,8 +2,21 @@
 #define JOB_CONTROL_H
 
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "builtin_io.h"
 
-#define MAX_JOBS 100
+// Таблица задач.
+// Задачи лежат в массиве по номеру задачи (освободившиеся номера переиспользуются,
+// выдается наименьший свободный), у каждой задачи список ее процессов.
+// Хэш pid -> (задача, процесс) находит задачу по любому процессу конвейера за O(1).
+// Статусы процессов приходят только из event_loop_reap. Задача переднего плана
+// тоже лежит в таблице (foreground = 1) и ждется через нее же.
+// Таблицу читает jobs из потока конвейера, поэтому изменения идут под мьютексом.
+// На каждый процесс открыт pidfd (пока хватает дескрипторов): через него идут
+// сигналы задаче, и wait ждет в epoll только готовые процессы.
+// Процессы забираются через wait4: ресурсы каждого процесса суммируются в его задаче
+// (time, jobs -v).
 
 typedef enum {
     JOB_RUNNING,
@@ -11,27 +24,65 @@ typedef enum {
     JOB_DONE
 } job_state_t;
 
+typedef struct {// Один процесс задачи
+    pid_t pid;
+    job_state_t state;
+    int status;// Статус из waitpid, когда процесс завершился
+    int pidfd;// -1 если pidfd недоступен или уже закрыт
+    struct rusage usage;// Из wait4, когда процесс завершился
+} job_process_t;
+
 typedef struct job_t {
     int job_id;
     pid_t pgid;
     char *command;
     job_state_t state;
-    struct job_t *next;
+    job_process_t *procs;
+    int proc_count;
+    int proc_capacity;
+    int live_count;// Сколько процессов еще не завершилось
+    int foreground;// Shell сейчас ждет эту задачу - о ней не сообщаем и в jobs не показываем
+    struct job_t *next_notify;// Очередь задач, о которых надо сообщить перед приглашением
+    int queued;
+    int waiting;// Задачу ждет wait
+    struct job_t *next_waited;// Очередь завершившихся задач для wait
+    struct timespec started;// CLOCK_MONOTONIC
+    struct timespec finished;// Когда завершился последний процесс
+    struct rusage usage;// Сумма по завершившимся процессам (ru_maxrss - максимум)
 } job_t;
 
 job_t *create_job(pid_t pgid, const char *command);
-void add_job(job_t *job);
+int job_add_process(job_t *job, pid_t pid, job_state_t state);// До или после add_job
+int add_job(job_t *job);// Выдает номер задачи и регистрирует ее процессы; при ошибке освобождает задачу, -1
 void remove_job(int job_id);
-job_t *find_job(pid_t pgid);
+job_t *find_job(pid_t pid);// По pid любого процесса задачи
+job_t *job_update_process(pid_t pid, int status, const struct rusage *usage);// Применяет статус из wait4, возвращает задачу или NULL
+void job_notify(int print);// Сообщает о завершенных/остановленных фоновых задачах и удаляет завершенные
+// Управление задачами - только у интерактивного shell на терминале: shell в своей
+// группе, каждая задача в своей, терминал на время ожидания отдается задаче
+// переднего плана. Без него (скрипты, -c, копии shell) процессы остаются в группе
+// shell и Ctrl+C действует на всех сразу
+void job_control_init(void);
+int job_control_enabled(void);
+int job_terminal(void);// Дескриптор терминала для tcsetpgrp в ребенке, -1 - управления задачами нет
+void job_set_reporting(int enabled);// Интерактивный режим: завершенные задачи ждут сообщения перед приглашением
+int job_wait(job_t *job);// Ждет задачу переднего плана, 1 если она остановлена
+int job_status(job_t *job);// Код возврата по статусу последнего процесса
 void update_job_status(pid_t pgid, job_state_t state);
-void print_jobs(void);
+void print_jobs(builtin_io_t *io, int verbose);
 job_t *get_job_by_id(int job_id);
+int job_count(void);
+void job_forget_all(void);// Копия shell после fork: задачи родителя ей не принадлежат
+void job_usage_add(struct rusage *total, const struct rusage *usage);// Время и переключения складываются, ru_maxrss - максимум
+double job_wall_time(const job_t *job);// Секунды от запуска до завершения (или до сейчас)
+double timeval_seconds(const struct timeval *tv);
+void print_duration(builtin_io_t *io, double seconds);// Как в time: 1m2.345s
+void print_usage(builtin_io_t *io, double real, const struct rusage *usage);// Отчет time
 
-int builtin_jobs(char **argv);
-int builtin_fg(char **argv);
-int builtin_bg(char **argv);
-int builtin_kill(char **argv);
-
-void sigchld_handler(int sig);
+int builtin_jobs(char **argv, builtin_io_t *io);
+int builtin_fg(char **argv, builtin_io_t *io);
+int builtin_bg(char **argv, builtin_io_t *io);
+int builtin_kill(char **argv, builtin_io_t *io);
+int builtin_wait(char **argv, builtin_io_t *io);
 
 #endif
@@ -0,0 +1,22 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <sys/types.h>
+
+// Запуск внешних процессов: posix_spawn (в glibc это clone(CLONE_VM|CLONE_VFORK),
+// стоимость не зависит от размера памяти shell) с откатом на обычный fork.
+
+typedef struct {
+    int fds[3];// Дескрипторы для 0, 1, 2 в дочернем процессе (-1 - унаследовать)
+    pid_t pgid;// Группа процессов: 0 - новая группа с pid ребенка, -1 - остаться в группе shell
+    int tty_fd;// Не -1 - ребенок сам делает свою группу группой переднего плана этого терминала, не дожидаясь родителя
+    char **envp;// Окружение команды; NULL - environ
+} spawn_options_t;
+
+void spawn_options_init(spawn_options_t *options);
+int spawn_process(const char *path, char **argv, const spawn_options_t *options, pid_t *pid_out);// 0 или код errno
+
+void spawn_reset_signals(void);// Для fork-пути: стандартные обработчики и пустая маска сигналов
+void spawn_exec(const char *path, char **argv, char **envp);// execve с запуском через /bin/sh при ENOEXEC, возвращается только при ошибке
+
+#endif
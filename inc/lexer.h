@@ -1,17 +1,24 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <stddef.h>
 #include "tokens.h"
+#include "arena.h"
 
 typedef struct {
+    arena_t *arena;// Арена командной строки: лексер, токены, парсер и AST
     const char *input;
+    char *buffer;// Копия ввода в арене: слова - срезы этого буфера
     int position;
     int length;
-    token_t *tokens;
-    token_t *current_token;
+    token_t *tokens;// Непрерывный массив токенов, последний - TOKEN_EOF
+    int token_count;
+    int token_capacity;
+    int current;// Индекс для lexer_get_next_token
 } lexer_t;
 
 lexer_t *lexer_create(const char *input);
+lexer_t *lexer_create_len(const char *input, size_t length);
 void lexer_destroy(lexer_t *lexer);
 token_t *lexer_tokenize(lexer_t *lexer);
 token_t *lexer_get_next_token(lexer_t *lexer);
@@ -19,7 +26,9 @@ void lexer_rewind(lexer_t *lexer);
 
 int is_special_char(char c);
 int is_whitespace(char c);
-char *handle_quotes(lexer_t *lexer, char quote_type);
-char *handle_word(lexer_t *lexer);
+int is_expansion_start(char c);
+int skip_command(const char *buf, int pos, int length);// Конец $(...) или `...`: pos на ( или `, -1 - не закрыта
+int scan_word(lexer_t *lexer, int *flags);// flags - WORD_* найденного слова
+int lexer_next_command(const char *buf, size_t length, size_t *start, size_t *end);// Границы следующей команды скрипта: выполняются по одной
 
 #endif
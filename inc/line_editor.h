@@ -0,0 +1,23 @@
+#ifndef LINE_EDITOR_H
+#define LINE_EDITOR_H
+
+#include "shell.h"
+
+// Редактор командной строки: терминал на время ввода переводится в raw-режим.
+//   Влево/вправо, Home/End, Ctrl-A/Ctrl-E - перемещение курсора
+//   Backspace/Delete - удаление символа, Ctrl-U/Ctrl-K - до начала/до конца строки
+//   Вверх/вниз - история, Ctrl-L - очистить экран
+//   Tab - дополнение команды или пути, второй Tab подряд - список вариантов
+//   Ctrl-C - отменить строку, Ctrl-D на пустой строке - выход
+//   Ctrl-R - инкрементальный поиск по истории: повторный Ctrl-R - следующее
+//   (более старое) совпадение, Enter - выполнить найденное, Ctrl-G - вернуть
+//   исходную строку, любая другая клавиша - продолжить редактирование найденного.
+// Пока ждем нажатия, цикл событий продолжает забирать фоновые процессы.
+
+#define EDITOR_READ_CHUNK 4096// Вставленный текст читается и отрисовывается пачкой
+#define EDITOR_ESCAPE_TIMEOUT_MS 50// Сколько ждать продолжения escape-последовательности
+#define EDITOR_MAX_LIST 300// Больше вариантов не выводим списком
+
+char *line_editor_read(shell_t *shell);// Строка без \n (malloc) или NULL на Ctrl-D/EOF
+
+#endif
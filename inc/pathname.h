@@ -0,0 +1,27 @@
+#ifndef PATHNAME_H
+#define PATHNAME_H
+
+#include <stddef.h>
+
+// Шаблоны имен файлов: * ? [...] ([!...] [^...], диапазоны, [:класс:]).
+// Шаблон компилируется один раз на слово: по / он делится на сегменты,
+// сегмент - на операции (литерал, ?, *, класс). Буквальные сегменты в середине
+// пути каталог не читают, у остальных буквальное начало (foo*.log) сужает
+// двоичным поиском отсортированный список каталога, а буквальный хвост (.log)
+// отсекает имя до полного сопоставления.
+// Каталоги берутся из dir_cache (getdents64, без stat на каждое имя) и
+// обходятся по одному сегменту за шаг; stat нужен только симлинкам и
+// DT_UNKNOWN там, где совпадение должно быть каталогом. Результат отсортирован.
+// \x в шаблоне - буквальный x: так раскрытие передает символы из кавычек.
+
+#define PATHNAME_INITIAL_TEXT 256
+#define PATHNAME_INITIAL_ITEMS 16
+
+typedef int (*pathname_add_t)(void *context, const char *path, size_t length);// Не 0 - ошибка, обход прекращается
+
+// Число совпадений (каждое передано add); 0 - совпадений нет или в шаблоне
+// нет метасимволов; -1 - ошибка. Перед вызовом - dir_cache_next_generation()
+// на каждую команду, иначе каталоги не перепроверятся
+int pathname_expand(const char *pattern, pathname_add_t add, void *context);
+
+#endif
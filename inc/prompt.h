@@ -0,0 +1,26 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include <stddef.h>
+
+// Приглашение shell.
+// Имя пользователя, хост и HOME определяются один раз в prompt_init,
+// текущий каталог перечитывается только после успешного cd.
+// Шаблон PS1 разбирается в сегменты один раз, готовая строка хранится
+// в буфере и пересобирается только когда что-то из этого поменялось.
+//
+// Поддерживаемые escape-последовательности PS1:
+//   \u - пользователь, \h - хост до первой точки, \H - полное имя хоста,
+//   \w - текущий каталог (HOME заменяется на ~), \W - последний компонент,
+//   \$ - '#' для root и '$' для остальных, \n - перевод строки, \\ - обратный слеш
+
+#define PROMPT_DEFAULT_PS1 "\\u@\\H:\\w$ "
+
+void prompt_init(void);
+void prompt_set_template(const char *ps1);// NULL - шаблон по умолчанию
+void prompt_cwd_changed(void);// Вызывается после успешного chdir
+const char *prompt_render(size_t *length);
+void prompt_print(void);
+void prompt_cleanup(void);
+
+#endif
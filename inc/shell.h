@@ -1,41 +1,39 @@
 #ifndef SHELL_H
 #define SHELL_H
 
-#define MAX_HISTORY 100// НОВОЕ: Константы для истории
-#define MAX_LINE_LENGTH 1024
-
-typedef struct history_entry {// Структура для истории команд
-    char *command;
-    struct history_entry *next;
-    struct history_entry *prev;
-} history_entry_t;
+#include <stddef.h>
+#include "history.h"
 
 typedef struct {// Структура shell
     int running;
     
-    // История команд
-    history_entry_t *history_head;
-    history_entry_t *history_tail;
-    history_entry_t *history_current;
-    int history_count;
-    char *history_file;
+    history_t history;// История команд
     
-    // ДОБАВИЛА Для редактирования командной строки
-    char line_buffer[MAX_LINE_LENGTH];
-    int cursor_pos;
-    int line_len;
+    // ДОБАВИЛА Для редактирования командной строки (line_editor.c)
+    char *line_buffer;// Растет по мере ввода - длина строки не ограничена
+    size_t line_capacity;
+    size_t cursor_pos;
+    size_t line_len;
 } shell_t;
 
 shell_t *shell_create(void);
 void shell_destroy(shell_t *shell);
-void shell_run(shell_t *shell);
+void shell_run(shell_t *shell);// Интерактивный режим: приглашение и построчный ввод
+
+int shell_execute_string(const char *input);// Пакетный режим: без приглашения и баннера, ввод целиком
+int shell_execute_file(const char *path);
+int shell_execute_fd(int fd);
 
 void history_add(shell_t *shell, const char *command);// Функции для работы с историей
 void history_load(shell_t *shell);
-void history_save(shell_t *shell);
+void history_close(shell_t *shell);
+size_t history_count(shell_t *shell);
+const char *history_get(shell_t *shell, size_t number);// number от 0 до history_count - 1, от старых к новым
+long history_search(shell_t *shell, const char *query, size_t before);// Самая новая команда с номером < before, содержащая query; -1 - нет
 void history_print(shell_t *shell);
 const char *history_prev(shell_t *shell);
 const char *history_next(shell_t *shell);
+void history_rewind(shell_t *shell);// history_prev снова начнет с самой новой команды
 
 #endif
 
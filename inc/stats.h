@@ -0,0 +1,41 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "builtin_io.h"
+
+// Гистограммы задержек по фазам обработки команды (CLOCK_MONOTONIC).
+// Корзина i содержит длительности из [2^i, 2^(i+1)) наносекунд, счетчики
+// обновляются атомарно - встроенные команды в конвейере пишут из своих потоков.
+// Если задана переменная MYSHELL_STATS_FILE, после каждой команды в этот файл
+// дописывается строка JSON с временем ее фаз.
+
+#define STATS_BUCKETS 40// Последняя корзина - все, что дольше ~9 минут
+#define STATS_FILE_ENV "MYSHELL_STATS_FILE"
+
+typedef enum {
+    STATS_LEX,// lexer_create + lexer_tokenize
+    STATS_PARSE,
+    STATS_SPAWN,// Запуск процесса (posix_spawn или fork в родителе)
+    STATS_WAIT,// Ожидание задачи переднего плана
+    STATS_BUILTIN,// Выполнение встроенной команды
+    STATS_COMMAND,// Вся команда: от разбора до завершения
+    STATS_PHASES
+} stats_phase_t;
+
+typedef struct {// Снимок сумм на начало команды - время фаз команды считается разностью
+    uint64_t start_ns;
+    uint64_t phase_ns[STATS_PHASES];
+} stats_command_t;
+
+uint64_t stats_now(void);// Наносекунды CLOCK_MONOTONIC
+void stats_record(stats_phase_t phase, uint64_t start_ns);// Длительность от start_ns до сейчас
+void stats_command_begin(stats_command_t *command);
+void stats_command_end(stats_command_t *command, const char *text, size_t length, int status, int cached);
+void stats_reset(void);
+void stats_print(builtin_io_t *io);
+
+int builtin_shellstats(char **argv, builtin_io_t *io);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "builtin_io.h"
+
+// Копирование данных между дескрипторами без прохода через память shell.
+// Способ выбирается по типам дескрипторов:
+//   файл -> файл      copy_file_range (на одной ФС - без копирования вовсе)
+//   пайп -> что угодно, что угодно -> пайп   splice
+//   файл -> сокет/tty sendfile
+// Если ядро или ФС способ не поддерживают, копирование продолжается
+// следующим способом с того же места, в конце - обычные read/write.
+
+#define STREAM_CHUNK (1 << 20)// Сколько байт просить у одного вызова splice/copy_file_range
+#define STREAM_BUFFER_SIZE (128 * 1024)// Буфер запасного пути read/write
+
+long long stream_copy(int in_fd, int out_fd);// Скопировано байт или -1 (errno сохранен)
+
+int builtin_cat(char **argv, builtin_io_t *io);
+int builtin_tee(char **argv, builtin_io_t *io);
+int cat_accepts(char **argv);// Опции, которых нет у встроенной версии, - к внешней команде
+int tee_accepts(char **argv);
+int stream_reads_stdin(char **argv);// cat без файлов или с "-", tee - всегда
+
+#endif
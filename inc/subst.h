@@ -0,0 +1,21 @@
+#ifndef SUBST_H
+#define SUBST_H
+
+#include <stddef.h>
+#include "builtin_io.h"
+
+// Подстановка команд: $(команда) и `команда`.
+// Текст разбирается как обычная командная строка (через кэш AST - в цикле
+// разбор не повторяется). Если в нем одни встроенные команды, которые не
+// меняют shell (echo, printf, pwd, test и &&, ||, ; между ними), они
+// выполняются прямо в shell и пишут в буфер в памяти - без пайпа и без fork.
+// Остальное идет задачей в копии shell (cd и exit внутри не трогают сам
+// shell), вывод собирается в memfd и читается после ее завершения: ждать
+// задачу и одновременно читать пайп не нужно, большой вывод не блокирует.
+// Завершающие переводы строк отрезаются на месте.
+
+// Вывод - в output (растет, переиспользуется), с завершающим нулем.
+// Возвращает статус команды (он же становится $?), -1 - ошибка (уже выведена)
+int subst_run(const char *text, size_t length, bio_sink_t *output);
+
+#endif
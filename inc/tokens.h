@@ -1,6 +1,11 @@
 #ifndef TOKENS_H
 #define TOKENS_H
 
+#define WORD_EXPAND 0x1// В слове есть $: хранится исходный текст с кавычками, раскрывается перед запуском
+#define WORD_GLOB 0x2// * ? или [...] вне кавычек - шаблон имен файлов, текст тоже исходный
+#define WORD_BRACE 0x4// {a,b} или {1..N} вне кавычек
+#define WORD_SUBST 0x8// $(...) или `...` - подстановка вывода команды (вместе с WORD_EXPAND)
+
 typedef enum {
     TOKEN_WORD,
     TOKEN_PIPE,
@@ -19,8 +24,9 @@ typedef enum {
 
 typedef struct token {
     token_type_t type;
-    char *value;
-    struct token *next;
+    const char *value;// Слова - срезы буфера лексера, операторы - статические строки
+    int length;// Длина значения без завершающего нуля
+    int flags;// WORD_* для слов
 } token_t;
 
 #endif
@@ -0,0 +1,43 @@
+#ifndef VARIABLES_H
+#define VARIABLES_H
+
+#include <sys/types.h>
+#include "builtin_io.h"
+
+// Переменные shell.
+// Хеш-таблица по имени; переменная хранится одной строкой "ИМЯ=значение",
+// поэтому экспортированные переменные сразу годятся в envp. Массив envp
+// для exec кэшируется и пересобирается только после изменения
+// экспортированной переменной - запуск команды передает готовый указатель.
+// При старте таблица заполняется из environ, все эти переменные экспортированы.
+// Специальные параметры $? $$ $! вычисляются в var_get и не хранятся в таблице.
+
+#define VAR_EXPORT 0x1// Попадает в окружение запускаемых команд
+#define VAR_INITIAL_BUCKETS 128
+
+typedef struct var_saved var_saved_t;// Значения до временных присваиваний VAR=val команда
+
+const char *var_get(const char *name);// NULL - переменная не задана
+const char *var_get_len(const char *name, size_t length);// Имя - срез строки, без завершающего нуля
+int var_set(const char *name, const char *value, int flags);// flags добавляются к имеющимся; -1 - неверное имя
+int var_unset(const char *name);
+int var_export(const char *name, int export);// Без значения: export X пометит X, значение появится при присваивании
+
+char **var_envp(void);// Кэш; действителен до следующего изменения экспортированной переменной
+size_t var_envp_size(void);// Сколько envp займет в exec (строки и указатели) - в счет ARG_MAX
+char **var_envp_with(char **assignments, int count);// envp с временными присваиваниями (malloc, free только массив)
+
+int var_valid_name(const char *name, size_t length);
+int var_assignment_count(char **argv);// Сколько слов в начале команды - присваивания ИМЯ=значение
+int var_assign(char **assignments, int count);// Постоянные присваивания (команда из одних присваиваний)
+var_saved_t *var_assign_temporary(char **assignments, int count);// Для встроенной команды: IFS=: read a b
+void var_restore(var_saved_t *saved);
+
+void var_set_status(int status);// $?
+int var_status(void);
+void var_set_last_background(pid_t pid);// $!
+
+int builtin_export(char **argv, builtin_io_t *io);
+int builtin_unset(char **argv, builtin_io_t *io);
+
+#endif
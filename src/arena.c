@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include "arena.h"
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+
+static arena_block_t *new_block(size_t size) {
+    arena_block_t *block = malloc(sizeof(arena_block_t) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+
+arena_t *arena_create(size_t block_size) {// Первый блок выделяется вместе со структурой арены
+    if (block_size < sizeof(arena_t) + ARENA_ALIGN) {
+        block_size = ARENA_DEFAULT_BLOCK;
+    }
+
+    arena_block_t *block = new_block(block_size);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    arena_t *arena = (arena_t *)block->data;// Сама арена живет в начале своего первого блока
+    block->used = (sizeof(arena_t) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    arena->head = block;
+    arena->block_size = block_size;
+    return arena;
+}
+
+
+static arena_block_t *first_block(arena_t *arena) {// Блок, в котором лежит сама арена
+    arena_block_t *block = arena->head;
+    while (block->next != NULL) {
+        block = block->next;
+    }
+    return block;
+}
+
+
+void arena_destroy(arena_t *arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    arena_block_t *block = arena->head;
+    while (block != NULL) {// Первый блок (с самой ареной) освобождается последним
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+
+void arena_reset(arena_t *arena) {
+    arena_block_t *first = first_block(arena);
+
+    arena_block_t *block = arena->head;
+    while (block != first) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    first->used = (sizeof(arena_t) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    arena->head = first;
+}
+
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    arena_block_t *block = arena->head;
+    if (block->used + size > block->size) {// Не помещается - новый блок, каждый следующий вдвое больше
+        size_t block_size = arena->block_size * 2;
+        if (block_size < size) {
+            block_size = size;
+        }
+
+        block = new_block(block_size);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = arena->head;
+        arena->head = block;
+        arena->block_size = block_size;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+
+char *arena_strndup(arena_t *arena, const char *str, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+
+char *arena_strdup(arena_t *arena, const char *str) {
+    return arena_strndup(arena, str, strlen(str));
+}
@@ -4,8 +4,8 @@
 #include "ast.h"
 
 
-ast_node_t *ast_create_node(node_type_t type) {//создание узла для разных типов операторов измм (созд узел нужного типа)
-    ast_node_t *node = (ast_node_t*)malloc(sizeof(ast_node_t));
+ast_node_t *ast_create_node(arena_t *arena, node_type_t type) {//создание узла для разных типов операторов измм (созд узел нужного типа)
+    ast_node_t *node = (ast_node_t*)arena_alloc(arena, sizeof(ast_node_t));
     if (node == NULL) {
         return NULL;
     }
@@ -18,6 +18,7 @@ ast_node_t *ast_create_node(node_type_t type) {//создание узла дл
         case NODE_COMMAND:
             node->data.command.argv = NULL;
             node->data.command.argc = 0;
+            node->data.command.word_flags = NULL;
             break;
         case NODE_PIPE:
             node->data.pipe.redirect_err = 0;
@@ -27,6 +28,7 @@ ast_node_t *ast_create_node(node_type_t type) {//создание узла дл
             node->data.redirect.out_file = NULL;
             node->data.redirect.err_file = NULL;
             node->data.redirect.append = 0;
+            node->data.redirect.file_flags = 0;
             break;
         default:// Для остальных типов ничего не инициализируем
             break;
@@ -35,8 +37,8 @@ ast_node_t *ast_create_node(node_type_t type) {//создание узла дл
 }
 
 //доступ через data.command
-ast_node_t *ast_create_command_node(char **argv, int argc) {// Создание узла команды с аргументами изм
-    ast_node_t *node = ast_create_node(NODE_COMMAND);
+ast_node_t *ast_create_command_node(arena_t *arena, char **argv, int argc) {// Создание узла команды с аргументами изм
+    ast_node_t *node = ast_create_node(arena, NODE_COMMAND);
     if (node == NULL) {
         return NULL;
     }
@@ -44,48 +46,6 @@ ast_node_t *ast_create_command_node(char **argv, int argc) {// Создание
     node->data.command.argc = argc;
     return node;
 }
-//добавила switch и доступ через union
-void ast_destroy(ast_node_t *node) {// Рекурсивное уничтожение AST дерева
-    if (node == NULL) {
-        return;
-    }
-    switch (node->type) {
-        case NODE_COMMAND:
-            if (node->data.command.argv != NULL) {
-                for (int i = 0; i < node->data.command.argc; i++) {
-                    if (node->data.command.argv[i] != NULL) {
-                        free(node->data.command.argv[i]);
-                    }
-                }
-                free(node->data.command.argv);
-            }
-            break;
-        
-        case NODE_REDIRECT:
-            if (node->data.redirect.in_file != NULL) {
-                free(node->data.redirect.in_file);
-            }
-            if (node->data.redirect.out_file != NULL) {
-                free(node->data.redirect.out_file);
-            }
-            if (node->data.redirect.err_file != NULL) {
-                free(node->data.redirect.err_file);
-            }
-            break;
-        
-        default:
-            break;
-    }
-    if (node->left != NULL) {
-        ast_destroy(node->left);
-    }
-    if (node->right != NULL) {
-        ast_destroy(node->right);
-    }
-    free(node);
-}
-
-
 // все обращения через union
 void ast_print(ast_node_t *node, int depth) {// Рекурсивная печать AST для отладки изм
     if (node == NULL) {
@@ -152,6 +112,9 @@ void ast_print(ast_node_t *node, int depth) {// Рекурсивная печа
         case NODE_SUBSHELL:
             printf("SUBSHELL");
             break;
+        case NODE_TIME:
+            printf("TIME");
+            break;
         default:
             printf("UNKNOWN");
             break;
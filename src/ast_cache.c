@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast_cache.h"
+
+#define AST_CACHE_MIN_BUCKETS 16
+
+static ast_cache_entry_t **buckets = NULL;
+static size_t bucket_count = 0;
+static size_t capacity = 0;
+static size_t entry_count = 0;
+static int initialized = 0;
+
+static ast_cache_entry_t *lru_head = NULL;// Самая свежая запись
+static ast_cache_entry_t *lru_tail = NULL;// Кандидат на вытеснение
+
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+static unsigned long evictions = 0;
+
+
+static unsigned long hash_input(const char *input, size_t length) {// FNV-1a по байтам: строка может быть без нуля на конце
+    unsigned long hash = 2166136261UL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)input[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+
+static size_t buckets_for(size_t size) {// Степень двойки не меньше 2 * capacity
+    size_t count = AST_CACHE_MIN_BUCKETS;
+    while (count < size * 2) {
+        count *= 2;
+    }
+    return count;
+}
+
+
+static int resize_buckets(size_t count) {// Перекладывает записи в таблицу нового размера
+    ast_cache_entry_t **table = calloc(count, sizeof(ast_cache_entry_t*));
+    if (table == NULL) {
+        return -1;
+    }
+
+    for (ast_cache_entry_t *entry = lru_head; entry != NULL; entry = entry->lru_next) {
+        size_t index = entry->hash & (count - 1);
+        entry->chain = table[index];
+        table[index] = entry;
+    }
+
+    free(buckets);
+    buckets = table;
+    bucket_count = count;
+    return 0;
+}
+
+
+static void ensure_init(void) {// Размер берется из MYSHELL_AST_CACHE_SIZE при первом обращении
+    if (initialized) {
+        return;
+    }
+    initialized = 1;
+
+    capacity = AST_CACHE_DEFAULT_SIZE;
+    const char *env = getenv("MYSHELL_AST_CACHE_SIZE");
+    if (env != NULL && *env != '\0') {
+        char *end;
+        long value = strtol(env, &end, 10);
+        if (*end == '\0' && value >= 0) {
+            capacity = (size_t)value;
+        } else {
+            fprintf(stderr, "Ошибка: неверное значение MYSHELL_AST_CACHE_SIZE: %s\n", env);
+        }
+    }
+
+    if (capacity > 0 && resize_buckets(buckets_for(capacity)) < 0) {
+        capacity = 0;
+    }
+}
+
+
+static void entry_free(ast_cache_entry_t *entry) {
+    arena_destroy(entry->arena);// Ключ, токены и дерево лежат в арене
+    free(entry);
+}
+
+
+static void lru_unlink(ast_cache_entry_t *entry) {
+    if (entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+
+static void lru_push_front(ast_cache_entry_t *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = lru_head;
+    if (lru_head != NULL) {
+        lru_head->lru_prev = entry;
+    }
+    lru_head = entry;
+    if (lru_tail == NULL) {
+        lru_tail = entry;
+    }
+}
+
+
+static void evict(ast_cache_entry_t *entry) {// Убирает запись из кэша; закрепленная доживет до release
+    ast_cache_entry_t **link = &buckets[entry->hash & (bucket_count - 1)];
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+
+    lru_unlink(entry);
+    entry->cached = 0;
+    entry_count--;
+
+    if (entry->refs == 0) {
+        entry_free(entry);
+    }
+}
+
+
+static ast_cache_entry_t *find(unsigned long hash, const char *input, size_t length) {
+    for (ast_cache_entry_t *entry = buckets[hash & (bucket_count - 1)]; entry != NULL; entry = entry->chain) {
+        if (entry->hash == hash && entry->key_len == length && memcmp(entry->key, input, length) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+
+ast_cache_entry_t *ast_cache_lookup(const char *input, size_t length) {
+    ensure_init();
+    if (capacity == 0 || length > AST_CACHE_MAX_KEY) {
+        return NULL;
+    }
+
+    ast_cache_entry_t *entry = find(hash_input(input, length), input, length);
+    if (entry == NULL) {
+        misses++;
+        return NULL;
+    }
+
+    hits++;
+    if (entry != lru_head) {
+        lru_unlink(entry);
+        lru_push_front(entry);
+    }
+    entry->refs++;
+    return entry;
+}
+
+
+ast_cache_entry_t *ast_cache_insert(const char *input, size_t length, arena_t *arena, ast_node_t *ast) {// При ошибке NULL, арена остается у вызывающего
+    ensure_init();
+
+    ast_cache_entry_t *entry = malloc(sizeof(ast_cache_entry_t));
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    entry->hash = hash_input(input, length);
+    entry->key = NULL;
+    entry->key_len = length;
+    entry->arena = arena;
+    entry->ast = ast;
+    entry->refs = 1;// Вызывающий сразу выполняет дерево
+    entry->cached = 0;
+    entry->chain = NULL;
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+
+    if (capacity == 0 || length > AST_CACHE_MAX_KEY) {// Не кэшируем - запись живет до release
+        return entry;
+    }
+
+    entry->key = arena_strndup(arena, input, length);// Ввод вызывающего (буфер readline, mmap) скоро исчезнет
+    if (entry->key == NULL) {
+        return entry;
+    }
+
+    ast_cache_entry_t *old = find(entry->hash, input, length);// Та же строка могла попасть в кэш из вложенного source
+    if (old != NULL) {
+        evict(old);
+    }
+
+    size_t index = entry->hash & (bucket_count - 1);
+    entry->chain = buckets[index];
+    buckets[index] = entry;
+    lru_push_front(entry);
+    entry->cached = 1;
+    entry_count++;
+
+    while (entry_count > capacity) {// Новая запись в голове списка, вытесняется хвост
+        evictions++;
+        evict(lru_tail);
+    }
+
+    return entry;
+}
+
+
+void ast_cache_release(ast_cache_entry_t *entry) {
+    if (entry == NULL) {
+        return;
+    }
+
+    entry->refs--;
+    if (entry->refs == 0 && !entry->cached) {
+        entry_free(entry);
+    }
+}
+
+
+void ast_cache_clear(void) {
+    ensure_init();
+    while (lru_head != NULL) {
+        evict(lru_head);
+    }
+}
+
+
+void ast_cache_set_capacity(size_t size) {
+    ensure_init();
+
+    while (entry_count > size) {
+        evictions++;
+        evict(lru_tail);
+    }
+
+    if (size > 0 && buckets_for(size) != bucket_count) {
+        if (resize_buckets(buckets_for(size)) < 0) {
+            fprintf(stderr, "Ошибка: не удалось изменить размер кэша AST\n");
+            return;
+        }
+    }
+    capacity = size;
+}
+
+
+void ast_cache_print_stats(builtin_io_t *io) {
+    ensure_init();
+
+    unsigned long total = hits + misses;
+    bio_printf(io, "Кэш AST: записей %zu из %zu\n", entry_count, capacity);
+    bio_printf(io, "  попаданий: %lu\n", hits);
+    bio_printf(io, "  промахов:  %lu\n", misses);
+    bio_printf(io, "  вытеснено: %lu\n", evictions);
+    if (total > 0) {
+        bio_printf(io, "  доля попаданий: %.1f%%\n", 100.0 * hits / total);
+    }
+}
+
+
+int builtin_astcache(char **argv, builtin_io_t *io) {//astcache [-c] [-s размер] - статистика и настройка кэша AST
+    if (argv[1] == NULL) {
+        ast_cache_print_stats(io);
+        return 0;
+    }
+
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (strcmp(argv[i], "-c") == 0) {// Очистить кэш
+            ast_cache_clear();
+        } else if (strcmp(argv[i], "-s") == 0 && argv[i + 1] != NULL) {
+            char *end;
+            long size = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || size < 0) {
+                bio_error(io, "astcache: %s: неверный размер\n", argv[i]);
+                return 1;
+            }
+            ast_cache_set_capacity((size_t)size);
+        } else {
+            bio_error(io, "astcache: использование: astcache [-c] [-s размер]\n");
+            return 2;
+        }
+    }
+    return 0;
+}
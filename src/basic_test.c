@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include "../inc/lexer.h"
 #include "../inc/parser.h"
@@ -28,11 +29,10 @@ void test_parser() {
     
     assert(ast != NULL);
     assert(ast->type == NODE_COMMAND);
-    assert(ast->argc == 3);
+    assert(ast->data.command.argc == 3);
     
     printf("Тест парсера пройден!\n");
     
-    ast_destroy(ast);
     parser_destroy(parser);
     lexer_destroy(lexer);
 }
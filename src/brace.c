@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "brace.h"
+#include "lexer.h"
+
+typedef struct {
+    const char *open;
+    const char *close;
+    int sequence;// {x..y[..шаг]}, иначе список через запятую
+    long long first;
+    long long last;
+    long long step;
+    int width;// Ширина с ведущими нулями ({01..10}), 0 - без них
+    int chars;// {a..z}
+} group_t;
+
+typedef struct pending {// Что раскрывать после текущего куска: хвост слова за группой
+    const char *text;
+    const char *end;
+    const struct pending *next;
+} pending_t;
+
+typedef struct {
+    brace_buffer_t *buffer;
+    brace_emit_t emit;
+    void *context;
+} walk_t;
+
+
+static int append(brace_buffer_t *buffer, const char *text, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : BRACE_INITIAL_BUFFER;
+        while (capacity < buffer->length + length) {
+            capacity *= 2;
+        }
+        char *grown = realloc(buffer->text, capacity);
+        if (grown == NULL) {
+            perror("malloc");
+            return -1;
+        }
+        buffer->text = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->text + buffer->length, text, length);
+    buffer->length += length;
+    return 0;
+}
+
+
+static const char *skip_substitution(const char *p, const char *end) {// p на $( или `, результат - на последнем символе подстановки
+    int close = skip_command(p, *p == '$', end - p);
+    return close < 0 ? NULL : p + close - 1;
+}
+
+
+// От p (после {) до первой запятой верхнего уровня (comma) или до закрывающей }.
+// Кавычки, \ и вложенные ${...} пропускаются. NULL - скобка не закрыта
+static const char *scan_group(const char *p, const char *end, int comma) {
+    int depth = 0;
+    char quote = 0;
+    for (; p < end; p++) {
+        char c = *p;
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = 0;
+            }
+        } else if (c == '\\') {
+            p++;
+        } else if (quote == '"') {
+            if (c == '"') {
+                quote = 0;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '$' && p + 1 < end && p[1] == '{') {
+            p = scan_group(p + 2, end, 0);
+            if (p == NULL) {
+                return NULL;
+            }
+        } else if ((c == '$' && p + 1 < end && p[1] == '(') || c == '`') {
+            p = skip_substitution(p, end);
+            if (p == NULL) {
+                return NULL;
+            }
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}') {
+            if (depth == 0) {
+                return p;
+            }
+            depth--;
+        } else if (c == ',' && comma && depth == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+
+static int parse_number(const char *p, const char *end, long long *value, int *padded) {// Целое со знаком; padded - есть ведущий 0
+    const char *digits = p;
+    if (digits < end && (*digits == '-' || *digits == '+')) {
+        digits++;
+    }
+    if (digits >= end || end - digits > 18) {
+        return 0;
+    }
+    long long result = 0;
+    for (const char *d = digits; d < end; d++) {
+        if (!isdigit((unsigned char)*d)) {
+            return 0;
+        }
+        result = result * 10 + (*d - '0');
+    }
+    *value = (*p == '-') ? -result : result;
+    *padded = end - digits > 1 && digits[0] == '0';
+    return 1;
+}
+
+
+static int parse_sequence(const char *p, const char *end, group_t *group) {// x..y или x..y..шаг
+    const char *dots = NULL;
+    for (const char *q = p; q + 1 < end; q++) {
+        if (q[0] == '.' && q[1] == '.') {
+            dots = q;
+            break;
+        }
+    }
+    if (dots == NULL) {
+        return 0;
+    }
+    const char *second = dots + 2;
+    const char *second_end = end;
+    for (const char *q = second; q + 1 < end; q++) {
+        if (q[0] == '.' && q[1] == '.') {
+            second_end = q;
+            break;
+        }
+    }
+
+    group->step = 1;
+    if (second_end != end) {
+        int unused;
+        if (!parse_number(second_end + 2, end, &group->step, &unused)) {
+            return 0;
+        }
+        if (group->step < 0) {
+            group->step = -group->step;
+        }
+        if (group->step == 0) {
+            group->step = 1;
+        }
+    }
+
+    if (dots - p == 1 && second_end - second == 1 &&
+        !isdigit((unsigned char)p[0]) && !isdigit((unsigned char)second[0])) {// {a..z}
+        group->chars = 1;
+        group->width = 0;
+        group->first = (unsigned char)p[0];
+        group->last = (unsigned char)second[0];
+        return isalpha((unsigned char)p[0]) && isalpha((unsigned char)second[0]);
+    }
+
+    int first_padded, last_padded;
+    if (!parse_number(p, dots, &group->first, &first_padded) ||
+        !parse_number(second, second_end, &group->last, &last_padded)) {
+        return 0;
+    }
+    group->chars = 0;
+    group->width = 0;
+    if (first_padded || last_padded) {// Ширина - по более длинному из концов: {01..100} -> 001 ... 100
+        int first_length = (int)(dots - p), last_length = (int)(second_end - second);
+        group->width = first_length > last_length ? first_length : last_length;
+    }
+    return 1;
+}
+
+
+static const char *find_group(const char *p, const char *end, group_t *group) {// Первая группа вне кавычек
+    char quote = 0;
+    for (; p < end; p++) {
+        char c = *p;
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = 0;
+            }
+        } else if (c == '\\') {
+            p++;
+        } else if (quote == '"') {
+            if (c == '"') {
+                quote = 0;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '$' && p + 1 < end && p[1] == '{') {
+            const char *close = scan_group(p + 2, end, 0);
+            if (close == NULL) {
+                return NULL;
+            }
+            p = close;
+        } else if ((c == '$' && p + 1 < end && p[1] == '(') || c == '`') {
+            p = skip_substitution(p, end);
+            if (p == NULL) {
+                return NULL;
+            }
+        } else if (c == '{') {
+            const char *close = scan_group(p + 1, end, 0);
+            if (close == NULL) {
+                continue;
+            }
+            group->open = p;
+            group->close = close;
+            group->sequence = 0;
+            if (scan_group(p + 1, close + 1, 1) != close) {
+                return p;
+            }
+            if (parse_sequence(p + 1, close, group)) {
+                group->sequence = 1;
+                return p;
+            }
+            // {x} без запятой - обычный текст, но внутри могут быть группы: {a{b,c}}
+        }
+    }
+    return NULL;
+}
+
+
+static int walk(walk_t *walk_state, const char *p, const char *end, const pending_t *rest);
+
+
+static int walk_sequence(walk_t *walk_state, const group_t *group, const char *end, const pending_t *rest) {
+    brace_buffer_t *buffer = walk_state->buffer;
+    size_t mark = buffer->length;
+    unsigned long long span = group->first <= group->last
+        ? (unsigned long long)(group->last - group->first)
+        : (unsigned long long)(group->first - group->last);
+    unsigned long long count = span / (unsigned long long)group->step + 1;
+    long long direction = group->first <= group->last ? group->step : -group->step;
+
+    long long value = group->first;
+    for (unsigned long long i = 0; i < count; i++) {
+        char text[32];
+        int length;
+        if (group->chars) {
+            length = 0;
+            if (!isalnum((int)value)) {// Между Z и a есть [ \ ] - раскрытие не должно принять их за синтаксис
+                text[length++] = '\\';
+            }
+            text[length++] = (char)value;
+        } else {
+            length = snprintf(text, sizeof(text), "%0*lld", group->width, value);
+        }
+        buffer->length = mark;
+        if (append(buffer, text, length) < 0) {
+            return -1;
+        }
+        int status = walk(walk_state, group->close + 1, end, rest);
+        if (status != 0) {
+            return status;
+        }
+        if (i + 1 < count) {
+            value += direction;// После последнего значения не прибавляем - не переполнится у LLONG_MAX
+        }
+    }
+    return 0;
+}
+
+
+// Раскрывает [p, end), затем куски из rest. Глубина рекурсии - число групп
+// в слове, а не число вариантов
+static int walk(walk_t *walk_state, const char *p, const char *end, const pending_t *rest) {
+    brace_buffer_t *buffer = walk_state->buffer;
+    size_t start = buffer->length;
+    group_t group;
+    const char *open = find_group(p, end, &group);
+    int status;
+
+    if (open == NULL) {
+        if (append(buffer, p, end - p) < 0) {
+            return -1;
+        }
+        if (rest != NULL) {
+            status = walk(walk_state, rest->text, rest->end, rest->next);
+        } else {
+            status = walk_state->emit(walk_state->context, buffer->text, buffer->length);
+        }
+        buffer->length = start;
+        return status;
+    }
+
+    if (append(buffer, p, open - p) < 0) {
+        return -1;
+    }
+    if (group.sequence) {
+        status = walk_sequence(walk_state, &group, end, rest);
+    } else {
+        size_t mark = buffer->length;
+        pending_t after = { group.close + 1, end, rest };
+        const char *alternative = open + 1;
+        while (1) {
+            const char *alternative_end = scan_group(alternative, group.close + 1, 1);
+            buffer->length = mark;
+            status = walk(walk_state, alternative, alternative_end, &after);
+            if (status != 0 || alternative_end == group.close) {
+                break;
+            }
+            alternative = alternative_end + 1;
+        }
+    }
+    buffer->length = start;
+    return status;
+}
+
+
+int brace_expand(brace_buffer_t *buffer, const char *word, size_t length, brace_emit_t emit, void *context) {
+    walk_t walk_state = { buffer, emit, context };
+    buffer->length = 0;
+    return walk(&walk_state, word, word + length, NULL);
+}
+
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "builtin_io.h"
+
+int write_all(int fd, const void *data, size_t length) {// write до конца, с повтором после сигнала
+    const char *p = data;
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        length -= n;
+    }
+    return 0;
+}
+
+
+int bio_sink_append(bio_sink_t *sink, const void *data, size_t length) {
+    if (sink->length + length + 1 > sink->capacity) {
+        size_t capacity = sink->capacity ? sink->capacity : BIO_SINK_INITIAL;
+        while (capacity < sink->length + length + 1) {
+            capacity *= 2;
+        }
+        char *grown = realloc(sink->data, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        sink->data = grown;
+        sink->capacity = capacity;
+    }
+    memcpy(sink->data + sink->length, data, length);
+    sink->length += length;
+    return 0;
+}
+
+
+static int emit(builtin_io_t *io, const void *data, size_t length) {// Мимо буфера: в память или в дескриптор
+    if (io->sink != NULL) {
+        return bio_sink_append(io->sink, data, length);
+    }
+    return write_all(io->out_fd, data, length);
+}
+
+
+void bio_init(builtin_io_t *io, int in_fd, int out_fd, int err_fd) {
+    io->in_fd = in_fd;
+    io->out_fd = out_fd;
+    io->err_fd = err_fd;
+    io->sink = NULL;
+    io->failed = 0;
+    io->len = 0;
+}
+
+
+int bio_flush(builtin_io_t *io) {
+    if (io->len > 0 && !io->failed && emit(io, io->buf, io->len) < 0) {
+        io->failed = 1;// Дальше не пишем: SIGPIPE в shell игнорируется, команда должна сама остановиться
+    }
+    io->len = 0;
+    return io->failed ? -1 : 0;
+}
+
+
+int bio_write(builtin_io_t *io, const void *data, size_t length) {
+    if (io->failed) {
+        return -1;
+    }
+
+    if (io->len + length > BIO_BUFFER_SIZE) {
+        if (bio_flush(io) < 0) {
+            return -1;
+        }
+        if (length > BIO_BUFFER_SIZE) {// Большой кусок - мимо буфера
+            if (emit(io, data, length) < 0) {
+                io->failed = 1;
+                return -1;
+            }
+            return 0;
+        }
+    }
+
+    memcpy(io->buf + io->len, data, length);
+    io->len += length;
+    return 0;
+}
+
+
+int bio_puts(builtin_io_t *io, const char *str) {
+    return bio_write(io, str, strlen(str));
+}
+
+
+int bio_printf(builtin_io_t *io, const char *format, ...) {
+    char small[512];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (length < 0) {
+        return -1;
+    }
+    if ((size_t)length < sizeof(small)) {
+        return bio_write(io, small, length);
+    }
+
+    char *big = malloc(length + 1);// Редкий длинный вывод (путь, длинный аргумент)
+    if (big == NULL) {
+        return -1;
+    }
+    va_start(args, format);
+    vsnprintf(big, length + 1, format, args);
+    va_end(args);
+    int result = bio_write(io, big, length);
+    free(big);
+    return result;
+}
+
+
+void bio_error(builtin_io_t *io, const char *format, ...) {
+    char message[1024];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length >= sizeof(message)) {
+        length = sizeof(message) - 1;
+    }
+
+    if (io->err_fd == io->out_fd) {// |& или &> в один файл - сохраняем порядок с обычным выводом
+        bio_flush(io);
+    }
+    write_all(io->err_fd, message, length);
+}
+
+
+void bio_perror(builtin_io_t *io, const char *what) {
+    int err = errno;// bio_error может затереть errno
+    bio_error(io, "%s: %s\n", what, strerror(err));
+}
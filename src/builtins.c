@@ -1,49 +1,63 @@
+#define _GNU_SOURCE
 #include <stdio.h>//изм встр команды
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include "builtins.h"
+#include "job_control.h"
+#include "command_hash.h"
+#include "ast_cache.h"
+#include "prompt.h"
+#include "shell.h"
+#include "stats.h"
+#include "stream.h"
+#include "core_builtins.h"
+#include "variables.h"
 
 //встроенные команды shell
 
 
-int builtin_cd(char **argv) {//cd сменить текущую директорию
+int builtin_cd(char **argv, builtin_io_t *io) {//cd сменить текущую директорию
     if (argv[1] == NULL) {// Если аргумента нет, переходим в домашнюю директорию
-        char *home = getenv("HOME");
+        const char *home = var_get("HOME");
         if (home == NULL) {
-            fprintf(stderr, "cd: HOME не установлена\n");
+            bio_error(io, "cd: HOME не установлена\n");
             return 1;
         }
         if (chdir(home) != 0) {
-            perror("cd");
+            bio_perror(io, "cd");
             return 1;
         }
     } else {//меняем директорию на указанную
         if (chdir(argv[1]) != 0) {
-            perror("cd");
+            bio_perror(io, "cd");
             return 1;
         }
     }
+    prompt_cwd_changed();// Приглашение перечитает каталог только теперь
     return 0;
 }
 
 
-int builtin_pwd(char **argv) {//pwd показать текущую директорию
+int builtin_pwd(char **argv, builtin_io_t *io) {//pwd показать текущую директорию
     (void)argv; //игнорируем аргументы
     
     char cwd[1024];//Буфер для текущей директории
     if (getcwd(cwd, sizeof(cwd)) != NULL) {
-        printf("%s\n", cwd);//Печатаем текущую директорию
+        bio_printf(io, "%s\n", cwd);//Печатаем текущую директорию
         return 0;
     } else {
-        perror("pwd");// ошибка если не удалось
+        bio_perror(io, "pwd");// ошибка если не удалось
         return 1;
     }
 }
 
 
-int builtin_echo(char **argv) {//echo напечатать текст
+int builtin_echo(char **argv, builtin_io_t *io) {//echo напечатать текст
     int i = 1;//Начинаем с первого аргумента это"echo"
     int newline = 1;//По умолчанию печатаем перевод строки в конце
     
@@ -53,103 +67,300 @@ int builtin_echo(char **argv) {//echo напечатать текст
     }
     
     while (argv[i] != NULL) {// Печатаем все аргументы через пробел
-        printf("%s", argv[i]);
+        bio_puts(io, argv[i]);
         if (argv[i + 1] != NULL) {
-            printf(" ");//печатаем пробел между аргументами
+            bio_write(io, " ", 1);//печатаем пробел между аргументами
         }
         i++;
     }
     
     
     if (newline) {//перевод строки если нужно
-        printf("\n");
+        bio_write(io, "\n", 1);
     }
     
     return 0;
 }
 
 
-int builtin_exit(char **argv) {//завершение работы shell
+int builtin_true(char **argv, builtin_io_t *io) {//true, : - ничего не делать успешно
+    (void)argv;
+    (void)io;
+    return 0;
+}
+
+
+int builtin_false(char **argv, builtin_io_t *io) {//false - ничего не делать с ошибкой
+    (void)argv;
+    (void)io;
+    return 1;
+}
+
+
+int builtin_exit(char **argv, builtin_io_t *io) {//завершение работы shell
+    (void)io;
     if (argv[1] != NULL) {//если указан код выхода
         exit(atoi(argv[1]));//вызвать exit() с кодом для аргумента
     } else {
-        exit(0);//иначе с кодом 0
+        exit(var_status());//иначе с кодом последней команды
     }
 }
 
 
-int builtin_help(char **argv) {//help показать справку
+int builtin_source(char **argv, builtin_io_t *io) {//source (.) - выполнить файл в текущем shell
+    if (argv[1] == NULL) {
+        bio_error(io, "%s: использование: %s <файл>\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    int status = shell_execute_file(argv[1]);
+    return status < 0 ? 1 : status;
+}
+
+
+int builtin_times(char **argv, builtin_io_t *io) {//times - время shell и завершившихся дочерних процессов
     (void)argv;
+    struct rusage self;
+    struct rusage children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);// Только забранные процессы - их забирает цикл событий
+
+    print_duration(io, timeval_seconds(&self.ru_utime));
+    bio_write(io, " ", 1);
+    print_duration(io, timeval_seconds(&self.ru_stime));
+    bio_write(io, "\n", 1);
+    print_duration(io, timeval_seconds(&children.ru_utime));
+    bio_write(io, " ", 1);
+    print_duration(io, timeval_seconds(&children.ru_stime));
+    bio_write(io, "\n", 1);
+    return 0;
+}
+
+
+int builtin_help(char **argv, builtin_io_t *io) {//help показать справку
+    (void)argv;
+    
+    bio_puts(io, "Simple Shell - Встроенные команды:\n\n");
+    bio_puts(io, "  cd [директория] - сменить текущую директорию\n");
+    bio_puts(io, "  pwd - показать текущую директорию\n");
+    bio_puts(io, "  echo [текст] - вывести текст\n");
+    bio_puts(io, "  cat [-u] [файл ...] - вывести файлы (с другими опциями - внешний cat)\n");
+    bio_puts(io, "  tee [-a] [файл ...] - копировать ввод в вывод и в файлы (-a - дописывать)\n");
+    bio_puts(io, "  true, :, false - вернуть 0 или 1\n");
+    bio_puts(io, "  test <выражение>, [ <выражение> ] - проверить условие (-f, -d, -z, =, -eq, !, -a, -o ...)\n");
+    bio_puts(io, "  printf <формат> [аргументы] - форматированный вывод\n");
+    bio_puts(io, "  read [-r] [-p приглашение] [имя ...] - прочитать строку в переменные\n");
+    bio_puts(io, "  exit [код] - выйти из shell (без кода - с кодом последней команды)\n");
+    bio_puts(io, "  export [-n] [имя[=значение] ...] - передавать переменную запускаемым командам\n");
+    bio_puts(io, "  unset имя ... - удалить переменную\n");
+    bio_puts(io, "  help - показать эту справку\n");
+    bio_puts(io, "  jobs [-v] - показать фоновые задачи (-v - время и ресурсы завершившихся процессов)\n");
+    bio_puts(io, "  fg <job_id> - перевести задачу в foreground\n");
+    bio_puts(io, "  bg <job_id> - перевести задачу в background\n");
+    bio_puts(io, "  kill <job_id> - завершить задачу\n");
+    bio_puts(io, "  wait [-n] [%job_id | pid ...] - дождаться фоновых задач (-n - первой завершившейся)\n");
+    bio_puts(io, "  hash [-r] [команда] - показать или сбросить кэш путей команд\n");
+    bio_puts(io, "  source <файл>, . <файл> - выполнить файл в текущем shell\n");
+    bio_puts(io, "  times - время процессора shell и его дочерних процессов\n");
+    bio_puts(io, "  shellstats [-r] - гистограммы времени фаз: разбор, запуск, ожидание, встроенные команды\n");
+    bio_puts(io, "  time <конвейер> - время, память и переключения контекста конвейера\n");
+    bio_puts(io, "  astcache [-c] [-s размер] - статистика и настройка кэша разобранных команд\n\n");
+    
+    bio_puts(io, "Операторы:\n");
+    bio_puts(io, "  cmd1 | cmd2 - конвейер (передать вывод cmd1 в cmd2)\n");
+    bio_puts(io, "  cmd1 && cmd2 - выполнить cmd2 только если cmd1 успешна\n");
+    bio_puts(io, "  cmd1 || cmd2 - выполнить cmd2 только если cmd1 неуспешна\n");
+    bio_puts(io, "  cmd1 ; cmd2 - выполнить команды последовательно\n");
+    bio_puts(io, "  cmd & - выполнить команду в фоне\n");
+    bio_puts(io, "  VAR=значение [cmd] - присвоить переменную shell или только для cmd\n\n");
     
-    printf("Simple Shell - Встроенные команды:\n\n");
-    printf("  cd [директория] - сменить текущую директорию\n");
-    printf("  pwd - показать текущую директорию\n");
-    printf("  echo [текст] - вывести текст\n");
-    printf("  exit [код] - выйти из shell\n");
-    printf("  help - показать эту справку\n");
-    printf("  jobs - показать фоновые задачи\n");
-    printf("  fg <job_id> - перевести задачу в foreground\n");
-    printf("  bg <job_id> - перевести задачу в background\n");
-    printf("  kill <job_id> - завершить задачу\n\n");
-    
-    printf("Операторы:\n");
-    printf("  cmd1 | cmd2 - конвейер (передать вывод cmd1 в cmd2)\n");
-    printf("  cmd1 && cmd2 - выполнить cmd2 только если cmd1 успешна\n");
-    printf("  cmd1 || cmd2 - выполнить cmd2 только если cmd1 неуспешна\n");
-    printf("  cmd1 ; cmd2 - выполнить команды последовательно\n");
-    printf("  cmd & - выполнить команду в фоне\n\n");
-    
-    printf("Перенаправления:\n");
-    printf("  cmd > file - записать вывод в file\n");
-    printf("  cmd >> file - добавить вывод в file\n");
-    printf("  cmd < file - читать ввод из file\n");
-    printf("  cmd &> file - перенаправить stdout и stderr в file\n");
-    printf("  cmd &>> file - добавить stdout и stderr в file\n");
+    bio_puts(io, "Перенаправления:\n");
+    bio_puts(io, "  cmd > file - записать вывод в file\n");
+    bio_puts(io, "  cmd >> file - добавить вывод в file\n");
+    bio_puts(io, "  cmd < file - читать ввод из file\n");
+    bio_puts(io, "  cmd &> file - перенаправить stdout и stderr в file\n");
+    bio_puts(io, "  cmd &>> file - добавить stdout и stderr в file\n");
     
     return 0;
 }
 
-//ф-ии для работы со встроенными командами jobs, fg, bg, kill
 
-int is_builtin_command(char *command) {//Проверяем является ли команда встроенной
-    if (command == NULL) return 0;//Пустая команда - не встроенная
+//реестр встроенных команд
+
+static const builtin_t builtins[] = {// BUILTIN_PIPE_SAFE - только у команд, которые ничего не меняют в shell
+    { "cd",         builtin_cd,         0, NULL },
+    { "pwd",        builtin_pwd,        BUILTIN_PIPE_SAFE, NULL },
+    { "echo",       builtin_echo,       BUILTIN_PIPE_SAFE, NULL },
+    { "cat",        builtin_cat,        BUILTIN_PIPE_SAFE | BUILTIN_STREAM, cat_accepts },
+    { "tee",        builtin_tee,        BUILTIN_PIPE_SAFE | BUILTIN_STREAM, tee_accepts },
+    { "true",       builtin_true,       BUILTIN_PIPE_SAFE, NULL },
+    { ":",          builtin_true,       BUILTIN_PIPE_SAFE, NULL },
+    { "false",      builtin_false,      BUILTIN_PIPE_SAFE, NULL },
+    { "test",       builtin_test,       BUILTIN_PIPE_SAFE, NULL },
+    { "[",          builtin_test,       BUILTIN_PIPE_SAFE, NULL },
+    { "printf",     builtin_printf,     BUILTIN_PIPE_SAFE, NULL },
+    { "read",       builtin_read,       0, NULL },
+    { "exit",       builtin_exit,       0, NULL },
+    { "export",     builtin_export,     0, NULL },
+    { "unset",      builtin_unset,      0, NULL },
+    { "help",       builtin_help,       BUILTIN_PIPE_SAFE, NULL },
+    { "jobs",       builtin_jobs,       BUILTIN_PIPE_SAFE, NULL },
+    { "fg",         builtin_fg,         0, NULL },
+    { "bg",         builtin_bg,         0, NULL },
+    { "kill",       builtin_kill,       0, NULL },
+    { "wait",       builtin_wait,       0, NULL },
+    { "hash",       builtin_hash,       0, NULL },
+    { "source",     builtin_source,     0, NULL },
+    { ".",          builtin_source,     0, NULL },
+    { "astcache",   builtin_astcache,   0, NULL },
+    { "times",      builtin_times,      BUILTIN_PIPE_SAFE, NULL },
+    { "shellstats", builtin_shellstats, BUILTIN_PIPE_SAFE, NULL },
+    { NULL, NULL, 0, NULL }
+};
+
+
+const builtin_t *find_builtin(const char *name) {//Проверяем является ли команда встроенной
+    if (name == NULL) return NULL;//Пустая команда - не встроенная
     
-    char *builtins[] = {// Список всех встроенных команд нашего shell
-        "cd", "pwd", "echo", "exit", "help", 
-        "jobs", "fg", "bg", "kill", NULL
-    };
+    for (int i = 0; builtins[i].name != NULL; i++) {
+        if (strcmp(name, builtins[i].name) == 0) {
+            return &builtins[i];
+        }
+    }
+    return NULL;
+}
+
+
+const builtin_t *find_builtin_argv(char **argv) {
+    const builtin_t *builtin = find_builtin(argv[0]);
+    if (builtin != NULL && builtin->accepts != NULL && !builtin->accepts(argv)) {
+        return NULL;
+    }
+    return builtin;
+}
+
+
+const builtin_t *builtin_list(void) {
+    return builtins;
+}
+
+
+int run_builtin(const builtin_t *builtin, char **argv, int fds[3]) {// Выполняем встроенную команду с дескрипторами стадии
+    return run_builtin_sink(builtin, argv, fds, NULL);
+}
+
+
+int run_builtin_sink(const builtin_t *builtin, char **argv, int fds[3], bio_sink_t *sink) {
+    builtin_io_t io;
+    bio_init(&io, fds[0], fds[1], fds[2]);
+    io.sink = sink;
+    
+    uint64_t start = stats_now();
+    int status = builtin->func(argv, &io);
+    bio_flush(&io);
+    stats_record(STATS_BUILTIN, start);
+    return status;
+}
+
+
+struct builtin_task {
+    pthread_t thread;
+    const builtin_t *builtin;
+    char **argv;// Копия в конце этого же блока (или слова вызывающего, если он гарантирует, что они переживут поток)
+    int fds[3];
+    int status;
+    int refs;// Поток и тот, кто его ждет; последний освобождает структуру
+};
+
+
+static void release_task(builtin_task_t *task) {
+    if (__atomic_sub_fetch(&task->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(task);
+    }
+}
+
+
+static void *builtin_thread_main(void *arg) {
+    builtin_task_t *task = arg;
     
+    task->status = run_builtin(task->builtin, task->argv, task->fds);
     
-    for (int i = 0; builtins[i] != NULL; i++) {//есть ли какая то из этих команд в списке
-        if (strcmp(command, builtins[i]) == 0) {
-            return 1;//встроенная команда
+    for (int i = 0; i < 3; i++) {// Закрытие конца пайпа дает следующей стадии EOF
+        if (task->fds[i] > STDERR_FILENO) {
+            close(task->fds[i]);
         }
     }
-    return 0;
+    release_task(task);
+    return NULL;
+}
+
+
+builtin_task_t *builtin_start_thread(const builtin_t *builtin, char **argv, int fds[3], int copy_argv) {
+    size_t count = 0;
+    size_t bytes = 0;
+    if (copy_argv) {// Слова из буфера раскрытия или арены AST - поток получает копию одним блоком с задачей
+        for (; argv[count] != NULL; count++) {
+            bytes += strlen(argv[count]) + 1;
+        }
+        bytes += (count + 1) * sizeof(char *);
+    }
+    
+    builtin_task_t *task = malloc(sizeof(builtin_task_t) + bytes);
+    if (task == NULL) {
+        return NULL;
+    }
+    
+    task->builtin = builtin;
+    task->argv = argv;
+    if (copy_argv) {
+        char **copy = (char **)(task + 1);
+        char *strings = (char *)(copy + count + 1);
+        for (size_t i = 0; i < count; i++) {
+            size_t length = strlen(argv[i]) + 1;
+            memcpy(strings, argv[i], length);
+            copy[i] = strings;
+            strings += length;
+        }
+        copy[count] = NULL;
+        task->argv = copy;
+    }
+    task->status = 0;
+    task->refs = 2;
+    
+    for (int i = 0; i < 3; i++) {// Свои копии: вызывающий закрывает концы пайпов сразу после запуска стадии
+        task->fds[i] = fds[i];
+        if (fds[i] > STDERR_FILENO) {
+            task->fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+        }
+    }
+    
+    int err = -1;
+    if (task->fds[0] >= 0 && task->fds[1] >= 0 && task->fds[2] >= 0) {
+        err = pthread_create(&task->thread, NULL, builtin_thread_main, task);
+    }
+    if (err != 0) {
+        for (int i = 0; i < 3; i++) {
+            if (task->fds[i] > STDERR_FILENO) {
+                close(task->fds[i]);
+            }
+        }
+        free(task);
+        return NULL;
+    }
+    
+    return task;
 }
 
-int handle_builtin(char **argv) {// Обрабатываем встроенную команду (вызываем нужную функцию)
-    if (argv[0] == NULL) return 0;
-    
-    if (strcmp(argv[0], "cd") == 0) {//если такая команда встроенная, вызываем соответствующую функцию
-        return builtin_cd(argv);
-    } else if (strcmp(argv[0], "pwd") == 0) {
-        return builtin_pwd(argv);
-    } else if (strcmp(argv[0], "echo") == 0) {
-        return builtin_echo(argv);
-    } else if (strcmp(argv[0], "exit") == 0) {
-        return builtin_exit(argv);
-    } else if (strcmp(argv[0], "help") == 0) {
-        return builtin_help(argv);
-    } else if (strcmp(argv[0], "jobs") == 0) {
-        return builtin_jobs(argv);
-    } else if (strcmp(argv[0], "fg") == 0) {
-        return builtin_fg(argv);
-    } else if (strcmp(argv[0], "bg") == 0) {
-        return builtin_bg(argv);
-    } else if (strcmp(argv[0], "kill") == 0) {
-        return builtin_kill(argv);
-    }
-    
-    return 0;//Неизвестная команда
+
+int builtin_join_thread(builtin_task_t *task) {
+    pthread_join(task->thread, NULL);
+    int status = task->status;
+    free(task);
+    return status;
+}
+
+
+void builtin_detach_thread(builtin_task_t *task) {
+    pthread_detach(task->thread);
+    release_task(task);
 }
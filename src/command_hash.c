@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "command_hash.h"
+#include "variables.h"
+
+#define HASH_INITIAL_BUCKETS 64
+#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+
+typedef struct hash_entry {
+    char *name;
+    char *path;// NULL - команда не найдена (кэшированный промах)
+    int dir_index;// В каком каталоге PATH найдена (-1 для промаха)
+    unsigned int hits;
+    struct hash_entry *next;
+} hash_entry_t;
+
+typedef struct {// Каталог из PATH и его mtime на момент заполнения кэша
+    char *path;
+    struct timespec mtime;
+    int exists;
+    int relative;// Пустой элемент или относительный путь - зависит от текущего каталога, mtime не следим
+} path_dir_t;
+
+static hash_entry_t **buckets = NULL;
+static size_t bucket_count = 0;
+static size_t entry_count = 0;
+
+static path_dir_t *path_dirs = NULL;
+static int path_dir_count = 0;
+static int first_relative = 0;// Найденное до этого каталога от cd не зависит и кэшируется
+static char *uncached_path = NULL;// Последний результат, который нельзя кэшировать
+static int path_dirty = 1;// Каталоги не соответствуют PATH - разобрать при следующем поиске
+static unsigned long generation = 0;// Номер команды верхнего уровня
+static unsigned long checked_generation = 0;// Поколение, в котором mtime каталогов последний раз проверялся
+
+
+static unsigned long hash_name(const char *name) {// FNV-1a
+    unsigned long hash = 2166136261UL;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+
+static void free_entries(void) {// Удаляет все записи, таблица остается
+    for (size_t i = 0; i < bucket_count; i++) {
+        hash_entry_t *entry = buckets[i];
+        while (entry != NULL) {
+            hash_entry_t *next = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry = next;
+        }
+        buckets[i] = NULL;
+    }
+    entry_count = 0;
+}
+
+
+static void stat_dir(path_dir_t *dir) {
+    struct stat st;
+    if (!dir->relative && stat(dir->path, &st) == 0) {
+        dir->mtime = st.st_mtim;
+        dir->exists = 1;
+    } else {
+        dir->exists = 0;
+    }
+}
+
+
+static int dir_changed(path_dir_t *dir) {// Изменилось ли содержимое каталога с момента кэширования
+    struct stat st;
+    if (stat(dir->path, &st) != 0) {
+        return dir->exists;
+    }
+    return !dir->exists ||
+           st.st_mtim.tv_sec != dir->mtime.tv_sec ||
+           st.st_mtim.tv_nsec != dir->mtime.tv_nsec;
+}
+
+
+static void free_dirs(path_dir_t *dirs, int count) {
+    for (int i = 0; i < count; i++) {
+        free(dirs[i].path);
+    }
+    free(dirs);
+}
+
+
+static void free_path_dirs(void) {
+    free_dirs(path_dirs, path_dir_count);
+    path_dirs = NULL;
+    path_dir_count = 0;
+    first_relative = 0;
+}
+
+
+static int split_path(const char *path_var, path_dir_t **dirs_out) {// Разбивает PATH на каталоги, возвращает их число (0 - нет памяти)
+    int count = 1;
+    for (const char *p = path_var; *p; p++) {
+        if (*p == ':') {
+            count++;
+        }
+    }
+
+    path_dir_t *dirs = calloc(count, sizeof(path_dir_t));
+    if (dirs == NULL) {
+        *dirs_out = NULL;
+        return 0;
+    }
+
+    const char *start = path_var;
+    for (int i = 0; i < count; i++) {
+        const char *end = strchr(start, ':');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+
+        dirs[i].path = (len == 0) ? strdup(".") : strndup(start, len);// Пустой элемент PATH - текущий каталог
+        dirs[i].relative = (len == 0 || start[0] != '/');
+        start = end + 1;
+    }
+    *dirs_out = dirs;
+    return count;
+}
+
+
+static void load_path_dirs(const char *path_var) {// Разбивает PATH на каталоги и запоминает их mtime
+    free_path_dirs();
+    path_dir_count = split_path(path_var, &path_dirs);
+
+    first_relative = path_dir_count;
+    for (int i = 0; i < path_dir_count; i++) {
+        stat_dir(&path_dirs[i]);
+        if (path_dirs[i].relative && first_relative == path_dir_count) {
+            first_relative = i;
+        }
+    }
+}
+
+
+static int validate_cache(void) {// Проверяет актуальность кэша, 0 - кэш сброшен
+    if (path_dirty) {// PATH присвоен или hash -r - каталоги разбираются заново
+        const char *path_var = var_get("PATH");
+        free_entries();
+        load_path_dirs(path_var != NULL ? path_var : DEFAULT_PATH);
+        path_dirty = 0;
+        checked_generation = generation;
+        return 0;
+    }
+    if (checked_generation == generation) {// В этом поколении каталоги уже проверены
+        return 1;
+    }
+    checked_generation = generation;
+
+    int changed = 0;
+    for (int i = 0; i < first_relative; i++) {// Дальше в кэше ничего нет - там все зависит от cd
+        if (dir_changed(&path_dirs[i])) {
+            changed = 1;
+            break;
+        }
+    }
+
+    if (changed) {
+        free_entries();
+        for (int i = 0; i < path_dir_count; i++) {
+            stat_dir(&path_dirs[i]);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+
+static hash_entry_t *find_entry(const char *name, unsigned long hash) {
+    if (bucket_count == 0) {
+        return NULL;
+    }
+    hash_entry_t *entry = buckets[hash & (bucket_count - 1)];
+    while (entry != NULL && strcmp(entry->name, name) != 0) {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+
+static void grow_table(void) {// Удваивает число корзин когда записей больше чем корзин
+    size_t new_count = bucket_count ? bucket_count * 2 : HASH_INITIAL_BUCKETS;
+    hash_entry_t **new_buckets = calloc(new_count, sizeof(hash_entry_t *));
+    if (new_buckets == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < bucket_count; i++) {
+        hash_entry_t *entry = buckets[i];
+        while (entry != NULL) {
+            hash_entry_t *next = entry->next;
+            size_t index = hash_name(entry->name) & (new_count - 1);
+            entry->next = new_buckets[index];
+            new_buckets[index] = entry;
+            entry = next;
+        }
+    }
+
+    free(buckets);
+    buckets = new_buckets;
+    bucket_count = new_count;
+}
+
+
+static char *search_dirs(const char *name, const path_dir_t *dirs, int count, int *dir_index) {// Полный путь к команде (malloc) или NULL; *dir_index - где найдена, count - не найдена
+    size_t name_len = strlen(name);
+    for (int i = 0; i < count; i++) {
+        size_t dir_len = strlen(dirs[i].path);
+        char *candidate = malloc(dir_len + name_len + 2);
+        if (candidate == NULL) {
+            break;
+        }
+        memcpy(candidate, dirs[i].path, dir_len);
+        candidate[dir_len] = '/';
+        memcpy(candidate + dir_len + 1, name, name_len + 1);
+
+        struct stat st;
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0) {
+            *dir_index = i;
+            return candidate;
+        }
+        free(candidate);
+    }
+    *dir_index = count;
+    return NULL;
+}
+
+
+static const char *keep_uncached(char *path) {// Результат живет до следующего некэшируемого поиска
+    free(uncached_path);
+    uncached_path = path;
+    return path;
+}
+
+
+static hash_entry_t *add_entry(const char *name, char *path, int dir_index) {// Добавляет результат поиска в таблицу, path переходит к записи
+    hash_entry_t *entry = malloc(sizeof(hash_entry_t));
+    if (entry != NULL && entry_count + 1 > bucket_count) {
+        grow_table();
+    }
+    if (entry == NULL || bucket_count == 0 || (entry->name = strdup(name)) == NULL) {
+        free(entry);
+        free(path);
+        return NULL;
+    }
+    entry->path = path;
+    entry->dir_index = path != NULL ? dir_index : -1;
+    entry->hits = 0;
+
+    size_t index = hash_name(name) & (bucket_count - 1);
+    entry->next = buckets[index];
+    buckets[index] = entry;
+    entry_count++;
+    return entry;
+}
+
+
+const char *command_hash_lookup(const char *name) {// Возвращает путь к исполняемому файлу или NULL
+    if (name == NULL || name[0] == '\0') {
+        return NULL;
+    }
+    if (strchr(name, '/') != NULL) {// Явный путь - PATH не используется
+        return name;
+    }
+
+    validate_cache();
+    hash_entry_t *entry = find_entry(name, hash_name(name));
+    if (entry == NULL) {
+        int dir_index;
+        char *path = search_dirs(name, path_dirs, path_dir_count, &dir_index);
+        if (dir_index >= first_relative && first_relative < path_dir_count) {// Ответ зависит от текущего каталога - после cd он другой
+            return keep_uncached(path);
+        }
+        entry = add_entry(name, path, dir_index);
+        if (entry == NULL) {
+            return NULL;
+        }
+    }
+
+    entry->hits++;
+    return entry->path;
+}
+
+
+const char *command_hash_search(const char *name, const char *path_var) {// PATH=... cmd: поиск по временному PATH мимо кэша
+    if (name == NULL || name[0] == '\0') {
+        return NULL;
+    }
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+
+    path_dir_t *dirs;
+    int count = split_path(path_var, &dirs);
+    int dir_index;
+    char *path = search_dirs(name, dirs, count, &dir_index);
+    free_dirs(dirs, count);
+    return keep_uncached(path);
+}
+
+
+void command_hash_clear(void) {
+    free_entries();
+    free_path_dirs();
+    path_dirty = 1;
+}
+
+
+void command_hash_next_generation(void) {
+    generation++;
+}
+
+
+void command_hash_print(builtin_io_t *io) {// Выводит закэшированные команды в формате bash: hits команда
+    if (entry_count == 0) {
+        bio_puts(io, "hash: таблица пуста\n");
+        return;
+    }
+
+    bio_puts(io, "hits\tcommand\n");
+    for (size_t i = 0; i < bucket_count; i++) {
+        for (hash_entry_t *entry = buckets[i]; entry != NULL; entry = entry->next) {
+            if (entry->path != NULL) {
+                bio_printf(io, "%4u\t%s\n", entry->hits, entry->path);
+            }
+        }
+    }
+}
+
+
+int builtin_hash(char **argv, builtin_io_t *io) {//hash [-r] [команда...] - работа с кэшем путей
+    if (argv[1] == NULL) {
+        command_hash_print(io);
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (strcmp(argv[i], "-r") == 0) {// Сбросить весь кэш
+            command_hash_clear();
+            continue;
+        }
+        if (command_hash_lookup(argv[i]) == NULL) {
+            bio_error(io, "hash: %s: не найдена\n", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
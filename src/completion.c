@@ -0,0 +1,500 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "completion.h"
+#include "dir_cache.h"
+#include "lexer.h"
+#include "builtins.h"
+#include "variables.h"
+
+#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+#define TRIE_ARENA_BLOCK 16384
+
+typedef struct trie_node {// Префиксное дерево имен команд
+    struct trie_node *child;
+    struct trie_node *sibling;// Братья по возрастанию символа - обход дает имена по алфавиту
+    unsigned char c;
+    unsigned char terminal;// Здесь кончается имя команды
+} trie_node_t;
+
+typedef struct {// Каталог из PATH и его mtime на момент построения дерева
+    char *path;
+    struct timespec mtime;
+    int exists;
+} trie_dir_t;
+
+static arena_t *trie_arena = NULL;
+static trie_node_t *trie_root = NULL;
+static char *trie_path_var = NULL;// PATH, по которому построено дерево
+static trie_dir_t *trie_dirs = NULL;
+static size_t trie_dir_count = 0;
+
+
+static trie_node_t *trie_new_node(unsigned char c) {
+    trie_node_t *node = arena_alloc(trie_arena, sizeof(trie_node_t));
+    if (node != NULL) {
+        node->child = NULL;
+        node->sibling = NULL;
+        node->c = c;
+        node->terminal = 0;
+    }
+    return node;
+}
+
+
+static void trie_insert(const char *name) {
+    trie_node_t *node = trie_root;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        trie_node_t **link = &node->child;
+        while (*link != NULL && (*link)->c < *p) {
+            link = &(*link)->sibling;
+        }
+        if (*link == NULL || (*link)->c != *p) {
+            trie_node_t *added = trie_new_node(*p);
+            if (added == NULL) {
+                return;
+            }
+            added->sibling = *link;
+            *link = added;
+        }
+        node = *link;
+    }
+    node->terminal = 1;
+}
+
+
+static void free_trie_dirs(void) {
+    for (size_t i = 0; i < trie_dir_count; i++) {
+        free(trie_dirs[i].path);
+    }
+    free(trie_dirs);
+    trie_dirs = NULL;
+    trie_dir_count = 0;
+}
+
+
+static void add_executables(trie_dir_t *dir) {// Исполняемые файлы каталога из PATH в дерево
+    const dir_listing_t *listing = dir_cache_get(dir->path);
+    dir->exists = listing != NULL;
+    if (listing == NULL) {
+        return;
+    }
+    dir->mtime = listing->mtime;
+
+    size_t dir_len = strlen(dir->path);
+    char path[PATH_MAX];
+    for (size_t i = 0; i < listing->count; i++) {
+        const dir_entry_t *entry = &listing->entries[i];
+        if (dir_len + strlen(entry->name) + 2 > sizeof(path) || dir_entry_is_dir(listing, entry)) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir->path, entry->name);
+        if (access(path, X_OK) == 0) {
+            trie_insert(entry->name);
+        }
+    }
+}
+
+
+static int trie_build(const char *path_var) {// Встроенные команды и все исполняемые файлы из PATH
+    if (trie_arena == NULL) {
+        trie_arena = arena_create(TRIE_ARENA_BLOCK);
+        if (trie_arena == NULL) {
+            return -1;
+        }
+    } else {
+        arena_reset(trie_arena);
+    }
+    free_trie_dirs();
+    free(trie_path_var);
+    trie_path_var = strdup(path_var);
+
+    trie_root = trie_new_node(0);
+    if (trie_root == NULL || trie_path_var == NULL) {
+        trie_root = NULL;
+        return -1;
+    }
+
+    for (const builtin_t *builtin = builtin_list(); builtin->name != NULL; builtin++) {
+        trie_insert(builtin->name);
+    }
+
+    size_t count = 1;
+    for (const char *p = path_var; *p; p++) {
+        if (*p == ':') {
+            count++;
+        }
+    }
+    trie_dirs = calloc(count, sizeof(trie_dir_t));
+    if (trie_dirs == NULL) {
+        return 0;
+    }
+
+    const char *start = path_var;
+    while (1) {
+        const char *end = strchr(start, ':');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        if (len > 0 && start[0] == '/') {// Относительные каталоги PATH зависят от cwd - их не дополняем
+            trie_dir_t *dir = &trie_dirs[trie_dir_count];
+            dir->path = strndup(start, len);
+            if (dir->path != NULL) {
+                trie_dir_count++;
+                add_executables(dir);
+            }
+        }
+        if (end == NULL) {
+            break;
+        }
+        start = end + 1;
+    }
+    return 0;
+}
+
+
+static int trie_stale(const char *path_var) {// Сменился PATH или mtime одного из его каталогов
+    if (trie_root == NULL || trie_path_var == NULL || strcmp(trie_path_var, path_var) != 0) {
+        return 1;
+    }
+    for (size_t i = 0; i < trie_dir_count; i++) {
+        trie_dir_t *dir = &trie_dirs[i];
+        const dir_listing_t *listing = dir_cache_get(dir->path);// Недавно проверенный каталог - без stat
+        if ((listing != NULL) != dir->exists) {
+            return 1;
+        }
+        if (listing != NULL &&
+            (listing->mtime.tv_sec != dir->mtime.tv_sec || listing->mtime.tv_nsec != dir->mtime.tv_nsec)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int add_match(completion_t *result, const char *prefix, size_t prefix_len, const char *name, int is_dir) {
+    size_t name_len = strlen(name);
+    char *match = arena_alloc(result->arena, prefix_len + name_len + 2);
+    if (match == NULL) {
+        return -1;
+    }
+    memcpy(match, prefix, prefix_len);
+    memcpy(match + prefix_len, name, name_len);
+    size_t length = prefix_len + name_len;
+    if (is_dir) {
+        match[length++] = '/';
+    }
+    match[length] = '\0';
+
+    if (result->count == result->capacity) {
+        size_t capacity = result->capacity ? result->capacity * 2 : 16;
+        const char **grown = realloc(result->matches, capacity * sizeof(char *));
+        if (grown == NULL) {
+            return -1;
+        }
+        result->matches = grown;
+        result->capacity = capacity;
+    }
+
+    if (result->count == 0) {
+        result->common_length = length;
+    } else {
+        size_t common = 0;
+        while (common < result->common_length && result->matches[0][common] == match[common]) {
+            common++;
+        }
+        result->common_length = common;
+    }
+    result->matches[result->count++] = match;
+    return 0;
+}
+
+
+static void collect_commands(completion_t *result, trie_node_t *node, char *name, size_t depth) {// Обход в глубину - имена по алфавиту
+    for (trie_node_t *child = node->child; child != NULL; child = child->sibling) {
+        if (depth + 1 >= NAME_MAX) {
+            return;
+        }
+        name[depth] = (char)child->c;
+        if (child->terminal) {
+            name[depth + 1] = '\0';
+            add_match(result, "", 0, name, 0);
+        }
+        collect_commands(result, child, name, depth + 1);
+    }
+}
+
+
+static void complete_command(completion_t *result, const char *word) {
+    const char *path_var = var_get("PATH");
+    if (path_var == NULL) {
+        path_var = DEFAULT_PATH;
+    }
+    if (trie_stale(path_var) && trie_build(path_var) < 0) {
+        return;
+    }
+
+    trie_node_t *node = trie_root;
+    for (const unsigned char *p = (const unsigned char *)word; *p && node != NULL; p++) {
+        node = node->child;
+        while (node != NULL && node->c < *p) {
+            node = node->sibling;
+        }
+        if (node != NULL && node->c != *p) {
+            node = NULL;
+        }
+    }
+    if (node == NULL) {
+        return;
+    }
+
+    char name[NAME_MAX + 1];
+    size_t length = strlen(word);
+    if (length >= NAME_MAX) {
+        return;
+    }
+    memcpy(name, word, length);
+    if (node->terminal) {
+        name[length] = '\0';
+        add_match(result, "", 0, name, 0);
+    }
+    collect_commands(result, node, name, length);
+}
+
+
+static char *resolve_dir(const char *word, size_t dir_len) {// Каталог слова как абсолютный путь - ключ dir_cache
+    char cwd[PATH_MAX];
+    const char *home = var_get("HOME");
+    const char *base = "";
+    const char *rest = word;
+    size_t rest_len = dir_len;
+    int relative = 0;
+
+    if (dir_len >= 2 && word[0] == '~' && word[1] == '/' && home != NULL) {
+        base = home;
+        rest = word + 1;
+        rest_len = dir_len - 1;
+    } else if (dir_len == 0 || word[0] != '/') {
+        if (getcwd(cwd, sizeof(cwd)) == NULL) {
+            return NULL;
+        }
+        base = cwd;
+        relative = 1;
+    }
+
+    size_t base_len = strlen(base);
+    char *path = malloc(base_len + rest_len + 2);
+    if (path == NULL) {
+        return NULL;
+    }
+    memcpy(path, base, base_len);
+    size_t length = base_len;
+    if (relative) {
+        path[length++] = '/';
+    }
+    memcpy(path + length, rest, rest_len);
+    length += rest_len;
+    while (length > 1 && path[length - 1] == '/') {// "/usr/bin/" и "/usr/bin" - один каталог
+        length--;
+    }
+    path[length] = '\0';
+    return path;
+}
+
+
+static void complete_path(completion_t *result, const char *word, int executables_only) {
+    const char *slash = strrchr(word, '/');
+    size_t dir_len = slash ? (size_t)(slash - word) + 1 : 0;// Вместе с '/'
+    const char *base = word + dir_len;
+    size_t base_len = strlen(base);
+
+    char *dir = resolve_dir(word, dir_len);
+    if (dir == NULL) {
+        return;
+    }
+    const dir_listing_t *listing = dir_cache_get(dir);
+    if (listing == NULL) {
+        free(dir);
+        return;
+    }
+
+    for (size_t i = dir_listing_lower_bound(listing, base); i < listing->count; i++) {
+        const dir_entry_t *entry = &listing->entries[i];
+        if (strncmp(entry->name, base, base_len) != 0) {
+            break;
+        }
+        if (entry->name[0] == '.' && base[0] != '.') {
+            continue;// Скрытые файлы - только если их просят явно
+        }
+
+        int is_dir = dir_entry_is_dir(listing, entry);
+        if (executables_only && !is_dir) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->name);
+            if (access(path, X_OK) != 0) {
+                continue;
+            }
+        }
+        if (add_match(result, word, dir_len, entry->name, is_dir) < 0) {
+            break;
+        }
+    }
+    free(dir);
+}
+
+
+static size_t skip_word(const char *line, size_t pos, size_t end, int *closed) {// Конец слова в исходном тексте, как в scan_word
+    *closed = 1;
+    while (pos < end) {
+        char c = line[pos];
+        if (is_whitespace(c) || is_special_char(c)) {
+            break;
+        }
+        if (c == '\'' || c == '"') {
+            pos++;
+            while (pos < end && line[pos] != c) {
+                if (c == '"' && line[pos] == '\\') {
+                    pos++;
+                }
+                pos++;
+            }
+            if (pos >= end) {
+                *closed = 0;
+                return end;
+            }
+            pos++;
+        } else if (c == '\\') {
+            pos += 2;
+        } else {
+            pos++;
+        }
+    }
+    return pos < end ? pos : end;
+}
+
+
+static int find_word(const char *line, size_t cursor, size_t *word_start) {// Начало слова под курсором; -1 - курсор в кавычках или комментарии
+    size_t pos = 0;
+    *word_start = cursor;// Курсор после пробела - дополняем новое пустое слово
+    while (pos < cursor) {
+        char c = line[pos];
+        if (is_whitespace(c) || is_special_char(c)) {
+            pos++;
+            continue;
+        }
+        if (c == '#') {
+            return -1;
+        }
+        int closed;
+        size_t end = skip_word(line, pos, cursor, &closed);
+        if (!closed) {
+            return -1;// Дополнение внутри незакрытой кавычки не поддерживается
+        }
+        if (end == cursor) {
+            *word_start = pos;
+        }
+        pos = end;
+    }
+    return 0;
+}
+
+
+static int command_position(token_t *tokens, int index) {// Стоит ли слово с номером index на месте имени команды
+    if (index == 0) {
+        return 1;
+    }
+    token_t *previous = &tokens[index - 1];
+    switch (previous->type) {
+        case TOKEN_PIPE:
+        case TOKEN_AND:
+        case TOKEN_OR:
+        case TOKEN_SEMICOLON:
+        case TOKEN_BACKGROUND:
+        case TOKEN_LPAREN:
+            return 1;
+        case TOKEN_REDIR_ERR:
+            return strcmp(previous->value, "|&") == 0;// &> и &>> - перед именем файла
+        case TOKEN_WORD:
+            return strcmp(previous->value, "time") == 0 && command_position(tokens, index - 1);
+        default:
+            return 0;
+    }
+}
+
+
+int completion_complete(const char *line, size_t cursor, completion_t *result) {
+    memset(result, 0, sizeof(*result));
+
+    size_t word_start;
+    if (find_word(line, cursor, &word_start) < 0) {
+        return -1;
+    }
+
+    lexer_t *lexer = lexer_create_len(line, cursor);
+    if (lexer == NULL) {
+        return -1;
+    }
+    token_t *tokens = lexer_tokenize(lexer);
+    if (tokens == NULL) {
+        lexer_destroy(lexer);
+        return -1;
+    }
+
+    int count = 0;
+    while (tokens[count].type != TOKEN_EOF) {
+        count++;
+    }
+
+    int index = count;// Номер дополняемого слова в потоке токенов
+    if (word_start < cursor) {
+        index = count - 1;
+        if (index < 0 || tokens[index].type != TOKEN_WORD ||
+            (size_t)(tokens[index].value - lexer->buffer) != word_start) {
+            lexer_destroy(lexer);
+            return -1;
+        }
+    }
+
+    result->arena = arena_create(ARENA_DEFAULT_BLOCK);
+    if (result->arena == NULL) {
+        lexer_destroy(lexer);
+        return -1;
+    }
+    result->word_start = word_start;
+    char *word = arena_strdup(result->arena, index < count ? tokens[index].value : "");// Без кавычек и экранирования
+    int at_command = command_position(tokens, index);
+    lexer_destroy(lexer);
+    if (word == NULL) {
+        return -1;
+    }
+    result->word_length = strlen(word);
+
+    if (at_command && strchr(word, '/') == NULL) {
+        complete_command(result, word);
+    } else {
+        complete_path(result, word, at_command);
+    }
+    return result->count > 0 ? 0 : -1;
+}
+
+
+void completion_free(completion_t *result) {
+    if (result->arena != NULL) {
+        arena_destroy(result->arena);
+    }
+    free(result->matches);
+    memset(result, 0, sizeof(*result));
+}
+
+
+void completion_clear(void) {
+    if (trie_arena != NULL) {
+        arena_destroy(trie_arena);
+        trie_arena = NULL;
+    }
+    trie_root = NULL;
+    free(trie_path_var);
+    trie_path_var = NULL;
+    free_trie_dirs();
+}
@@ -0,0 +1,790 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "core_builtins.h"
+#include "variables.h"
+
+//test и [
+
+
+typedef struct {
+    char **args;// Аргументы без имени команды и без ] у [
+    int count;
+    int pos;
+    int error;// В выражении ошибка - код 2
+    const char *name;// test или [ - для сообщений
+    builtin_io_t *io;
+} test_parser_t;
+
+
+static void test_error(test_parser_t *p, const char *message, const char *arg) {
+    if (!p->error) {// Сообщаем только о первой ошибке
+        if (arg != NULL) {
+            bio_error(p->io, "%s: %s: %s\n", p->name, arg, message);
+        } else {
+            bio_error(p->io, "%s: %s\n", p->name, message);
+        }
+    }
+    p->error = 1;
+}
+
+
+static int is_unary_op(const char *arg) {
+    return arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0' && strchr("bcdefghLkprsStuwxznOG", arg[1]) != NULL;
+}
+
+
+static int is_binary_op(const char *arg) {
+    static const char *ops[] = { "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+                                 "-nt", "-ot", "-ef", NULL };
+    for (int i = 0; ops[i] != NULL; i++) {
+        if (strcmp(arg, ops[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static long long test_integer(test_parser_t *p, const char *arg) {// Допускаются пробелы вокруг числа, как у внешнего test
+    char *end;
+    errno = 0;
+    long long value = strtoll(arg, &end, 10);
+    while (isspace((unsigned char)*end)) {
+        end++;
+    }
+    if (end == arg || *end != '\0' || errno == ERANGE) {
+        test_error(p, "ожидается целое число", arg);
+        return 0;
+    }
+    return value;
+}
+
+
+static int test_fd(test_parser_t *p, int fd) {// -t 0/1/2 смотрит на дескрипторы команды, а не shell
+    switch (fd) {
+        case STDIN_FILENO:  return p->io->in_fd;
+        case STDOUT_FILENO: return p->io->out_fd;
+        case STDERR_FILENO: return p->io->err_fd;
+        default:            return fd;
+    }
+}
+
+
+static int test_unary(test_parser_t *p, const char *op, const char *arg) {
+    char kind = op[1];
+    switch (kind) {
+        case 'z': return arg[0] == '\0';
+        case 'n': return arg[0] != '\0';
+        case 't': return isatty(test_fd(p, (int)test_integer(p, arg)));
+        case 'r': return faccessat(AT_FDCWD, arg, R_OK, AT_EACCESS) == 0;
+        case 'w': return faccessat(AT_FDCWD, arg, W_OK, AT_EACCESS) == 0;
+        case 'x': return faccessat(AT_FDCWD, arg, X_OK, AT_EACCESS) == 0;
+        default: break;
+    }
+
+    struct stat st;
+    int found = (kind == 'h' || kind == 'L') ? lstat(arg, &st) == 0 : stat(arg, &st) == 0;
+    if (!found) {
+        return 0;
+    }
+    switch (kind) {
+        case 'e': return 1;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 'h':
+        case 'L': return S_ISLNK(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'g': return (st.st_mode & S_ISGID) != 0;
+        case 'u': return (st.st_mode & S_ISUID) != 0;
+        case 'k': return (st.st_mode & S_ISVTX) != 0;
+        case 'O': return st.st_uid == geteuid();
+        case 'G': return st.st_gid == getegid();
+        default:  return 0;
+    }
+}
+
+
+static int newer(const struct stat *a, const struct stat *b) {
+    if (a->st_mtim.tv_sec != b->st_mtim.tv_sec) {
+        return a->st_mtim.tv_sec > b->st_mtim.tv_sec;
+    }
+    return a->st_mtim.tv_nsec > b->st_mtim.tv_nsec;
+}
+
+
+static int test_binary(test_parser_t *p, const char *left, const char *op, const char *right) {
+    if (op[0] != '-') {
+        int cmp = strcmp(left, right);
+        if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return cmp == 0;
+        if (strcmp(op, "!=") == 0) return cmp != 0;
+        if (strcmp(op, "<") == 0) return cmp < 0;
+        return cmp > 0;
+    }
+
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        struct stat a, b;
+        int has_a = stat(left, &a) == 0;
+        int has_b = stat(right, &b) == 0;
+        if (op[1] == 'n') return has_a && (!has_b || newer(&a, &b));// Как в bash: существующий файл новее отсутствующего
+        if (op[1] == 'o') return has_b && (!has_a || newer(&b, &a));
+        return has_a && has_b && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+    }
+
+    long long l = test_integer(p, left);
+    long long r = test_integer(p, right);
+    if (strcmp(op, "-eq") == 0) return l == r;
+    if (strcmp(op, "-ne") == 0) return l != r;
+    if (strcmp(op, "-lt") == 0) return l < r;
+    if (strcmp(op, "-le") == 0) return l <= r;
+    if (strcmp(op, "-gt") == 0) return l > r;
+    return l >= r;
+}
+
+
+static int test_or(test_parser_t *p);
+
+
+static int test_primary(test_parser_t *p) {
+    if (p->pos >= p->count) {
+        test_error(p, "ожидается аргумент", NULL);
+        return 0;
+    }
+    char **args = p->args;
+    int pos = p->pos;
+
+    if (pos + 2 < p->count && is_binary_op(args[pos + 1])) {// Бинарный оператор важнее: [ -f = -f ]
+        p->pos += 3;
+        return test_binary(p, args[pos], args[pos + 1], args[pos + 2]);
+    }
+    if (strcmp(args[pos], "(") == 0) {
+        p->pos++;
+        int value = test_or(p);
+        if (p->pos >= p->count || strcmp(args[p->pos], ")") != 0) {
+            test_error(p, "ожидается )", NULL);
+            return 0;
+        }
+        p->pos++;
+        return value;
+    }
+    if (is_unary_op(args[pos]) && pos + 1 < p->count) {
+        p->pos += 2;
+        return test_unary(p, args[pos], args[pos + 1]);
+    }
+    p->pos++;
+    return args[pos][0] != '\0';
+}
+
+
+static int test_not(test_parser_t *p) {
+    if (p->pos < p->count && strcmp(p->args[p->pos], "!") == 0) {
+        p->pos++;
+        return !test_not(p);
+    }
+    return test_primary(p);
+}
+
+
+static int test_and(test_parser_t *p) {
+    int value = test_not(p);
+    while (p->pos < p->count && strcmp(p->args[p->pos], "-a") == 0) {
+        p->pos++;
+        int right = test_not(p);// Вычисляем всегда - иначе ошибка справа осталась бы незамеченной
+        value = value && right;
+    }
+    return value;
+}
+
+
+static int test_or(test_parser_t *p) {
+    int value = test_and(p);
+    while (p->pos < p->count && strcmp(p->args[p->pos], "-o") == 0) {
+        p->pos++;
+        int right = test_and(p);
+        value = value || right;
+    }
+    return value;
+}
+
+
+static int test_expression(test_parser_t *p, int start, int n) {// По числу аргументов, как требует POSIX; длинные выражения - разбором
+    char **args = p->args + start;
+
+    switch (n) {
+        case 0:
+            return 0;
+        case 1:
+            return args[0][0] != '\0';
+        case 2:
+            if (strcmp(args[0], "!") == 0) {
+                return args[1][0] == '\0';
+            }
+            if (is_unary_op(args[0])) {
+                return test_unary(p, args[0], args[1]);
+            }
+            test_error(p, "ожидается унарный оператор", args[0]);
+            return 0;
+        case 3:
+            if (is_binary_op(args[1])) {
+                return test_binary(p, args[0], args[1], args[2]);
+            }
+            if (strcmp(args[0], "!") == 0) {
+                return !test_expression(p, start + 1, 2);
+            }
+            if (strcmp(args[0], "(") == 0 && strcmp(args[2], ")") == 0) {
+                return args[1][0] != '\0';
+            }
+            break;
+        case 4:
+            if (strcmp(args[0], "!") == 0) {
+                return !test_expression(p, start + 1, 3);
+            }
+            if (strcmp(args[0], "(") == 0 && strcmp(args[3], ")") == 0) {
+                return test_expression(p, start + 1, 2);
+            }
+            break;
+        default:
+            break;
+    }
+
+    p->pos = start;
+    int value = test_or(p);
+    if (!p->error && p->pos < start + n) {
+        test_error(p, "лишний аргумент", p->args[p->pos]);
+    }
+    return value;
+}
+
+
+int builtin_test(char **argv, builtin_io_t *io) {//test, [ - проверить условие
+    int argc = 0;
+    while (argv[argc] != NULL) {
+        argc++;
+    }
+
+    test_parser_t p = { argv + 1, argc - 1, 0, 0, argv[0], io };
+    if (strcmp(argv[0], "[") == 0) {
+        if (argc < 2 || strcmp(argv[argc - 1], "]") != 0) {
+            bio_error(io, "[: отсутствует ]\n");
+            return 2;
+        }
+        p.count--;
+    }
+
+    int value = test_expression(&p, 0, p.count);
+    if (p.error) {
+        return 2;
+    }
+    return value ? 0 : 1;
+}
+
+
+//printf
+
+
+static int octal_digit(char c) {
+    return c >= '0' && c <= '7';
+}
+
+
+static size_t parse_escape(const char *s, char *out, int in_b, int *stop) {// s указывает за '\'; возвращает длину разобранного
+    switch (s[0]) {
+        case 'a':  *out = '\a'; return 1;
+        case 'b':  *out = '\b'; return 1;
+        case 'f':  *out = '\f'; return 1;
+        case 'n':  *out = '\n'; return 1;
+        case 'r':  *out = '\r'; return 1;
+        case 't':  *out = '\t'; return 1;
+        case 'v':  *out = '\v'; return 1;
+        case '\\': *out = '\\'; return 1;
+        case 'c':
+            *stop = 1;// \c - дальше ничего не выводить
+            return 1;
+        case 'x':
+            if (isxdigit((unsigned char)s[1])) {
+                size_t length = 1;
+                int value = 0;
+                while (length < 3 && isxdigit((unsigned char)s[length])) {
+                    char c = s[length++];
+                    value = value * 16 + (isdigit((unsigned char)c) ? c - '0' : tolower((unsigned char)c) - 'a' + 10);
+                }
+                *out = (char)value;
+                return length;
+            }
+            break;
+        default:
+            if (octal_digit(s[0])) {// В формате \NNN, в %b - \0NNN
+                size_t length = (in_b && s[0] == '0') ? 1 : 0;
+                size_t limit = length + 3;
+                int value = 0;
+                while (length < limit && octal_digit(s[length])) {
+                    value = value * 8 + (s[length++] - '0');
+                }
+                *out = (char)value;
+                return length;
+            }
+            break;
+    }
+    *out = '\\';// Неизвестная последовательность выводится как есть
+    return 0;
+}
+
+
+typedef struct {
+    char **args;
+    int used;
+    int status;
+    int stop;// Встретился \c в %b
+    builtin_io_t *io;
+} printf_state_t;
+
+
+static const char *next_arg(printf_state_t *state) {
+    const char *arg = state->args[state->used];
+    if (arg == NULL) {
+        return NULL;
+    }
+    state->used++;
+    return arg;
+}
+
+
+static int number_arg(printf_state_t *state, const char *arg, long long *value, unsigned long long *uvalue) {// 'c - код символа, как у внешнего printf
+    *value = 0;
+    *uvalue = 0;
+    if (arg == NULL) {
+        return 0;
+    }
+    if (arg[0] == '\'' || arg[0] == '"') {
+        *value = (unsigned char)arg[1];
+        *uvalue = (unsigned char)arg[1];
+        return 0;
+    }
+
+    char *end;
+    errno = 0;
+    if (arg[0] == '-') {
+        *value = strtoll(arg, &end, 0);
+        *uvalue = (unsigned long long)*value;
+    } else {
+        *uvalue = strtoull(arg, &end, 0);
+        *value = (long long)*uvalue;
+    }
+    if (end == arg || *end != '\0' || errno == ERANGE) {
+        bio_error(state->io, "printf: %s: ожидается число\n", arg);
+        state->status = 1;
+        return -1;
+    }
+    return 0;
+}
+
+
+static double float_arg(printf_state_t *state, const char *arg) {
+    if (arg == NULL) {
+        return 0.0;
+    }
+    if (arg[0] == '\'' || arg[0] == '"') {
+        return (unsigned char)arg[1];
+    }
+    char *end;
+    errno = 0;
+    double value = strtod(arg, &end);
+    if (end == arg || *end != '\0' || errno == ERANGE) {
+        bio_error(state->io, "printf: %s: ожидается число\n", arg);
+        state->status = 1;
+    }
+    return value;
+}
+
+
+static void print_b(printf_state_t *state, const char *spec, const char *arg) {// %b - аргумент с escape-последовательностями
+    size_t length = strlen(arg);
+    char *expanded = malloc(length + 1);
+    if (expanded == NULL) {
+        state->status = 1;
+        return;
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < length && !state->stop; i++) {
+        if (arg[i] != '\\' || arg[i + 1] == '\0') {
+            expanded[out++] = arg[i];
+            continue;
+        }
+        char c;
+        size_t used = parse_escape(arg + i + 1, &c, 1, &state->stop);
+        if (!state->stop) {
+            expanded[out++] = c;
+        }
+        i += used;
+    }
+    expanded[out] = '\0';
+    bio_printf(state->io, spec, expanded);
+    free(expanded);
+}
+
+
+static int star_arg(printf_state_t *state) {// Ширина или точность из аргумента: %*d
+    long long value;
+    unsigned long long unused;
+    number_arg(state, next_arg(state), &value, &unused);
+    return (int)value;
+}
+
+
+static const char *print_conversion(printf_state_t *state, const char *p) {// p указывает за '%'; возвращает позицию за спецификацией
+    char spec[64];
+    size_t length = 0;
+    spec[length++] = '%';
+
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL && length < 8) {
+        spec[length++] = *p++;
+    }
+    if (*p == '*') {
+        length += snprintf(spec + length, sizeof(spec) - length, "%d", star_arg(state));
+        p++;
+    } else {
+        while (isdigit((unsigned char)*p) && length < 24) {
+            spec[length++] = *p++;
+        }
+    }
+    if (*p == '.') {
+        spec[length++] = *p++;
+        if (*p == '*') {
+            length += snprintf(spec + length, sizeof(spec) - length, "%d", star_arg(state));
+            p++;
+        } else {
+            while (isdigit((unsigned char)*p) && length < 40) {
+                spec[length++] = *p++;
+            }
+        }
+    }
+
+    char conversion = *p;
+    if (conversion == '\0') {
+        bio_error(state->io, "printf: незаконченная спецификация формата\n");
+        state->status = 1;
+        state->stop = 1;
+        return p;
+    }
+    p++;
+
+    const char *arg = NULL;
+    long long value;
+    unsigned long long uvalue;
+    switch (conversion) {
+        case 'd':
+        case 'i':
+            number_arg(state, next_arg(state), &value, &uvalue);
+            memcpy(spec + length, "lld", 4);
+            bio_printf(state->io, spec, value);
+            break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            number_arg(state, next_arg(state), &value, &uvalue);
+            spec[length++] = 'l';
+            spec[length++] = 'l';
+            spec[length++] = conversion;
+            spec[length] = '\0';
+            bio_printf(state->io, spec, uvalue);
+            break;
+        case 'e': case 'E': case 'f': case 'F':
+        case 'g': case 'G': case 'a': case 'A':
+            spec[length++] = conversion;
+            spec[length] = '\0';
+            bio_printf(state->io, spec, float_arg(state, next_arg(state)));
+            break;
+        case 'c':
+            arg = next_arg(state);
+            spec[length++] = 'c';
+            spec[length] = '\0';
+            if (arg != NULL && arg[0] != '\0') {
+                bio_printf(state->io, spec, arg[0]);
+            } else {// Пустой аргумент - ничего, кроме заполнения до ширины
+                spec[length - 1] = 's';
+                bio_printf(state->io, spec, "");
+            }
+            break;
+        case 's':
+            arg = next_arg(state);
+            memcpy(spec + length, "s", 2);
+            bio_printf(state->io, spec, arg ? arg : "");
+            break;
+        case 'b':
+            arg = next_arg(state);
+            memcpy(spec + length, "s", 2);
+            print_b(state, spec, arg ? arg : "");
+            break;
+        default:
+            bio_error(state->io, "printf: %%%c: неверная спецификация формата\n", conversion);
+            state->status = 1;
+            state->stop = 1;
+            break;
+    }
+    return p;
+}
+
+
+int builtin_printf(char **argv, builtin_io_t *io) {//printf - форматированный вывод
+    int first = 1;
+    if (argv[first] != NULL && strcmp(argv[first], "--") == 0) {
+        first++;
+    }
+    if (argv[first] == NULL) {
+        bio_error(io, "printf: использование: printf формат [аргументы]\n");
+        return 2;
+    }
+
+    const char *format = argv[first];
+    printf_state_t state = { argv + first + 1, 0, 0, 0, io };
+
+    do {// Формат повторяется, пока не кончатся аргументы
+        int used_before = state.used;
+        const char *p = format;
+        while (*p != '\0' && !state.stop) {
+            const char *plain = p;// Обычный текст до % или \ - одним куском
+            while (*p != '\0' && *p != '%' && *p != '\\') {
+                p++;
+            }
+            if (p > plain) {
+                bio_write(io, plain, p - plain);
+            }
+
+            if (*p == '\\') {
+                char c;
+                size_t used = parse_escape(p + 1, &c, 0, &state.stop);
+                if (!state.stop) {
+                    bio_write(io, &c, 1);
+                }
+                p += 1 + used;
+            } else if (*p == '%') {
+                if (p[1] == '%') {
+                    bio_write(io, "%", 1);
+                    p += 2;
+                } else {
+                    p = print_conversion(&state, p + 1);
+                }
+            }
+        }
+        if (state.used == used_before) {// В формате нет спецификаций - аргументы не нужны
+            break;
+        }
+    } while (state.args[state.used] != NULL && !state.stop);
+
+    return state.status;
+}
+
+
+//read
+
+
+static int valid_name(const char *name) {
+    if (!isalpha((unsigned char)name[0]) && name[0] != '_') {
+        return 0;
+    }
+    for (const char *p = name + 1; *p != '\0'; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+typedef struct {
+    char *text;
+    char *escaped;// 1 - символ был экранирован \ и не разделяет поля
+    size_t length;
+    size_t capacity;
+} read_line_t;
+
+
+static int line_push(read_line_t *line, char c, char escaped) {
+    if (line->length + 1 >= line->capacity) {
+        size_t capacity = line->capacity * 2;
+        char *text = realloc(line->text, capacity);
+        if (text == NULL) {
+            return -1;
+        }
+        line->text = text;
+        char *marks = realloc(line->escaped, capacity);
+        if (marks == NULL) {
+            return -1;
+        }
+        line->escaped = marks;
+        line->capacity = capacity;
+    }
+    line->text[line->length] = c;
+    line->escaped[line->length] = escaped;
+    line->length++;
+    line->text[line->length] = '\0';
+    return 0;
+}
+
+
+// Из пайпа и терминала читаем по байту: лишнее прочитанное досталось бы
+// не тем командам. Обычный файл читаем блоком и возвращаем смещение за \n.
+static int read_line(int fd, int raw, read_line_t *line) {// 0 - строка до \n, 1 - EOF, -1 - ошибка
+    char block[4096];
+    int seekable = lseek(fd, 0, SEEK_CUR) >= 0;
+    int pending_escape = 0;
+
+    while (1) {
+        ssize_t n = read(fd, block, seekable ? sizeof(block) : 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            return 1;
+        }
+
+        for (ssize_t i = 0; i < n; i++) {
+            char c = block[i];
+            if (pending_escape) {
+                pending_escape = 0;
+                if (c != '\n' && line_push(line, c, 1) < 0) {// \ перед переводом строки - продолжение строки
+                    return -1;
+                }
+                continue;
+            }
+            if (c == '\\' && !raw) {
+                pending_escape = 1;
+                continue;
+            }
+            if (c == '\n') {
+                if (seekable && i + 1 < n) {
+                    lseek(fd, i + 1 - n, SEEK_CUR);
+                }
+                return 0;
+            }
+            if (line_push(line, c, 0) < 0) {
+                return -1;
+            }
+        }
+    }
+}
+
+
+static int is_ifs(const read_line_t *line, size_t i, const char *ifs) {
+    return !line->escaped[i] && strchr(ifs, line->text[i]) != NULL;
+}
+
+
+static int is_ifs_space(const read_line_t *line, size_t i, const char *ifs) {
+    return is_ifs(line, i, ifs) && isspace((unsigned char)line->text[i]);
+}
+
+
+static void assign(const char *name, const char *value, size_t length) {
+    char *copy = strndup(value, length);
+    if (copy != NULL) {
+        var_set(name, copy, 0);
+        free(copy);
+    }
+}
+
+
+static void split_fields(read_line_t *line, char **names, const char *ifs) {// Разбиение по IFS: последнее имя получает остаток строки
+    size_t i = 0;
+    while (i < line->length && is_ifs_space(line, i, ifs)) {
+        i++;
+    }
+
+    for (int n = 0; names[n] != NULL; n++) {
+        if (names[n + 1] == NULL) {
+            size_t end = line->length;
+            while (end > i && is_ifs_space(line, end - 1, ifs)) {
+                end--;
+            }
+            assign(names[n], line->text + i, end - i);
+            break;
+        }
+
+        size_t start = i;
+        while (i < line->length && !is_ifs(line, i, ifs)) {
+            i++;
+        }
+        assign(names[n], line->text + start, i - start);
+
+        while (i < line->length && is_ifs_space(line, i, ifs)) {
+            i++;
+        }
+        if (i < line->length && is_ifs(line, i, ifs)) {// Один непробельный разделитель вместе с пробелами вокруг
+            i++;
+            while (i < line->length && is_ifs_space(line, i, ifs)) {
+                i++;
+            }
+        }
+    }
+}
+
+
+int builtin_read(char **argv, builtin_io_t *io) {//read - прочитать строку в переменные
+    int raw = 0;
+    const char *prompt = NULL;
+    int i = 1;
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(argv[i], "-r") == 0) {
+            raw = 1;
+        } else if (strcmp(argv[i], "-p") == 0 && argv[i + 1] != NULL) {
+            prompt = argv[++i];
+        } else {
+            bio_error(io, "read: использование: read [-r] [-p приглашение] [имя ...]\n");
+            return 2;
+        }
+    }
+
+    char **names = argv + i;
+    for (int n = 0; names[n] != NULL; n++) {
+        if (!valid_name(names[n])) {
+            bio_error(io, "read: `%s': неверное имя переменной\n", names[n]);
+            return 2;
+        }
+    }
+
+    if (prompt != NULL && isatty(io->in_fd)) {
+        write_all(io->err_fd, prompt, strlen(prompt));
+    }
+
+    read_line_t line = { malloc(128), malloc(128), 0, 128 };
+    if (line.text == NULL || line.escaped == NULL) {
+        free(line.text);
+        free(line.escaped);
+        bio_perror(io, "read");
+        return 1;
+    }
+    line.text[0] = '\0';
+
+    int result = read_line(io->in_fd, raw, &line);
+    if (result < 0) {
+        bio_perror(io, "read");
+    } else if (names[0] == NULL) {
+        assign(READ_DEFAULT_NAME, line.text, line.length);
+    } else {
+        const char *ifs = var_get("IFS");
+        split_fields(&line, names, ifs ? ifs : READ_DEFAULT_IFS);
+    }
+
+    free(line.text);
+    free(line.escaped);
+    return result == 0 ? 0 : 1;
+}
@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "dir_cache.h"
+
+struct linux_dirent64 {// Запись getdents64 (в glibc нет объявления)
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static dir_listing_t listings[DIR_CACHE_MAX_DIRS];
+static size_t listing_count = 0;
+static uint64_t use_counter = 0;
+static uint64_t generation = 1;// У нового списка 0 - он еще не проверялся ни в одном поколении
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+static void free_listing(dir_listing_t *listing) {
+    free(listing->path);
+    free(listing->names);
+    free(listing->entries);
+    memset(listing, 0, sizeof(*listing));
+}
+
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const dir_entry_t *)a)->name, ((const dir_entry_t *)b)->name);
+}
+
+
+static int read_listing(dir_listing_t *listing, int fd) {// Все имена каталога одним блоком
+    char *buffer = malloc(DIR_CACHE_READ_SIZE);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    size_t names_size = 0, names_capacity = 0, count = 0, capacity = 0;
+    char *names = NULL;
+    dir_entry_t *entries = NULL;// Пока блок имен растет, name хранит смещение
+    int status = 0;
+
+    while (1) {
+        long n = syscall(SYS_getdents64, fd, buffer, DIR_CACHE_READ_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            status = n < 0 ? -1 : 0;
+            break;
+        }
+
+        for (long offset = 0; offset < n;) {
+            struct linux_dirent64 *dirent = (struct linux_dirent64 *)(buffer + offset);
+            offset += dirent->d_reclen;
+
+            const char *name = dirent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            size_t length = strlen(name) + 1;
+            if (names_size + length > names_capacity) {
+                size_t new_capacity = names_capacity ? names_capacity * 2 : 4096;
+                while (new_capacity < names_size + length) {
+                    new_capacity *= 2;
+                }
+                char *grown = realloc(names, new_capacity);
+                if (grown == NULL) {
+                    status = -1;
+                    goto out;
+                }
+                names = grown;
+                names_capacity = new_capacity;
+            }
+            if (count == capacity) {
+                size_t new_capacity = capacity ? capacity * 2 : 64;
+                dir_entry_t *grown = realloc(entries, new_capacity * sizeof(dir_entry_t));
+                if (grown == NULL) {
+                    status = -1;
+                    goto out;
+                }
+                entries = grown;
+                capacity = new_capacity;
+            }
+
+            memcpy(names + names_size, name, length);
+            entries[count].name = (const char *)(uintptr_t)names_size;
+            entries[count].type = dirent->d_type;
+            count++;
+            names_size += length;
+        }
+    }
+
+out:
+    free(buffer);
+    if (status < 0) {
+        free(names);
+        free(entries);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        entries[i].name = names + (uintptr_t)entries[i].name;
+    }
+    qsort(entries, count, sizeof(dir_entry_t), compare_entries);
+
+    free(listing->names);
+    free(listing->entries);
+    listing->names = names;
+    listing->entries = entries;
+    listing->count = count;
+    return 0;
+}
+
+
+static int load_listing(dir_listing_t *listing) {// Перечитывает каталог, если его mtime изменился
+    int fd = open(listing->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    listing->checked_ns = now_ns();
+
+    if (listing->entries != NULL && !listing->racy &&
+        st.st_mtim.tv_sec == listing->mtime.tv_sec && st.st_mtim.tv_nsec == listing->mtime.tv_nsec) {
+        close(fd);
+        return 0;
+    }
+
+    int status = read_listing(listing, fd);
+    close(fd);
+    if (status == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        int64_t age_ms = (int64_t)(now.tv_sec - st.st_mtim.tv_sec) * 1000 + (now.tv_nsec - st.st_mtim.tv_nsec) / 1000000;
+        listing->mtime = st.st_mtim;
+        listing->racy = age_ms < DIR_CACHE_RACY_MS;// Запись в каталог в тот же тик после чтения не сдвинула бы mtime
+    }
+    return status;
+}
+
+
+static dir_listing_t *find_listing(const char *path) {
+    for (size_t i = 0; i < listing_count; i++) {
+        if (strcmp(listings[i].path, path) == 0) {
+            return &listings[i];
+        }
+    }
+    return NULL;
+}
+
+
+static dir_listing_t *new_listing(const char *path) {// Свободная ячейка или самая давно использованная
+    dir_listing_t *listing;
+    if (listing_count < DIR_CACHE_MAX_DIRS) {
+        listing = &listings[listing_count++];
+    } else {
+        listing = &listings[0];
+        for (size_t i = 1; i < listing_count; i++) {
+            if (listings[i].last_used < listing->last_used) {
+                listing = &listings[i];
+            }
+        }
+        free_listing(listing);
+    }
+
+    listing->path = strdup(path);
+    if (listing->path == NULL) {
+        *listing = listings[--listing_count];
+        memset(&listings[listing_count], 0, sizeof(dir_listing_t));
+        return NULL;
+    }
+    return listing;
+}
+
+
+static void drop_listing(dir_listing_t *listing) {// Каталог пропал или не читается
+    free_listing(listing);
+    *listing = listings[--listing_count];
+    memset(&listings[listing_count], 0, sizeof(dir_listing_t));
+}
+
+
+const dir_listing_t *dir_cache_get(const char *path) {
+    dir_listing_t *listing = find_listing(path);
+    if (listing == NULL) {
+        listing = new_listing(path);
+        if (listing == NULL) {
+            return NULL;
+        }
+    } else if (now_ns() - listing->checked_ns < DIR_CACHE_RECHECK_MS * 1000000ULL) {
+        listing->last_used = ++use_counter;
+        return listing;// Проверяли недавно - даже stat не делаем
+    }
+
+    if (load_listing(listing) < 0) {
+        drop_listing(listing);
+        return NULL;
+    }
+    listing->last_used = ++use_counter;
+    return listing;
+}
+
+
+const dir_listing_t *dir_cache_get_current(const char *path) {
+    dir_listing_t *listing = find_listing(path);
+    if (listing == NULL) {
+        listing = new_listing(path);
+        if (listing == NULL) {
+            return NULL;
+        }
+    } else if (listing->generation == generation) {
+        listing->last_used = ++use_counter;
+        return listing;// Другой шаблон этой же команды уже проверил каталог
+    }
+
+    if (load_listing(listing) < 0) {
+        drop_listing(listing);
+        return NULL;
+    }
+    listing->generation = generation;
+    listing->last_used = ++use_counter;
+    return listing;
+}
+
+
+void dir_cache_next_generation(void) {
+    generation++;
+}
+
+
+size_t dir_listing_lower_bound(const dir_listing_t *listing, const char *prefix) {
+    size_t low = 0, high = listing->count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (strcmp(listing->entries[middle].name, prefix) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+
+int dir_entry_is_dir(const dir_listing_t *listing, const dir_entry_t *entry) {
+    if (entry->type == DT_DIR) {
+        return 1;
+    }
+    if (entry->type != DT_LNK && entry->type != DT_UNKNOWN) {
+        return 0;
+    }
+
+    size_t length = strlen(listing->path) + strlen(entry->name) + 2;
+    char *path = malloc(length);
+    if (path == NULL) {
+        return 0;
+    }
+    snprintf(path, length, "%s/%s", listing->path, entry->name);
+
+    struct stat st;
+    int is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    free(path);
+    return is_dir;
+}
+
+
+void dir_cache_clear(void) {
+    for (size_t i = 0; i < listing_count; i++) {
+        free_listing(&listings[i]);
+    }
+    listing_count = 0;
+}
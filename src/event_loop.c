@@ -0,0 +1,197 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "event_loop.h"
+#include "job_control.h"
+
+#define FALLBACK_POLL_MS 100// Без signalfd ввод и задачи опрашиваются с таким шагом
+
+static int signal_fd = -1;
+static int epoll_fd = -1;
+static int watched_fd = -1;// Дескриптор ввода, уже добавленный в epoll
+
+
+static void block_sigchld(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+}
+
+
+int event_loop_init(void) {
+    if (signal_fd >= 0) {
+        return 0;
+    }
+
+    block_sigchld();// Новые потоки наследуют маску - сигнал никогда не прервет их
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        perror("signalfd");
+        return -1;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = signal_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event) < 0) {
+        perror("epoll_ctl");
+        close(epoll_fd);
+        epoll_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+
+void event_loop_after_fork(void) {// Унаследованные номера уже закрыты или заняты другими файлами - просто забываем их
+    signal_fd = -1;
+    epoll_fd = -1;
+    watched_fd = -1;
+    event_loop_init();
+}
+
+
+int event_loop_signal_fd(void) {
+    return signal_fd;
+}
+
+
+static void drain_signal_fd(void) {// Сигналы SIGCHLD сливаются, поэтому после чтения забираем всех через waitpid(-1)
+    struct signalfd_siginfo info[16];
+    while (read(signal_fd, info, sizeof(info)) > 0) {
+    }
+}
+
+
+int event_loop_reap(void) {// Единственное место, где забираются статусы процессов shell (wait4 - вместе с ресурсами)
+    if (signal_fd >= 0) {
+        drain_signal_fd();
+    }
+
+    int count = 0;
+    int status;
+    struct rusage usage;
+    pid_t pid;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {// Пачка из тысяч завершений забирается за один проход
+        job_update_process(pid, status, &usage);// Процесс не из таблицы задач - статус никому не нужен
+        count++;
+    }
+    return count;
+}
+
+
+void event_loop_wait_child(void) {
+    if (signal_fd >= 0) {
+        struct pollfd pfd = { .fd = signal_fd, .events = POLLIN };// poll, а не epoll: в копии shell после fork epoll смотрел бы на сигналы родителя
+        while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {
+        }
+        return;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    struct timespec timeout = { 0, FALLBACK_POLL_MS * 1000000L };
+    sigtimedwait(&mask, NULL, &timeout);
+}
+
+
+int event_loop_wait_set(int epoll_set) {// Набор собирает вызывающий; проснулись - забираем все готовые статусы
+    if (epoll_set < 0) {
+        event_loop_wait_child();
+        return event_loop_reap();
+    }
+
+    struct epoll_event events[64];// Готовые события остаются в наборе - их заберем на следующем круге
+    int count;
+    while ((count = epoll_wait(epoll_set, events, 64, -1)) < 0 && errno == EINTR) {
+    }
+    if (count < 0) {
+        perror("epoll_wait");
+        return -1;
+    }
+    return event_loop_reap();
+}
+
+
+static int watch_fd(int fd) {
+    if (watched_fd == fd) {
+        return 0;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (watched_fd >= 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watched_fd, NULL);
+        watched_fd = -1;
+    }
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        return -1;// Например обычный файл - epoll его не поддерживает
+    }
+    watched_fd = fd;
+    return 0;
+}
+
+
+int event_loop_wait_readable(int fd) {
+    if (epoll_fd < 0 || watch_fd(fd) < 0) {// Без epoll: опрос ввода с таймаутом и сбор процессов между попытками
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        while (1) {
+            int ready = poll(&pfd, 1, FALLBACK_POLL_MS);
+            event_loop_reap();
+            if (ready > 0) {
+                return 0;
+            }
+            if (ready < 0 && errno != EINTR) {
+                return -1;
+            }
+        }
+    }
+
+    struct epoll_event events[2];
+    while (1) {
+        int count = epoll_wait(epoll_fd, events, 2, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            return -1;
+        }
+
+        int input_ready = 0;
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.fd == signal_fd) {
+                event_loop_reap();// Уведомления копятся в таблице задач и печатаются перед приглашением
+            } else {
+                input_ready = 1;// EPOLLHUP/EPOLLERR тоже: read вернет EOF или ошибку
+            }
+        }
+        if (input_ready) {
+            return 0;
+        }
+    }
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,9 +7,20 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 #include "executor.h"
 #include "builtins.h"
 #include "job_control.h"
+#include "command_hash.h"
+#include "launch.h"
+#include "event_loop.h"
+#include "stats.h"
+#include "stream.h"
+#include "variables.h"
+#include "expand.h"
 
 exec_context_t *create_exec_context(void) {//инициализирует контекст выполнения команды
     exec_context_t *context = malloc(sizeof(exec_context_t));
@@ -24,6 +36,10 @@ exec_context_t *create_exec_context(void) {//инициализирует кон
     context->redirect_out = NULL;
     context->redirect_err = NULL;
     context->append = 0;//добавление в файл или перезапись
+    context->in_pipe = 0;//выполняемся ли уже внутри стадии конвейера
+    context->pipeline_pgid = 0;//группа процессов конвейера
+    context->envp = NULL;//окружение переменных shell
+    context->path_var = NULL;
     
     return context;
 }
@@ -46,53 +62,81 @@ void free_exec_context(exec_context_t *context) {// Освобождает па
     free(context);
 }
 
-void setup_redirections(exec_context_t *context) {
+
+static struct rusage *timed_usage = NULL;// Ресурсы задач переднего плана под выполняющимся time
+
+
+static void account_job(job_t *job) {// Задача переднего плана завершилась - ее процессы входят в отчет time
+    if (timed_usage != NULL) {
+        job_usage_add(timed_usage, &job->usage);
+    }
+}
+
+static int open_redirect_file(const char *file, int is_input, int append, const char *what) {
+    int flags = O_RDONLY;
+    if (!is_input) {
+        flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);// Добавление в конец или перезапись файла
+    }
+
+    int fd = open(file, flags | O_CLOEXEC, 0644);// O_CLOEXEC: в exec попадают только дескрипторы 0, 1, 2
+    if (fd < 0) {
+        perror(what);
+    }
+    return fd;
+}
+
+
+int open_redirections(exec_context_t *context, int fds[3]) {// Открывает файлы перенаправлений в родителе, -1 при ошибке
+    fds[0] = fds[1] = fds[2] = -1;
+
     if (context->redirect_in != NULL) {// Перенаправление ввода из файла
-        if (context->redirect_in != NULL) {
-        int fd = open(context->redirect_in, O_RDONLY);
-        if (fd < 0) {
-            perror("open input file");
-            exit(EXIT_FAILURE);
+        fds[0] = open_redirect_file(context->redirect_in, 1, 0, "open input file");
+        if (fds[0] < 0) {
+            return -1;
         }
-        dup2(fd, STDIN_FILENO);
-        close(fd);
-    }
     }
     if (context->redirect_out != NULL) {// Перенаправление вывода в файл
-        int flags = O_WRONLY | O_CREAT;
-        if (context->append) {
-            flags |= O_APPEND;// Добавление в конец файла
-        } else {
-            flags |= O_TRUNC;// Перезапись файла
-        }
-        
-        int fd = open(context->redirect_out, flags, 0644);
-        if (fd < 0) {
-            perror("open output file");
-            exit(EXIT_FAILURE);
-        }
-        dup2(fd, STDOUT_FILENO);
-        close(fd);
+        fds[1] = open_redirect_file(context->redirect_out, 0, context->append, "open output file");
+        if (fds[1] < 0) {
+            close_redirections(fds);
+            return -1;
+        }
     }
-    
     if (context->redirect_err != NULL) {// Перенаправление ошибок в файл
-        int flags = O_WRONLY | O_CREAT;
-        if (context->append) {
-            flags |= O_APPEND;
-        } else {
-            flags |= O_TRUNC;
-        }
-        
-        int fd = open(context->redirect_err, flags, 0644);
-        if (fd < 0) {
-            perror("open error file");
-            exit(EXIT_FAILURE);
-        }
-        dup2(fd, STDERR_FILENO);
-        close(fd);
+        fds[2] = open_redirect_file(context->redirect_err, 0, context->append, "open error file");
+        if (fds[2] < 0) {
+            close_redirections(fds);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+void close_redirections(int fds[3]) {
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+            fds[i] = -1;
+        }
     }
 }
 
+
+void setup_redirections(exec_context_t *context) {// Для процессов, которые делают exec сами (стадии через fork)
+    int fds[3];
+    if (open_redirections(context, fds) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) {
+            dup2(fds[i], i);
+        }
+    }
+    close_redirections(fds);
+}
+
 int execute_ast(ast_node_t *node) {// Основная функция для выполнения AST дерева
     exec_context_t *context = create_exec_context();
     if (context == NULL) {
@@ -106,11 +150,7 @@ int execute_ast(ast_node_t *node) {// Основная функция для в
 }
 
 
-int execute_command(ast_node_t *node, exec_context_t *context) {// Выполняет команду в зависимости от типа узла AST
-    if (node == NULL) {
-        return 0;
-    }
-    
+static int execute_node(ast_node_t *node, exec_context_t *context) {// Выполняет команду в зависимости от типа узла AST
     switch (node->type) { // Выбор функции выполнения в зависимости от типа узла
         case NODE_COMMAND:
             return execute_simple_command(node, context);
@@ -126,8 +166,10 @@ int execute_command(ast_node_t *node, exec_context_t *context) {// Выполн
             return execute_sequence(node, context);
         case NODE_BACKGROUND:
             return execute_background(node, context);
-        case NODE_SUBSHELL:
-            return execute_simple_command(node->left, context);
+        case NODE_SUBSHELL:// В копии shell: присваивания, cd и exit внутри не трогают сам shell
+            return execute_pipeline(node->left, context);
+        case NODE_TIME:
+            return execute_time(node, context);
         default:
             fprintf(stderr, "Ошибка: неизвестный тип узла AST\n");
             return -1;
@@ -135,53 +177,584 @@ int execute_command(ast_node_t *node, exec_context_t *context) {// Выполн
 }
 
 
+int execute_command(ast_node_t *node, exec_context_t *context) {
+    if (node == NULL) {
+        return 0;
+    }
+
+    int status = execute_node(node, context);
+    var_set_status(status < 0 ? 1 : status);// $? видят уже следующие команды списка: false; echo $?
+    return status;
+}
+
+
+static int run_simple_command(ast_node_t *node, char **words, int argc, exec_context_t *context) {// words - слова команды после раскрытия
+    char **argv = words;
+    int assignments = var_assignment_count(argv);// VAR=val в начале команды
+    if (assignments == argc) {// Одни присваивания - меняют переменные shell
+        return var_assign(argv, assignments);
+    }
+    argv += assignments;
+
+    const builtin_t *builtin = find_builtin_argv(argv);// Проверяем встроенную команду
+    if (builtin != NULL && (builtin->flags & BUILTIN_STREAM) && !context->in_pipe) {// cat /dev/zero > f - задача, которую можно остановить или убить; копия shell без exec
+        return execute_pipeline(node, context);
+    }
+    if (builtin != NULL) {
+        int redirect_fds[3];// Встроенная команда пишет в дескрипторы контекста, а не в глобальный stdout
+        if (open_redirections(context, redirect_fds) < 0) {
+            return 1;
+        }
+        int fds[3] = { context->in_fd, context->out_fd, context->err_fd };
+        for (int i = 0; i < 3; i++) {
+            if (redirect_fds[i] >= 0) {
+                fds[i] = redirect_fds[i];
+            }
+        }
+
+        fflush(stdout);// Вывод через stdio, сделанный раньше, должен оказаться первым
+        var_saved_t *saved = assignments ? var_assign_temporary(words, assignments) : NULL;
+        int status = run_builtin(builtin, argv, fds);
+        var_restore(saved);
+        close_redirections(redirect_fds);
+        return status;
+    }//Теперь перенаправления хранятся в отдельном узле NODE_REDIRECT команда больше не содержит in_file, out_file, err_file эти поля теперь в узле NODE_REDIRECT
+    if (assignments == 0) {
+        return launch_process(argv, context);// Запускаем внешний процесс с общим кэшем окружения
+    }
+
+    char **saved_envp = context->envp;
+    context->envp = var_envp_with(words, assignments);// Указатели на слова команды - строки не копируются
+    if (context->envp == NULL) {
+        context->envp = saved_envp;
+        perror("malloc");
+        return 1;
+    }
+    const char *saved_path_var = context->path_var;
+    for (int i = 0; i < assignments; i++) {
+        if (strncmp(words[i], "PATH=", 5) == 0) {// Последнее присваивание побеждает, как в окружении
+            context->path_var = words[i] + 5;
+        }
+    }
+    int status = launch_process(argv, context);
+    free(context->envp);
+    context->envp = saved_envp;
+    context->path_var = saved_path_var;
+    return status;
+}
+
+
+static int check_arg_max(expand_t *expansion, ast_node_t *command) {// {1..N} у внешней команды: размер проверяется до раскрытия, -1 - не поместится в exec
+    char **argv = command->data.command.argv;
+    const unsigned char *flags = command->data.command.word_flags;
+    int braces = 0;
+    for (int i = 0; i < command->data.command.argc; i++) {
+        braces |= flags[i] & WORD_BRACE;
+    }
+    if (!braces || flags[0] != 0 || var_assignment_count(argv) > 0 || find_builtin_argv(argv) != NULL) {
+        return 0;// Встроенной команде ARG_MAX не указ, имя из подстановки заранее не известно
+    }
+
+    long limit = sysconf(_SC_ARG_MAX);
+    size_t environment = var_envp_size();// Ядро считает argv и envp вместе
+    if (limit <= 0 || (environment < (size_t)limit &&
+        !expand_exceeds(expansion, argv, flags, command->data.command.argc, (size_t)limit - environment))) {
+        return 0;
+    }
+    errno = E2BIG;// Как ответил бы execve - только без раскрытия списка в память
+    perror(argv[0]);
+    return -1;
+}
+
+
 int execute_simple_command(ast_node_t *node, exec_context_t *context) {//вып прост команд
     
     if (node == NULL || node->type != NODE_COMMAND || node->data.command.argv == NULL || node->data.command.argc == 0) {// Проверка на пустую команду
         return 0;
     }
     
-    if (is_builtin_command(node->data.command.argv[0])) {// Проверяем встроенную команду
-        return handle_builtin(node->data.command.argv);
-    }//Теперь перенаправления хранятся в отдельном узле NODE_REDIRECT команда больше не содержит in_file, out_file, err_file эти поля теперь в узле NODE_REDIRECT
-    return launch_process(node->data.command.argv, context);// Запускаем внешний процесс
+    if (node->data.command.word_flags == NULL) {// Без подстановок argv берется прямо из AST
+        return run_simple_command(node, node->data.command.argv, node->data.command.argc, context);
+    }
+    
+    expand_t *expansion = expand_acquire();
+    if (expansion == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    int argc = 0;
+    char **argv = NULL;
+    int status = 126;// Не помещается в exec - статус как у неудачного exec
+    if (check_arg_max(expansion, node) == 0) {
+        argv = expand_command(expansion, node->data.command.argv, node->data.command.word_flags, node->data.command.argc, &argc);
+        status = 1;
+    }
+    if (argv != NULL) {
+        status = argc > 0 ? run_simple_command(node, argv, argc, context) : 0;// $пусто - команды нет
+        if (status == 0 && var_assignment_count(argv) == argc && expand_status(expansion) > 0) {
+            status = expand_status(expansion);// Без команды статус - у последней $(...): x=$(false)
+        }
+    }
+    expand_release(expansion);
+    return status;
 }
 
-int execute_pipeline(ast_node_t *node, exec_context_t *context) {// Выполняет конвейер команд
-    int pipefd[2];
-    
-    if (pipe(pipefd) == -1) {// Создаем пайп
-        perror("pipe");
+static int flatten_pipeline(ast_node_t *node, pipeline_stage_t **stages_out) {// Разворачивает левую цепочку NODE_PIPE в массив стадий
+    int count = 1;
+    for (ast_node_t *current = node; current->type == NODE_PIPE; current = current->left) {
+        count++;
+    }
+
+    pipeline_stage_t *stages = calloc(count, sizeof(pipeline_stage_t));
+    if (stages == NULL) {
         return -1;
     }
-    
-    int saved_stdout = dup(STDOUT_FILENO);// Сохраняем оригинальные дескрипторы
-    int saved_stdin = dup(STDIN_FILENO);
-    
-    int redirect_stderr = (node->type == NODE_PIPE && node->data.pipe.redirect_err);//изм проверяем флаг redirect_err
-    
-    
-    dup2(pipefd[WRITE_END], STDOUT_FILENO);// Настраиваем вывод левой команды на пайп
-    close(pipefd[WRITE_END]);
-    
-    if (redirect_stderr) {// Если нужно перенаправить stderr
-        dup2(pipefd[WRITE_END], STDERR_FILENO);
+
+    int i = count - 1;// Правые потомки идут с конца: ((a | b) | c) -> a, b, c
+    ast_node_t *current = node;
+    while (current->type == NODE_PIPE) {
+        stages[i].node = current->right;
+        stages[i - 1].redirect_err = current->data.pipe.redirect_err;// |& относится к левой стадии
+        current = current->left;
+        i--;
     }
-    
-    execute_command(node->left, context);// Выполняем левую команду (ее вывод пойдет в пайп)
-    
-    dup2(saved_stdout, STDOUT_FILENO);// Восстанавливаем стандартный вывод
-    
-    dup2(pipefd[READ_END], STDIN_FILENO);// Настраиваем ввод правой команды из пайпа
-    close(pipefd[READ_END]);
-    
-    int right_status = execute_command(node->right, context);// Выполняем правую команду (читает из пайпа)
-    
-    dup2(saved_stdin, STDIN_FILENO);// Восстанавливаем стандартный ввод
-    
-    close(saved_stdout);// Закрываем сохраненные дескрипторы
-    close(saved_stdin);// Закрываем сохраненные дескрипторы
-    return right_status;
+    stages[0].node = current;
+
+    *stages_out = stages;
+    return count;
+}
+
+
+static ast_node_t *stage_command(ast_node_t *node) {// Команда стадии без узлов перенаправлений
+    while (node != NULL && node->type == NODE_REDIRECT) {
+        node = node->left;
+    }
+    if (node != NULL && node->type == NODE_COMMAND && node->data.command.argc > 0) {
+        return node;
+    }
+    return NULL;
+}
+
+
+static const char *stage_name(ast_node_t *node) {// Имя стадии для списка задач
+    ast_node_t *command = stage_command(node);
+    if (command != NULL) {
+        return command->data.command.argv[0];
+    }
+    return node == NULL ? "?" : "(...)";
+}
+
+
+static char *pipeline_description(pipeline_stage_t *stages, int count) {// Строка вида "cmd1 | cmd2 | cmd3"
+    size_t len = 1;
+    for (int i = 0; i < count; i++) {
+        len += strlen(stage_name(stages[i].node)) + 3;
+    }
+
+    char *description = malloc(len);
+    if (description == NULL) {
+        return NULL;
+    }
+
+    description[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        if (i > 0) {
+            strcat(description, " | ");
+        }
+        strcat(description, stage_name(stages[i].node));
+    }
+    return description;
+}
+
+
+static char *redirect_target(ast_node_t *node, const char *file) {// Имя файла для контекста (malloc); NULL - ошибка уже выведена
+    if (node->data.redirect.file_flags != 0) {
+        return expand_word(file, node->data.redirect.file_flags);// > $log, > *.log
+    }
+    char *copy = strdup(file);
+    if (copy == NULL) {
+        perror("malloc");
+    }
+    return copy;
+}
+
+
+static int collect_redirects(ast_node_t *node, exec_context_t *context) {// Переносит перенаправления стадии в контекст (внешние перекрывают внутренние), -1 при ошибке
+    for (; node != NULL && node->type == NODE_REDIRECT; node = node->left) {
+        if (node->data.redirect.in_file != NULL && context->redirect_in == NULL) {
+            context->redirect_in = redirect_target(node, node->data.redirect.in_file);
+            if (context->redirect_in == NULL) {
+                return -1;
+            }
+        }
+        if (node->data.redirect.out_file != NULL && context->redirect_out == NULL) {
+            context->redirect_out = redirect_target(node, node->data.redirect.out_file);
+            if (context->redirect_out == NULL) {
+                return -1;
+            }
+            context->append = node->data.redirect.append;
+        }
+        if (node->data.redirect.err_file != NULL && context->redirect_err == NULL) {
+            context->redirect_err = redirect_target(node, node->data.redirect.err_file);
+            if (context->redirect_err == NULL) {
+                return -1;
+            }
+            context->append = node->data.redirect.append;
+        }
+    }
+    return 0;
+}
+
+
+static int spawn_stage(pipeline_stage_t *stage, char **argv, int fds[3], exec_context_t *context) {// Быстрый путь: внешняя команда через posix_spawn
+    const char *path = command_hash_lookup(argv[0]);// Путь ищем в родителе - кэш переживает запуск
+    if (path == NULL) {
+        fprintf(stderr, "%s: команда не найдена\n", argv[0]);
+        return -1;
+    }
+
+    exec_context_t *stage_context = create_exec_context();
+    if (stage_context == NULL) {
+        return -1;
+    }
+    if (collect_redirects(stage->node, stage_context) < 0) {
+        free_exec_context(stage_context);
+        return -1;
+    }
+
+    int redirect_fds[3];
+    if (open_redirections(stage_context, redirect_fds) < 0) {
+        free_exec_context(stage_context);
+        return -1;
+    }
+
+    spawn_options_t options;
+    spawn_options_init(&options);
+    if (job_control_enabled()) {
+        options.pgid = context->pipeline_pgid;
+        options.tty_fd = context->background ? -1 : job_terminal();
+    } else {
+        options.pgid = -1;
+    }
+    options.envp = var_envp();
+    for (int i = 0; i < 3; i++) {// Файл перенаправления важнее пайпа
+        options.fds[i] = (redirect_fds[i] >= 0) ? redirect_fds[i] : fds[i];
+    }
+
+    int err = spawn_process(path, argv, &options, &stage->pid);
+    close_redirections(redirect_fds);
+    free_exec_context(stage_context);
+
+    if (err != 0) {
+        errno = err;
+        perror(argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int thread_stage(pipeline_stage_t *stage, char **argv, const builtin_t *builtin, int fds[3]) {// Встроенная команда без fork: поток пишет прямо в пайп стадии
+    exec_context_t *stage_context = create_exec_context();
+    if (stage_context == NULL) {
+        return -1;
+    }
+    if (collect_redirects(stage->node, stage_context) < 0) {
+        free_exec_context(stage_context);
+        return -1;
+    }
+
+    int redirect_fds[3];
+    if (open_redirections(stage_context, redirect_fds) < 0) {
+        free_exec_context(stage_context);
+        return -1;
+    }
+
+    int task_fds[3];
+    for (int i = 0; i < 3; i++) {
+        task_fds[i] = (redirect_fds[i] >= 0) ? redirect_fds[i] : fds[i];
+    }
+
+    stage->task = builtin_start_thread(builtin, argv, task_fds, 1);// Свои копии дескрипторов и слов: остановленную задачу поток дорабатывает после освобождения AST
+    close_redirections(redirect_fds);
+    free_exec_context(stage_context);
+
+    if (stage->task == NULL) {
+        fprintf(stderr, "%s: не удалось запустить поток\n", argv[0]);
+        return -1;
+    }
+    stage->pid = 0;
+    return 0;
+}
+
+
+static void close_inherited_fds(void) {// Копия shell наследует и концы пайпов, которые держат потоки других стадий
+    if (close_range(STDERR_FILENO + 1, ~0U, 0) == 0) {
+        return;
+    }
+
+    long max = sysconf(_SC_OPEN_MAX);
+    if (max < 0 || max > 65536) {
+        max = 65536;
+    }
+    for (int fd = STDERR_FILENO + 1; fd < max; fd++) {
+        close(fd);
+    }
+}
+
+
+static void run_pipeline_stage(pipeline_stage_t *stage, int fds[3], exec_context_t *context) {// Запасной путь: выполняется в дочернем процессе после fork
+    if (job_control_enabled()) {
+        setpgid(0, context->pipeline_pgid);// Все стадии в одной группе (у первой pgid == 0 -> своя группа)
+        if (!context->background) {
+            tcsetpgrp(job_terminal(), getpgrp());// Сама, не дожидаясь родителя: стадия может сразу читать терминал
+        }
+    }
+    spawn_reset_signals();
+
+    for (int i = 0; i < 3; i++) {// Ввод из предыдущего пайпа, вывод в следующий
+        if (fds[i] != i) {
+            dup2(fds[i], i);
+        }
+    }
+    close_inherited_fds();// Иначе стадия может держать открытым пишущий конец своего же пайпа
+    event_loop_after_fork();// Копия shell ждет свои команды через свой signalfd, как и родитель
+    job_forget_all();// Задачи родителя - не ее дети, их pidfd закрыты выше
+
+    exec_context_t *stage_context = create_exec_context();
+    if (stage_context == NULL) {
+        _exit(EXIT_FAILURE);
+    }
+    stage_context->in_pipe = (stage_command(stage->node) != NULL);// Одиночная команда делает exec без повторного fork, подсекция ждет свои команды
+    stage_context->pipeline_pgid = getpgrp();// Команды подсекции остаются в группе конвейера
+
+    ast_node_t *node = stage->node;
+    if (node->type == NODE_SUBSHELL) {// Мы уже копия shell - вторая не нужна
+        node = node->left;
+    }
+    int status = execute_command(node, stage_context);
+
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status < 0 ? EXIT_FAILURE : status);
+}
+
+
+static int stage_is_thread_safe(pipeline_stage_t *stage) {// Стадия может выполниться потоком shell
+    ast_node_t *command = stage_command(stage->node);
+    if (command != NULL && command->data.command.word_flags != NULL && command->data.command.word_flags[0] != 0) {
+        return 1;// Имя станет известно только после раскрытия - считаем, что это может быть поток
+    }
+    const builtin_t *builtin = command ? find_builtin_argv(command->data.command.argv) : NULL;
+    return builtin != NULL && (builtin->flags & BUILTIN_PIPE_SAFE);
+}
+
+
+static int start_stage(pipeline_stage_t *stage, int fds[3], int close_fd, int has_process, exec_context_t *context) {// Запускает одну стадию, 0 при успехе
+    ast_node_t *command = stage_command(stage->node);
+    char **argv = command != NULL ? command->data.command.argv : NULL;
+    expand_t *expansion = NULL;
+
+    if (command != NULL && command->data.command.word_flags != NULL) {// Раскрываем в родителе: posix_spawn и потоку нужен готовый argv
+        int argc = 0;
+        expansion = expand_acquire();
+        argv = (expansion != NULL && check_arg_max(expansion, command) == 0)
+            ? expand_command(expansion, argv, command->data.command.word_flags, command->data.command.argc, &argc) : NULL;
+        if (argv == NULL) {
+            expand_release(expansion);
+            return -1;
+        }
+        if (argc == 0) {
+            argv = NULL;// Пустая команда - пусть разбирается копия shell
+        }
+    }
+
+    int result = 1;// 1 - стадия не запущена, нужна копия shell
+    if (argv != NULL && var_assignment_count(argv) == 0) {// С присваиваниями - через копию shell, она разберет их сама
+        const builtin_t *builtin = find_builtin_argv(argv);
+        int thread_ok = builtin != NULL && (!(builtin->flags & BUILTIN_STREAM) ||
+            (has_process && !(stream_reads_stdin(argv) && isatty(fds[STDIN_FILENO]))));// Поток не получает сигналов задачи: его остановит EOF или EPIPE от процесса соседней стадии
+        if (builtin == NULL) {
+            result = spawn_stage(stage, argv, fds, context);
+        } else if ((builtin->flags & BUILTIN_PIPE_SAFE) && thread_ok && !context->background) {// Фоновой задаче нужна своя группа процессов
+            result = thread_stage(stage, argv, builtin, fds);
+        }
+    }
+    expand_release(expansion);
+    if (result != 1) {
+        return result;
+    }
+
+    uint64_t start = stats_now();
+    pid_t pid = fork();// Остальные встроенные команды и подсекции выполняются в копии shell
+    if (pid == 0) {
+        if (close_fd >= 0) {
+            close(close_fd);// Читающий конец нужен только следующей стадии
+        }
+        run_pipeline_stage(stage, fds, context);
+    }
+    stats_record(STATS_SPAWN, start);
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    if (job_control_enabled()) {
+        setpgid(pid, context->pipeline_pgid ? context->pipeline_pgid : pid);// Дублируем в родителе, чтобы не было гонки
+    }
+    stage->pid = pid;
+    return 0;
+}
+
+
+int execute_pipeline(ast_node_t *node, exec_context_t *context) {// Запускает все стадии конвейера одновременно
+    pipeline_stage_t *stages = NULL;
+    int count = flatten_pipeline(node, &stages);
+    if (count < 0) {
+        perror("malloc");
+        return -1;
+    }
+
+    int redirect_fds[3];// Перенаправления всего конвейера: ввод первой стадии, вывод последней
+    if (open_redirections(context, redirect_fds) < 0) {
+        free(stages);
+        return 1;
+    }
+    int base_fds[3] = { context->in_fd, context->out_fd, context->err_fd };// Без перенаправлений - дескрипторы контекста ($(...) отдает свой вывод)
+    for (int i = 0; i < 3; i++) {
+        if (redirect_fds[i] >= 0) {
+            base_fds[i] = redirect_fds[i];
+        }
+    }
+
+    fflush(stdout);// Иначе буфер stdio продублируется в стадиях, выполняемых через fork
+
+    pid_t saved_pgid = context->pipeline_pgid;
+    context->pipeline_pgid = 0;
+
+    int prev_read = base_fds[STDIN_FILENO];
+    int started = 0;
+    int has_process = 0;// Есть стадия, которую получит сигнал с терминала
+    for (int i = 0; i < count; i++) {
+        if (!stage_is_thread_safe(&stages[i])) {
+            has_process = 1;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        int pipefd[2] = { -1, -1 };
+
+        if (i < count - 1 && pipe2(pipefd, O_CLOEXEC) == -1) {// Пайп к следующей стадии, в exec не наследуется
+            perror("pipe");
+            break;
+        }
+
+        int fds[3];
+        fds[STDIN_FILENO] = prev_read;
+        fds[STDOUT_FILENO] = (i < count - 1) ? pipefd[WRITE_END] : base_fds[STDOUT_FILENO];
+        fds[STDERR_FILENO] = stages[i].redirect_err ? fds[STDOUT_FILENO] : base_fds[STDERR_FILENO];
+
+        int result = start_stage(&stages[i], fds, pipefd[READ_END], has_process, context);
+
+        if (prev_read > STDERR_FILENO) {// Родителю концы пайпов больше не нужны
+            close(prev_read);
+        }
+        if (pipefd[WRITE_END] != -1) {
+            close(pipefd[WRITE_END]);
+        }
+        prev_read = pipefd[READ_END];
+
+        if (result < 0) {// Стадия не запустилась - соседи получат EOF или SIGPIPE
+            stages[i].pid = -1;
+            continue;
+        }
+
+        if (context->pipeline_pgid == 0 && stages[i].pid > 0) {// Первый запущенный процесс становится лидером группы
+            context->pipeline_pgid = stages[i].pid;
+        }
+        started++;
+    }
+
+    if (prev_read > STDERR_FILENO) {// Остался после ошибки создания пайпа
+        close(prev_read);
+    }
+    close_redirections(redirect_fds);// Дескрипторы контекста закрывает их владелец
+
+    pid_t pgid = context->pipeline_pgid;
+    context->pipeline_pgid = saved_pgid;
+
+    job_t *job = NULL;// Одна задача на всю группу - и фоновая, и переднего плана
+    for (int i = 0; i < count; i++) {
+        if (stages[i].pid <= 0) {
+            continue;
+        }
+        if (job == NULL) {
+            char *description = pipeline_description(stages, count);
+            job = create_job(pgid, description ? description : stage_name(stages[0].node));
+            free(description);
+            if (job == NULL) {
+                break;
+            }
+        }
+        job_add_process(job, stages[i].pid, JOB_RUNNING);// Задача знает все свои процессы, а не только лидера группы
+    }
+    if (job != NULL) {
+        job->foreground = !context->background;
+        if (add_job(job) < 0) {
+            job = NULL;
+        }
+    }
+
+    int status = 0;
+
+    if (started == 0) {
+        status = 127;
+    } else if (context->background) {
+        if (job != NULL) {
+            printf("[%d] %d\n", job->job_id, pgid);
+        }
+        for (int i = count - 1; i >= 0; i--) {// $! - последний процесс конвейера
+            if (stages[i].pid > 0) {
+                var_set_last_background(stages[i].pid);
+                break;
+            }
+        }
+    } else {
+        int stopped = (job != NULL) ? job_wait(job) : 0;// Статусы процессов забирает цикл событий
+
+        for (int i = 0; i < count; i++) {// Потоки ждем после процессов: поток может ждать данных от остановленной стадии
+            if (stages[i].task == NULL) {
+                continue;
+            }
+            if (stopped) {
+                builtin_detach_thread(stages[i].task);// Доработает, когда задачу продолжат или завершат
+            } else {
+                int stage_status = builtin_join_thread(stages[i].task);
+                if (i == count - 1) {
+                    status = stage_status;
+                }
+            }
+            stages[i].task = NULL;
+        }
+
+        if (stages[count - 1].pid > 0 && job != NULL) {// Статус конвейера - статус последней стадии
+            status = job_status(job);
+        } else if (stages[count - 1].pid < 0) {
+            status = 127;
+        }
+
+        if (stopped) {// Конвейер остановлен (Ctrl+Z) - задача остается в списке
+            job->foreground = 0;
+            printf("[%d] Stopped %s\n", job->job_id, job->command);
+            status = 0;
+        } else if (job != NULL) {
+            account_job(job);
+            remove_job(job->job_id);
+        }
+    }
+
+    free(stages);
+    return status;
 }
 
 
@@ -199,18 +772,27 @@ int execute_redirect(ast_node_t *node, exec_context_t *context) {// Выполн
     redirect_context->out_fd = context->out_fd;
     redirect_context->err_fd = context->err_fd;
     redirect_context->background = context->background;
+    redirect_context->in_pipe = context->in_pipe;
+    redirect_context->pipeline_pgid = context->pipeline_pgid;
+    redirect_context->append = context->append;
     
+    if (collect_redirects(node, redirect_context) < 0) {// Устанавливаем перенаправления из узла
+        free_exec_context(redirect_context);
+        return 1;
+    }
     
-    if (node->data.redirect.in_file != NULL) {// Устанавливаем перенаправления из узла
-        redirect_context->redirect_in = strdup(node->data.redirect.in_file);//изм
+    if (context->redirect_in != NULL && redirect_context->redirect_in == NULL) {// Остальное наследуем от охватывающей команды
+        redirect_context->redirect_in = strdup(context->redirect_in);
     }
-    if (node->data.redirect.out_file != NULL) {
-        redirect_context->redirect_out = strdup(node->data.redirect.out_file);//изм
-        redirect_context->append = node->data.redirect.append;//изм
+    if (context->redirect_out != NULL && redirect_context->redirect_out == NULL) {
+        redirect_context->redirect_out = strdup(context->redirect_out);
     }
-    if (node->data.redirect.err_file != NULL) {
-        redirect_context->redirect_err = strdup(node->data.redirect.err_file);//изм
-        redirect_context->append = node->data.redirect.append;//изм
+    if (context->redirect_err != NULL && redirect_context->redirect_err == NULL) {
+        redirect_context->redirect_err = strdup(context->redirect_err);
+    }
+    
+    while (node->left != NULL && node->left->type == NODE_REDIRECT) {// Вложенные узлы уже учтены
+        node = node->left;
     }
     
     int result = execute_command(node->left, redirect_context);//выполняем команду с перенаправлениями
@@ -250,79 +832,151 @@ int execute_sequence(ast_node_t *node, exec_context_t *context) {// Выполн
 
 
 int execute_background(ast_node_t *node, exec_context_t *context) {// Выполняет команду в фоне (&)
+    int saved_background = context->background;// Фоновым становится только этот элемент списка
     context->background = 1;
-    return execute_command(node->left, context);
+
+    ast_node_t *inner = node->left;
+    while (inner != NULL && inner->type == NODE_REDIRECT) {
+        inner = inner->left;
+    }
+    int result;
+    if (inner != NULL && inner->type != NODE_COMMAND && inner->type != NODE_PIPE) {// Подсекция или список - одна задача в копии shell, ее и ждет wait
+        result = execute_pipeline(node->left, context);
+    } else {
+        result = execute_command(node->left, context);
+    }
+    context->background = saved_background;
+    return result;
+}
+
+int execute_time(ast_node_t *node, exec_context_t *context) {// Процессы считаются по задачам, сам shell (встроенные команды) - через RUSAGE_SELF
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    struct rusage *saved_usage = timed_usage;
+    timed_usage = &usage;
+
+    struct rusage self_before;
+    struct timespec start;
+    getrusage(RUSAGE_SELF, &self_before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int status = execute_command(node->left, context);
+
+    struct rusage self_after;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &self_after);
+    timed_usage = saved_usage;
+    if (saved_usage != NULL) {// time внутри time: внешний видит те же задачи, свое время shell он посчитает сам
+        job_usage_add(saved_usage, &usage);
+    }
+
+    timersub(&self_after.ru_utime, &self_before.ru_utime, &self_after.ru_utime);
+    timersub(&self_after.ru_stime, &self_before.ru_stime, &self_after.ru_stime);
+    timeradd(&usage.ru_utime, &self_after.ru_utime, &usage.ru_utime);
+    timeradd(&usage.ru_stime, &self_after.ru_stime, &usage.ru_stime);
+
+    builtin_io_t io;// Отчет в stderr shell, как в bash (перенаправления команды на него не влияют)
+    bio_init(&io, -1, STDERR_FILENO, STDERR_FILENO);
+    double real = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    print_usage(&io, real, &usage);
+    bio_flush(&io);
+    return status;
+}
+
+
+static int wait_foreground(pid_t pid, const char *name) {// Ждет процесс переднего плана через таблицу задач и возвращает его статус
+    job_t *job = create_job(pid, name);
+    if (job != NULL) {
+        job->foreground = 1;// До add_job: процесс мог уже завершиться, и о нем нельзя сообщать как о фоновом
+    }
+    if (job == NULL || job_add_process(job, pid, JOB_RUNNING) < 0 || add_job(job) < 0) {
+        int status;// Без памяти под задачу ждем процесс напрямую
+        if (waitpid(pid, &status, 0) < 0) {
+            return 0;
+        }
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+
+    if (job_wait(job)) {// Задача остановлена - остается в списке
+        job->foreground = 0;
+        printf("[%d] Stopped %s\n", job->job_id, name);
+        return 0;
+    }
+
+    int status = job_status(job);//Нормальное завершение или 128 + сигнал
+    account_job(job);
+    remove_job(job->job_id);
+    return status;
 }
 
 int launch_process(char **argv, exec_context_t *context) {
-    pid_t pid = fork();//Создаем новый процесс
-    
-    if (pid == 0) {// Это дочерний процесс (где выполняется команда)
-        
-        if (context->background) {// Настраиваем группу процессов
-            setpgid(0, 0);//Создаем новую группу для фоновых
-        }
-        
-        signal(SIGINT, SIG_DFL);// Восстанавливаем стандартные обработчики сигналов
-        signal(SIGQUIT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-        signal(SIGTTIN, SIG_DFL);
-        signal(SIGTTOU, SIG_DFL);
-        signal(SIGCHLD, SIG_DFL);
-        
-        
+    const char *path = context->path_var != NULL ? command_hash_search(argv[0], context->path_var)
+                                                 : command_hash_lookup(argv[0]);// Ищем путь в родителе, чтобы кэш пережил запуск
+    if (path == NULL) {
+        fprintf(stderr, "%s: команда не найдена\n", argv[0]);
+        if (context->in_pipe) {
+            exit(127);
+        }
+        return 127;
+    }
+
+    if (context->in_pipe) {// Стадия конвейера уже в своем процессе (fork-путь) - просто exec
         setup_redirections(context);
-        execvp(argv[0], argv);
-    
-        perror("execvp");// Если дошли сюда - значит execvp не сработал
-        exit(EXIT_FAILURE);
-        
-    } else if (pid < 0) {
-        
-        perror("fork");// Ошибка при создании процесса
-        return -1;
+        spawn_exec(path, argv, context->envp ? context->envp : var_envp());
+        perror(argv[0]);
+        exit(errno == ENOENT ? 127 : 126);
+    }
+
+    spawn_options_t options;// Перенаправления открываем в родителе и передаем как действия над дескрипторами
+    spawn_options_init(&options);
+    if (open_redirections(context, options.fds) < 0) {
+        return 1;
+    }
+    if (job_control_enabled()) {// Каждая задача в своей группе процессов, команды подсекции - в группе конвейера
+        options.pgid = context->pipeline_pgid;
+        options.tty_fd = context->background ? -1 : job_terminal();
     } else {
-        if (context->background) {// Это родительский процесс (наш shell)
-            setpgid(pid, pid);// Фоновая задача
-            
-            
-            job_t *job = create_job(pid, argv[0]);// Добавляем в список задач
-            add_job(job);
-            printf("[%d] %d\n", job->job_id, pid);
-            return 0;
-        } else {
-            setpgid(pid, pid);// Обычная задача - ждем завершения
-            
-            int status;
-            waitpid(pid, &status, WUNTRACED);//Ждем завершения
-            
-            
-            if (WIFEXITED(status)) {// Обрабатываем результат
-                return WEXITSTATUS(status);//Нормальное завершение
-            } else if (WIFSIGNALED(status)) {
-                return 128 + WTERMSIG(status);//Завершение по сигналу
-            } else if (WIFSTOPPED(status)) {
-                
-                job_t *job = create_job(pid, argv[0]);// Задача остановлена - добавляем в список
-                job->state = JOB_STOPPED;
-                add_job(job);
-                printf("[%d] Stopped %s\n", job->job_id, argv[0]);
+        options.pgid = -1;// Без управления задачами - в группе shell: Ctrl+C в скрипте прерывает и shell, и команду
+    }
+    options.envp = context->envp ? context->envp : var_envp();// Готовый массив: пересобирается только после export и присваиваний
+
+    pid_t pid;
+    int err = spawn_process(path, argv, &options, &pid);
+    close_redirections(options.fds);
+
+    int status = 0;
+    if (err != 0) {
+        errno = err;
+        perror(argv[0]);
+        status = (err == ENOENT) ? 127 : 126;
+    } else if (context->background) {// Фоновая задача - не ждем
+        var_set_last_background(pid);
+        job_t *job = create_job(pid, argv[0]);// Добавляем в список задач
+        if (job != NULL) {
+            job_add_process(job, pid, JOB_RUNNING);
+            if (add_job(job) == 0) {
+                printf("[%d] %d\n", job->job_id, pid);
             }
-            
-            return 0;
         }
+    } else {
+        status = wait_foreground(pid, argv[0]);
     }
+
+    return status;
 }
 
 
 void setup_signal_handlers(void) {// Настраивает обработчики сигналов для shell
-    struct sigaction sa;
-    sa.sa_handler = sigchld_handler;// Настраиваем обработчик SIGCHLD
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART;
-    sigaction(SIGCHLD, &sa, NULL);
-    
-    signal(SIGINT, SIG_IGN);// Игнорируем сигналы в shell
+    event_loop_init();// SIGCHLD блокируется и приходит через signalfd - обработчика нет
+    signal(SIGPIPE, SIG_IGN);// Встроенные команды в потоках получают EPIPE вместо гибели всего shell
+
+    if (!job_control_enabled()) {// Скрипт и -c: Ctrl+C и Ctrl+Z действуют на shell вместе с его командами
+        return;
+    }
+    signal(SIGINT, SIG_IGN);// Интерактивный shell сигналы с терминала игнорирует - они для задачи переднего плана
     signal(SIGQUIT, SIG_IGN);
     signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);// fg возвращает терминал shell через tcsetpgrp из фоновой группы
+    signal(SIGTTIN, SIG_IGN);
 }
@@ -0,0 +1,647 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "expand.h"
+#include "lexer.h"
+#include "variables.h"
+#include "pathname.h"
+#include "dir_cache.h"
+#include "brace.h"
+#include "subst.h"
+
+typedef struct {
+    const char *literal;// Буквальное слово из AST - не копируется
+    size_t offset;// Иначе начало поля в буфере (буфер может переехать при росте)
+} field_t;
+
+struct expand {
+    char *buffer;// Все раскрытые поля подряд, каждое с завершающим нулем
+    size_t length;
+    size_t capacity;
+    field_t *fields;
+    int field_count;
+    int field_capacity;
+    char **argv;
+    int argv_capacity;
+    size_t field_start;
+    int field_open;// Поле начато: "" или текст уже дали поле, даже пустое
+    int field_glob;// В поле есть * ? [ вне кавычек
+    int field_escaped;// В поле есть \ перед символами из кавычек
+    int glob;// Слово раскрывается по шаблону (присваивания - нет)
+    int error;
+    const char *ifs;
+    brace_buffer_t braces;// Текущий вариант {a,b}
+    bio_sink_t output;// Вывод последней $(...)
+    int status;// Ее статус, -1 - подстановок команд не было
+    struct expand *next;// Список свободных в пуле
+};
+
+static expand_t *pool = NULL;
+
+
+expand_t *expand_acquire(void) {
+    expand_t *expand = pool;
+    if (expand != NULL) {
+        pool = expand->next;
+        return expand;
+    }
+    return calloc(1, sizeof(expand_t));
+}
+
+
+void expand_release(expand_t *expand) {
+    if (expand != NULL) {
+        expand->next = pool;
+        pool = expand;
+    }
+}
+
+
+static void reset(expand_t *expand) {
+    expand->length = 0;
+    expand->field_count = 0;
+    expand->field_open = 0;
+    expand->glob = 0;
+    expand->error = 0;
+    expand->status = -1;
+    expand->ifs = var_get("IFS");
+    if (expand->ifs == NULL) {
+        expand->ifs = EXPAND_DEFAULT_IFS;
+    }
+}
+
+
+static int reserve(expand_t *expand, size_t extra) {
+    if (expand->length + extra <= expand->capacity) {
+        return 0;
+    }
+    size_t capacity = expand->capacity ? expand->capacity : EXPAND_INITIAL_BUFFER;
+    while (capacity < expand->length + extra) {
+        capacity *= 2;
+    }
+    char *buffer = realloc(expand->buffer, capacity);
+    if (buffer == NULL) {
+        perror("malloc");
+        expand->error = 1;
+        return -1;
+    }
+    expand->buffer = buffer;
+    expand->capacity = capacity;
+    return 0;
+}
+
+
+static int add_field(expand_t *expand, const char *literal, size_t offset) {
+    if (expand->field_count == expand->field_capacity) {
+        int capacity = expand->field_capacity ? expand->field_capacity * 2 : EXPAND_INITIAL_FIELDS;
+        field_t *fields = realloc(expand->fields, capacity * sizeof(field_t));
+        if (fields == NULL) {
+            perror("malloc");
+            expand->error = 1;
+            return -1;
+        }
+        expand->fields = fields;
+        expand->field_capacity = capacity;
+    }
+    expand->fields[expand->field_count].literal = literal;
+    expand->fields[expand->field_count].offset = offset;
+    expand->field_count++;
+    return 0;
+}
+
+
+static void open_field(expand_t *expand) {
+    if (!expand->field_open) {
+        expand->field_open = 1;
+        expand->field_start = expand->length;
+        expand->field_glob = 0;
+        expand->field_escaped = 0;
+    }
+}
+
+
+static int add_match(void *context, const char *path, size_t length) {// Совпадение шаблона - отдельное поле
+    expand_t *expand = context;
+    if (reserve(expand, length + 1) < 0) {
+        return -1;
+    }
+    size_t start = expand->length;
+    memcpy(expand->buffer + start, path, length + 1);
+    expand->length += length + 1;
+    return add_field(expand, NULL, start);
+}
+
+
+static void unescape(expand_t *expand) {// Поле остается словом: экранирующие \ больше не нужны
+    char *out = expand->buffer + expand->field_start;
+    const char *p = out;
+    const char *end = expand->buffer + expand->length;
+    while (p < end) {
+        if (*p == '\\' && p + 1 < end) {
+            p++;
+        }
+        *out++ = *p++;
+    }
+    expand->length = out - expand->buffer;
+}
+
+
+static void end_field(expand_t *expand) {
+    if (!expand->field_open || reserve(expand, 1) < 0) {
+        return;
+    }
+    expand->field_open = 0;
+    if (expand->field_glob) {// Текст шаблона остается в буфере мертвыми байтами, совпадения идут за ним
+        expand->buffer[expand->length] = '\0';
+        int matches = pathname_expand(expand->buffer + expand->field_start, add_match, expand);
+        if (matches < 0) {
+            expand->error = 1;
+            return;
+        }
+        if (matches > 0) {
+            return;
+        }
+    }
+    if (expand->field_escaped) {// Совпадений нет - шаблон остается как есть
+        unescape(expand);
+    }
+    expand->buffer[expand->length++] = '\0';
+    add_field(expand, NULL, expand->field_start);
+}
+
+
+static void put(expand_t *expand, const char *text, size_t length) {
+    if (length == 0 || reserve(expand, length) < 0) {
+        return;
+    }
+    open_field(expand);
+    memcpy(expand->buffer + expand->length, text, length);
+    expand->length += length;
+}
+
+
+static void put_quoted(expand_t *expand, const char *text, size_t length) {// Из кавычек: для шаблона это буквальные символы, \ перед ними
+    if (!expand->glob) {
+        put(expand, text, length);
+        return;
+    }
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '*' || text[i] == '?' || text[i] == '[' || text[i] == ']' || text[i] == '\\') {
+            put(expand, text + start, i - start);
+            put(expand, "\\", 1);
+            expand->field_escaped = 1;
+            start = i;
+        }
+    }
+    put(expand, text + start, length - start);
+}
+
+
+static void put_active(expand_t *expand, char c) {// Вне кавычек: * ? [ делают поле шаблоном
+    if (c == '\\') {
+        put_quoted(expand, &c, 1);
+        return;
+    }
+    put(expand, &c, 1);
+    if (expand->glob && (c == '*' || c == '?' || c == '[')) {
+        expand->field_glob = 1;
+    }
+}
+
+
+// Результат подстановки без кавычек делится по IFS. Пробельные символы IFS
+// схлопываются, остальные (IFS=:) разделяют всегда: a::b - три поля, среднее пустое
+static void put_split(expand_t *expand, const char *value) {
+    int after_delimiter = !expand->field_open;
+    for (const char *p = value; *p != '\0'; p++) {
+        if (strchr(expand->ifs, *p) == NULL) {
+            put_active(expand, *p);
+            after_delimiter = 0;
+        } else if (*p == ' ' || *p == '\t' || *p == '\n') {
+            end_field(expand);
+        } else {
+            if (after_delimiter) {
+                open_field(expand);
+            }
+            end_field(expand);
+            after_delimiter = 1;
+        }
+    }
+}
+
+
+static void put_value(expand_t *expand, const char *value, int quoted, int split) {
+    if (value == NULL) {
+        value = "";
+    }
+    if (quoted) {
+        open_field(expand);// "$пусто" - пустое поле, а не отсутствие поля
+    }
+    if (quoted || !split) {
+        put_quoted(expand, value, strlen(value));
+    } else if (expand->ifs[0] == '\0') {// IFS= - без деления, но шаблоном значение остается
+        for (const char *p = value; *p != '\0'; p++) {
+            put_active(expand, *p);
+        }
+    } else {
+        put_split(expand, value);
+    }
+}
+
+
+static size_t name_length(const char *p, const char *end) {// Имя после $: $? $$ $! $1 - один символ
+    if (p >= end) {
+        return 0;
+    }
+    if (*p == '?' || *p == '$' || *p == '!' || isdigit((unsigned char)*p)) {
+        return 1;
+    }
+    size_t length = 0;
+    while (p + length < end && (isalnum((unsigned char)p[length]) || p[length] == '_')) {
+        length++;
+    }
+    return length;
+}
+
+
+static const char *lookup(const char *name, size_t length) {
+    if (isdigit((unsigned char)name[0])) {
+        return NULL;// Позиционных параметров у shell нет
+    }
+    return var_get_len(name, length);
+}
+
+
+static const char *closing_brace(const char *p, const char *end) {// Парная } для ${, p - после {
+    int depth = 1;
+    char quote = 0;
+    for (; p < end; p++) {
+        if (*p == '\\' && quote != '\'') {
+            p++;
+        } else if (quote != 0) {
+            if (*p == quote) {
+                quote = 0;
+            }
+        } else if (*p == '\'' || *p == '"') {
+            quote = *p;
+        } else if (*p == '{') {
+            depth++;
+        } else if (*p == '}' && --depth == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+
+static void expand_text(expand_t *expand, const char *p, const char *end, int quoted, int split);
+
+
+static char *expand_string(const char *p, const char *end) {// Слово из ${имя=слово} как одна строка, malloc
+    expand_t *nested = expand_acquire();
+    if (nested == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+    reset(nested);
+    expand_text(nested, p, end, 0, 0);
+    end_field(nested);
+
+    char *result = NULL;
+    if (!nested->error) {
+        result = strdup(nested->field_count > 0 ? nested->buffer : "");
+        if (result == NULL) {
+            perror("malloc");
+        }
+    }
+    expand_release(nested);
+    return result;
+}
+
+
+static const char *expand_braces(expand_t *expand, const char *p, const char *end, int quoted, int split) {// p - на {
+    const char *close = closing_brace(p + 1, end);
+    if (close == NULL) {
+        fprintf(stderr, "Ошибка: незакрытая ${\n");
+        expand->error = 1;
+        return end;
+    }
+
+    const char *name = p + 1;
+    int want_length = 0;
+    if (*name == '#' && name + 1 < close) {// ${#имя}
+        want_length = 1;
+        name++;
+    }
+    size_t length = name_length(name, close);
+    const char *op = name + length;
+    int colon = (op < close && *op == ':');
+
+    if (length == 0 || (want_length && op != close) ||
+        (op != close && (op + colon >= close || strchr("-=+?", op[colon]) == NULL))) {
+        fprintf(stderr, "Ошибка: %.*s: неверная подстановка\n", (int)(close - p + 2), p - 1);
+        expand->error = 1;
+        return close + 1;
+    }
+
+    const char *value = lookup(name, length);
+    if (want_length) {
+        size_t chars = 0;
+        for (const char *c = value ? value : ""; *c != '\0'; c++) {
+            chars += ((unsigned char)*c & 0xC0) != 0x80;// Символы UTF-8, а не байты
+        }
+        char text[24];
+        snprintf(text, sizeof(text), "%zu", chars);
+        put_value(expand, text, quoted, split);
+        return close + 1;
+    }
+    if (op == close) {
+        put_value(expand, value, quoted, split);
+        return close + 1;
+    }
+
+    char action = op[colon];
+    const char *word = op + colon + 1;
+    int is_set = value != NULL && !(colon && value[0] == '\0');
+    switch (action) {
+        case '-':
+            if (is_set) {
+                put_value(expand, value, quoted, split);
+            } else {
+                expand_text(expand, word, close, quoted, split);
+            }
+            break;
+        case '+':
+            if (is_set) {
+                expand_text(expand, word, close, quoted, split);
+            } else if (quoted) {
+                open_field(expand);
+            }
+            break;
+        case '=':
+            if (!is_set) {
+                char *assigned = expand_string(word, close);
+                if (assigned == NULL) {
+                    expand->error = 1;
+                    break;
+                }
+                char *variable = strndup(name, length);
+                if (variable == NULL || var_set(variable, assigned, 0) < 0) {
+                    fprintf(stderr, "Ошибка: $%.*s: так присвоить нельзя\n", (int)length, name);
+                    expand->error = 1;
+                }
+                free(variable);
+                free(assigned);
+                if (expand->error) {
+                    break;
+                }
+                value = lookup(name, length);
+            }
+            put_value(expand, value, quoted, split);
+            break;
+        case '?':
+            if (is_set) {
+                put_value(expand, value, quoted, split);
+            } else {
+                char *message = expand_string(word, close);
+                fprintf(stderr, "%.*s: %s\n", (int)length, name,
+                        (message != NULL && message[0] != '\0') ? message : "параметр не задан или пуст");
+                free(message);
+                expand->error = 1;
+            }
+            break;
+    }
+    return close + 1;
+}
+
+
+static void substitute(expand_t *expand, const char *text, size_t length, int quoted, int split) {// Вывод команды идет как значение параметра
+    int status = subst_run(text, length, &expand->output);
+    if (status < 0) {
+        expand->error = 1;
+        return;
+    }
+    expand->status = status;
+    put_value(expand, expand->output.data, quoted, split);
+}
+
+
+static const char *expand_backquote(expand_t *expand, const char *p, const char *end, int quoted, int split) {// p - на `
+    int close = skip_command(p, 0, end - p);
+    if (close < 0) {
+        fprintf(stderr, "Ошибка: незакрытая `\n");
+        expand->error = 1;
+        return end;
+    }
+    const char *body = p + 1;
+    size_t length = close - 2;
+    if (memchr(body, '\\', length) == NULL) {
+        substitute(expand, body, length, quoted, split);
+        return p + close;
+    }
+
+    char *text = malloc(length + 1);// Внутри `...` слеш перед $ ` \ (и " в двойных кавычках) снимается до разбора
+    if (text == NULL) {
+        perror("malloc");
+        expand->error = 1;
+        return end;
+    }
+    size_t used = 0;
+    for (const char *c = body; c < body + length; c++) {
+        if (*c == '\\' && c + 1 < body + length && strchr(quoted ? "$`\\\"" : "$`\\", c[1]) != NULL) {
+            c++;
+        }
+        text[used++] = *c;
+    }
+    substitute(expand, text, used, quoted, split);
+    free(text);
+    return p + close;
+}
+
+
+static const char *expand_parameter(expand_t *expand, const char *p, const char *end, int quoted, int split) {// p - после $
+    if (*p == '{') {
+        return expand_braces(expand, p, end, quoted, split);
+    }
+    if (*p == '(') {
+        int close = skip_command(p, 0, end - p);
+        if (close < 0) {
+            fprintf(stderr, "Ошибка: незакрытая $(\n");
+            expand->error = 1;
+            return end;
+        }
+        substitute(expand, p + 1, close - 2, quoted, split);
+        return p + close;
+    }
+    size_t length = name_length(p, end);
+    put_value(expand, lookup(p, length), quoted, split);
+    return p + length;
+}
+
+
+// Один проход по исходному тексту слова: кавычки снимаются, подстановки
+// раскрываются сразу в буфер. quoted - текст внутри двойных кавычек
+static void expand_text(expand_t *expand, const char *p, const char *end, int quoted, int split) {
+    while (p < end && !expand->error) {
+        char c = *p;
+        if (c == '\'' && !quoted) {
+            const char *close = memchr(p + 1, '\'', end - p - 1);
+            if (close == NULL) {
+                close = end;
+            }
+            open_field(expand);
+            put_quoted(expand, p + 1, close - p - 1);
+            p = close < end ? close + 1 : end;
+        } else if (c == '"') {
+            quoted = !quoted;
+            open_field(expand);
+            p++;
+        } else if (c == '\\' && p + 1 < end) {
+            if (!quoted || strchr("$`\"\\\n", p[1]) != NULL) {
+                put_quoted(expand, p + 1, 1);
+                p += 2;
+            } else {
+                put_quoted(expand, p, 1);// В двойных кавычках "\n" остается двумя символами
+                p++;
+            }
+        } else if (c == '$' && p + 1 < end && is_expansion_start(p[1])) {
+            p = expand_parameter(expand, p + 1, end, quoted, split);
+        } else if (c == '`') {
+            p = expand_backquote(expand, p, end, quoted, split);
+        } else if (quoted) {
+            put_quoted(expand, p, 1);
+            p++;
+        } else {
+            put_active(expand, *p++);
+        }
+    }
+}
+
+
+static int expand_variant(void *context, const char *word, size_t length) {// Вариант {a,b} раскрывается как отдельное слово
+    expand_t *expand = context;
+    expand_text(expand, word, word + length, 0, 1);
+    end_field(expand);
+    return expand->error ? -1 : 0;
+}
+
+
+static void expand_one(expand_t *expand, const char *word, int flags, int split) {
+    if ((flags & WORD_BRACE) && split) {// Варианты идут прямо в поля, списком нигде не хранятся
+        if (brace_expand(&expand->braces, word, strlen(word), expand_variant, expand) != 0) {
+            expand->error = 1;
+        }
+        return;
+    }
+    expand_text(expand, word, word + strlen(word), 0, split);
+    end_field(expand);
+}
+
+
+typedef struct {
+    size_t total;
+    size_t limit;
+} measure_t;
+
+
+static int measure_variant(void *context, const char *word, size_t length) {
+    (void)word;
+    measure_t *measure = context;
+    measure->total += length + 1 + sizeof(char *);
+    return measure->total > measure->limit;// Превысили - дальше не считаем
+}
+
+
+int expand_exceeds(expand_t *expand, char **words, const unsigned char *flags, int count, size_t limit) {
+    measure_t measure = { 0, limit };
+    for (int i = 0; i < count && measure.total <= limit; i++) {
+        if (flags[i] & WORD_BRACE) {
+            if (brace_expand(&expand->braces, words[i], strlen(words[i]), measure_variant, &measure) < 0) {
+                return 0;// Нехватку памяти сообщит само раскрытие
+            }
+        } else {
+            measure.total += strlen(words[i]) + 1 + sizeof(char *);
+        }
+    }
+    return measure.total > limit;
+}
+
+
+static int is_assignment(const char *word) {
+    const char *equals = strchr(word, '=');
+    return equals != NULL && var_valid_name(word, equals - word);
+}
+
+
+char **expand_command(expand_t *expand, char **words, const unsigned char *flags, int count, int *argc) {
+    reset(expand);
+    dir_cache_next_generation();// Шаблоны одной команды делят списки каталогов, следующая команда их перепроверит
+    int assigning = 1;// Присваивания в начале команды не делятся на поля и не раскрываются по шаблону: A=$x cmd
+    for (int i = 0; i < count && !expand->error; i++) {
+        assigning = assigning && is_assignment(words[i]);
+        if (flags[i] == 0) {
+            add_field(expand, words[i], 0);// Кавычки уже сняты лексером
+            continue;
+        }
+        expand->glob = !assigning;
+        expand_one(expand, words[i], flags[i], !assigning);
+    }
+    if (expand->error) {
+        return NULL;
+    }
+
+    if (expand->field_count + 1 > expand->argv_capacity) {
+        int capacity = expand->argv_capacity ? expand->argv_capacity : EXPAND_INITIAL_FIELDS;
+        while (capacity < expand->field_count + 1) {
+            capacity *= 2;
+        }
+        char **argv = realloc(expand->argv, capacity * sizeof(char *));
+        if (argv == NULL) {
+            perror("malloc");
+            return NULL;
+        }
+        expand->argv = argv;
+        expand->argv_capacity = capacity;
+    }
+    for (int i = 0; i < expand->field_count; i++) {// Буфер больше не растет - можно брать указатели
+        field_t *field = &expand->fields[i];
+        expand->argv[i] = field->literal ? (char *)field->literal : expand->buffer + field->offset;
+    }
+    expand->argv[expand->field_count] = NULL;
+    *argc = expand->field_count;
+    return expand->argv;
+}
+
+
+int expand_status(expand_t *expand) {
+    return expand->status;
+}
+
+
+char *expand_word(const char *word, int flags) {
+    expand_t *expand = expand_acquire();
+    if (expand == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+    reset(expand);
+    dir_cache_next_generation();
+    expand->glob = 1;// > *.log - если совпадение одно
+    expand_one(expand, word, flags, 1);
+
+    char *result = NULL;
+    if (!expand->error) {
+        if (expand->field_count != 1) {
+            fprintf(stderr, "%s: неоднозначное перенаправление\n", word);
+        } else {
+            result = strdup(expand->fields[0].offset + expand->buffer);// Совпадение шаблона лежит за текстом самого шаблона
+            if (result == NULL) {
+                perror("malloc");
+            }
+        }
+    }
+    expand_release(expand);
+    return result;
+}
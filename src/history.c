@@ -1,111 +1,632 @@
+#define _GNU_SOURCE// memmem
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include "shell.h"
+#include "builtin_io.h"
 
-void history_add(shell_t *shell, const char *command) {
-    if (!command || strlen(command) == 0) return;
-    
-    
-    if (shell->history_tail && strcmp(shell->history_tail->command, command) == 0) {// Не добавляем пустые команды и дубликаты подряд
+#define HISTORY_INDEX_MAGIC "MSHIDX01"// Заголовок файла индекса
+#define HISTORY_INDEX_HEADER 8
+#define HISTORY_READ_CHUNK 256// Шаг чтения команды, которой нет в отображении
+#define TRIGRAM_INITIAL_CAPACITY 4096// Ячеек хеш-таблицы триграмм, степень двойки
+
+
+static size_t entry_total(history_t *history) {
+    return history->mapped_count + history->added_count;
+}
+
+
+static uint64_t entry_offset(history_t *history, size_t i) {
+    if (i < history->mapped_count) {
+        return history->index_map[i];
+    }
+    return history->added[i - history->mapped_count];
+}
+
+
+static int reserve_line(history_t *history, size_t length) {// Буфер под команду длины length и \0
+    if (length < history->line_capacity) {
+        return 0;
+    }
+    size_t capacity = history->line_capacity ? history->line_capacity : HISTORY_READ_CHUNK;
+    while (capacity <= length) {
+        capacity *= 2;
+    }
+    char *grown = realloc(history->line, capacity);
+    if (grown == NULL) {
+        return -1;
+    }
+    history->line = grown;
+    history->line_capacity = capacity;
+    return 0;
+}
+
+
+static const char *entry_text(history_t *history, size_t i) {// Команда с \0 в буфере history->line
+    uint64_t start = entry_offset(history, i);
+
+    if (start < history->map_size) {// Загружена при старте - берем из отображения
+        const char *end = memchr(history->map + start, '\n', history->map_size - start);
+        if (end != NULL) {
+            size_t length = end - (history->map + start);
+            if (reserve_line(history, length) < 0) {
+                return NULL;
+            }
+            memcpy(history->line, history->map + start, length);
+            history->line[length] = '\0';
+            return history->line;
+        }
+    }
+
+    size_t length = 0;// Добавлена в этом сеансе - дочитываем из файла до \n
+    while (1) {
+        if (reserve_line(history, length + HISTORY_READ_CHUNK) < 0) {
+            return NULL;
+        }
+        ssize_t n = pread(history->fd, history->line + length, HISTORY_READ_CHUNK, start + length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        char *end = memchr(history->line + length, '\n', n);
+        if (end != NULL) {
+            length = end - history->line;
+            break;
+        }
+        length += n;
+    }
+    history->line[length] = '\0';
+    return history->line;
+}
+
+
+static const char *entry_span(history_t *history, size_t i, size_t *length) {// Команда без копирования, если она в отображении
+    uint64_t start = entry_offset(history, i);
+    if (start < history->map_size) {
+        const char *end = memchr(history->map + start, '\n', history->map_size - start);
+        if (end != NULL) {
+            *length = end - (history->map + start);
+            return history->map + start;
+        }
+    }
+
+    const char *text = entry_text(history, i);
+    *length = text ? strlen(text) : 0;
+    return text;
+}
+
+
+static uint32_t trigram_key(const char *text) {
+    const unsigned char *p = (const unsigned char *)text;
+    return ((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) + 1;
+}
+
+
+static size_t trigram_hash(uint32_t key, size_t capacity) {
+    uint32_t hash = key * 0x9E3779B1u;
+    hash ^= hash >> 15;
+    return hash & (capacity - 1);
+}
+
+
+static void trigrams_free(history_t *history) {// Без индекса поиск идет перебором - результат тот же
+    for (size_t i = 0; i < history->trigram_capacity; i++) {
+        free(history->trigrams[i].entries);
+    }
+    free(history->trigrams);
+    history->trigrams = NULL;
+    history->trigram_capacity = 0;
+    history->trigram_used = 0;
+}
+
+
+static history_trigram_t *trigram_find(history_t *history, uint32_t key) {
+    size_t mask = history->trigram_capacity - 1;
+    for (size_t i = trigram_hash(key, history->trigram_capacity); ; i = (i + 1) & mask) {
+        history_trigram_t *slot = &history->trigrams[i];
+        if (slot->key == key || slot->key == 0) {
+            return slot;
+        }
+    }
+}
+
+
+static int trigrams_grow(history_t *history) {
+    size_t old_capacity = history->trigram_capacity;
+    history_trigram_t *old = history->trigrams;
+
+    size_t capacity = old_capacity ? old_capacity * 2 : TRIGRAM_INITIAL_CAPACITY;
+    history->trigrams = calloc(capacity, sizeof(history_trigram_t));
+    if (history->trigrams == NULL) {
+        history->trigrams = old;
+        return -1;
+    }
+    history->trigram_capacity = capacity;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].key != 0) {
+            *trigram_find(history, old[i].key) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+
+static int trigrams_add(history_t *history, uint32_t id, const char *text, size_t length) {// Номера приходят по возрастанию
+    for (size_t i = 0; i + 3 <= length; i++) {
+        if ((history->trigram_used + 1) * 2 > history->trigram_capacity && trigrams_grow(history) < 0) {
+            return -1;
+        }
+
+        uint32_t key = trigram_key(text + i);
+        history_trigram_t *slot = trigram_find(history, key);
+        if (slot->key == 0) {
+            slot->key = key;
+            history->trigram_used++;
+        }
+        if (slot->count > 0 && slot->entries[slot->count - 1] == id) {
+            continue;// Триграмма повторяется в той же команде
+        }
+
+        if (slot->count == slot->capacity) {
+            uint32_t capacity = slot->capacity ? slot->capacity * 2 : 4;
+            uint32_t *grown = realloc(slot->entries, capacity * sizeof(uint32_t));
+            if (grown == NULL) {
+                return -1;
+            }
+            slot->entries = grown;
+            slot->capacity = capacity;
+        }
+        slot->entries[slot->count++] = id;
+    }
+    return 0;
+}
+
+
+static void index_entry(history_t *history, size_t id, const char *text, size_t length) {
+    if (history->trigrams != NULL && trigrams_add(history, (uint32_t)id, text, length) < 0) {
+        trigrams_free(history);
+    }
+}
+
+
+static void build_trigrams(history_t *history) {// Все видимые команды берутся из отображения без копирования
+    if (trigrams_grow(history) < 0) {
         return;
     }
-    
-    history_entry_t *entry = malloc(sizeof(history_entry_t));
-    entry->command = strdup(command);
-    entry->next = NULL;
-    entry->prev = shell->history_tail;
-    
-    if (shell->history_tail) {
-        shell->history_tail->next = entry;
-    }
-    shell->history_tail = entry;
-    
-    if (!shell->history_head) {
-        shell->history_head = entry;
-    }
-    
-    shell->history_count++;
-    
-    
-    while (shell->history_count > MAX_HISTORY) {// Ограничиваем размер истории
-        history_entry_t *old = shell->history_head;
-        shell->history_head = old->next;
-        if (shell->history_head) {
-            shell->history_head->prev = NULL;
-        }
-        free(old->command);
-        free(old);
-        shell->history_count--;
-    }
-    
-    shell->history_current = shell->history_tail;
-}
-
-void history_load(shell_t *shell) {
+    size_t total = entry_total(history);
+    for (size_t i = history->first; i < total && history->trigrams != NULL; i++) {
+        size_t length;
+        const char *text = entry_span(history, i, &length);
+        if (text != NULL) {
+            index_entry(history, i, text, length);
+        }
+    }
+}
+
+
+static int entry_contains(history_t *history, size_t i, const char *query, size_t length) {
+    size_t entry_length;
+    const char *text = entry_span(history, i, &entry_length);
+    return text != NULL && memmem(text, entry_length, query, length) != NULL;
+}
+
+
+static int push_offset(history_t *history, uint64_t offset) {
+    if (history->added_count == history->added_capacity) {
+        size_t capacity = history->added_capacity ? history->added_capacity * 2 : 64;
+        uint64_t *grown = realloc(history->added, capacity * sizeof(uint64_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        history->added = grown;
+        history->added_capacity = capacity;
+    }
+    history->added[history->added_count++] = offset;
+    return 0;
+}
+
+
+static size_t history_capacity(void) {// MYSHELL_HISTSIZE или значение по умолчанию
+    const char *value = getenv(HISTORY_SIZE_ENV);
+    if (value == NULL || value[0] == '\0') {
+        return HISTORY_DEFAULT_SIZE;
+    }
+    char *end;
+    long size = strtol(value, &end, 10);
+    if (*end != '\0' || size <= 0) {
+        fprintf(stderr, "Ошибка: %s: неверный размер истории: %s\n", HISTORY_SIZE_ENV, value);
+        return HISTORY_DEFAULT_SIZE;
+    }
+    return size < HISTORY_MAX_SIZE ? (size_t)size : HISTORY_MAX_SIZE;
+}
+
+
+static void unmap_files(history_t *history) {
+    if (history->map != NULL) {
+        munmap((void *)history->map, history->map_size);
+    }
+    if (history->index_map != NULL) {
+        munmap((void *)((const char *)history->index_map - HISTORY_INDEX_HEADER), history->index_map_size);
+    }
+    history->map = NULL;
+    history->map_size = 0;
+    history->index_map = NULL;
+    history->index_map_size = 0;
+    history->mapped_count = 0;
+}
+
+
+static int index_valid(history_t *history) {// Индекс указывает на начала строк текущего файла
+    if (history->mapped_count == 0) {
+        return 1;
+    }
+    uint64_t last = history->index_map[history->mapped_count - 1];
+    if (last >= history->map_size) {
+        return 0;// Файл истории обрезан или заменен
+    }
+    return last == 0 || history->map[last - 1] == '\n';
+}
+
+
+static void map_index(history_t *history) {// Отображает индекс; испорченный или чужой начинаем заново
+    struct stat st;
+    if (fstat(history->index_fd, &st) < 0) {
+        return;
+    }
+
+    size_t size = st.st_size;
+    if (size >= HISTORY_INDEX_HEADER && (size - HISTORY_INDEX_HEADER) % sizeof(uint64_t) == 0) {
+        const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, history->index_fd, 0);
+        if (map != MAP_FAILED && memcmp(map, HISTORY_INDEX_MAGIC, HISTORY_INDEX_HEADER) == 0) {
+            history->index_map = (const uint64_t *)(map + HISTORY_INDEX_HEADER);
+            history->index_map_size = size;
+            history->mapped_count = (size - HISTORY_INDEX_HEADER) / sizeof(uint64_t);
+            if (index_valid(history)) {
+                return;
+            }
+        }
+        if (map != MAP_FAILED) {
+            munmap((void *)map, size);
+        }
+        history->index_map = NULL;
+        history->index_map_size = 0;
+        history->mapped_count = 0;
+    }
+
+    if (ftruncate(history->index_fd, 0) < 0 ||
+        write_all(history->index_fd, HISTORY_INDEX_MAGIC, HISTORY_INDEX_HEADER) < 0) {
+        perror(history->path);
+    }
+}
+
+
+static void index_tail(history_t *history) {// Команды за последней проиндексированной (старый формат, сбой) - в индекс
+    size_t position = 0;
+    if (history->mapped_count > 0) {
+        uint64_t last = history->index_map[history->mapped_count - 1];
+        const char *end = memchr(history->map + last, '\n', history->map_size - last);
+        position = end ? (size_t)(end - history->map) + 1 : history->map_size;
+    }
+
+    size_t first_new = history->added_count;
+    while (position < history->map_size) {
+        if (push_offset(history, position) < 0) {
+            break;
+        }
+        const char *end = memchr(history->map + position, '\n', history->map_size - position);
+        position = end ? (size_t)(end - history->map) + 1 : history->map_size;
+    }
+
+    if (history->map_size > 0 && history->map[history->map_size - 1] != '\n') {// Последняя строка без \n - иначе к ней приклеится новая команда
+        write_all(history->fd, "\n", 1);
+    }
+
+    size_t count = history->added_count - first_new;
+    if (count > 0 && write_all(history->index_fd, history->added + first_new, count * sizeof(uint64_t)) < 0) {
+        perror(history->path);
+    }
+}
+
+
+static int compact(history_t *history) {// Оставляет в файле последние capacity команд; индекс построится при загрузке
+    uint64_t start = entry_offset(history, entry_total(history) - history->capacity);
+
+    size_t length = strlen(history->path) + sizeof(".tmp");
+    char *temp = malloc(length);
+    if (temp == NULL) {
+        return -1;
+    }
+    snprintf(temp, length, "%s.tmp", history->path);
+
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        perror(temp);
+        free(temp);
+        return -1;
+    }
+    int status = write_all(fd, history->map + start, history->map_size - start);
+    close(fd);
+    if (status < 0 || rename(temp, history->path) < 0) {
+        perror(temp);
+        unlink(temp);
+        free(temp);
+        return -1;
+    }
+    free(temp);
+
+    if (ftruncate(history->index_fd, 0) < 0) {
+        perror(history->path);
+    }
+    return 0;
+}
+
+
+static int open_files(history_t *history) {
+    history->fd = open(history->path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (history->fd < 0) {
+        perror(history->path);
+        return -1;
+    }
+
+    size_t length = strlen(history->path) + sizeof(HISTORY_INDEX_SUFFIX);
+    char *index_path = malloc(length);
+    if (index_path == NULL) {
+        return -1;
+    }
+    snprintf(index_path, length, "%s%s", history->path, HISTORY_INDEX_SUFFIX);
+    history->index_fd = open(index_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (history->index_fd < 0) {
+        perror(index_path);
+    }
+    free(index_path);
+    if (history->index_fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(history->fd, &st) < 0) {
+        perror(history->path);
+        return -1;
+    }
+    if (st.st_size > 0) {
+        const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, history->fd, 0);
+        if (map == MAP_FAILED) {
+            perror(history->path);
+            return -1;
+        }
+        history->map = map;
+        history->map_size = st.st_size;
+    }
+
+    map_index(history);
+    index_tail(history);
+    return 0;
+}
+
+
+static void close_files(history_t *history) {
+    unmap_files(history);
+    if (history->fd >= 0) {
+        close(history->fd);
+    }
+    if (history->index_fd >= 0) {
+        close(history->index_fd);
+    }
+    history->fd = -1;
+    history->index_fd = -1;
+    history->added_count = 0;
+}
+
+
+void history_load(shell_t *shell) {// Отображает историю в память; время не зависит от ее размера
+    history_t *history = &shell->history;
     const char *home = getenv("HOME");
     if (!home) return;
-    
-    char path[1024];
-    snprintf(path, sizeof(path), "%s/.my_shell_history", home);
-    
-    shell->history_file = strdup(path);
-    
-    FILE *f = fopen(path, "r");
-    if (!f) return;
-    
-    char line[MAX_LINE_LENGTH];
-    while (fgets(line, sizeof(line), f)) {
-        line[strcspn(line, "\n")] = 0;
-        history_add(shell, line);
-    }
-    
-    fclose(f);
-}
-
-void history_save(shell_t *shell) {
-    if (!shell->history_file) return;
-    
-    FILE *f = fopen(shell->history_file, "w");
-    if (!f) return;
-    
-    history_entry_t *entry = shell->history_head;
-    while (entry) {
-        fprintf(f, "%s\n", entry->command);
-        entry = entry->next;
-    }
-    
-    fclose(f);
+
+    size_t length = strlen(home) + sizeof("/" HISTORY_FILE_NAME);
+    history->path = malloc(length);
+    if (history->path == NULL) {
+        return;
+    }
+    snprintf(history->path, length, "%s/%s", home, HISTORY_FILE_NAME);
+    history->capacity = history_capacity();
+
+    if (open_files(history) < 0) {
+        close_files(history);
+        return;
+    }
+
+    if (entry_total(history) > history->capacity * 2) {// Переписываем редко: только когда старые команды заняли больше половины
+        if (compact(history) == 0) {
+            close_files(history);
+            if (open_files(history) < 0) {
+                close_files(history);
+                return;
+            }
+        }
+    }
+
+    size_t total = entry_total(history);
+    history->first = total > history->capacity ? total - history->capacity : 0;
+    history->position = total;
+    build_trigrams(history);
+}
+
+
+void history_close(shell_t *shell) {
+    history_t *history = &shell->history;
+    close_files(history);
+    trigrams_free(history);
+    free(history->added);
+    free(history->line);
+    free(history->path);
+    history->added = NULL;
+    history->added_capacity = 0;
+    history->line = NULL;
+    history->line_capacity = 0;
+    history->path = NULL;
 }
 
+
+void history_add(shell_t *shell, const char *command) {// Дописывает команду в файл одним write
+    history_t *history = &shell->history;
+    if (!command || strlen(command) == 0) return;
+    if (history->fd < 0 || strchr(command, '\n') != NULL) return;// Команда в файле - одна строка
+
+    size_t total = entry_total(history);
+    if (total > history->first) {// Не добавляем дубликаты подряд
+        const char *last = entry_text(history, total - 1);
+        if (last != NULL && strcmp(last, command) == 0) {
+            history->position = total;
+            return;
+        }
+    }
+
+    size_t length = strlen(command);
+    struct iovec parts[2] = {
+        { (void *)command, length },
+        { "\n", 1 }
+    };
+    ssize_t written = writev(history->fd, parts, 2);
+    if (written != (ssize_t)(length + 1)) {
+        if (written < 0) {
+            perror(history->path);
+        }
+        return;
+    }
+
+    off_t end = lseek(history->fd, 0, SEEK_CUR);// С O_APPEND - конец именно нашей записи, даже если пишет другой shell
+    if (end < 0 || push_offset(history, end - (length + 1)) < 0) {
+        return;
+    }
+    uint64_t offset = end - (length + 1);
+    if (write_all(history->index_fd, &offset, sizeof(offset)) < 0) {
+        perror(history->path);
+    }
+
+    index_entry(history, total, command, length);
+    total++;
+    if (total - history->first > history->capacity) {// Ограничиваем размер истории
+        history->first = total - history->capacity;
+    }
+    history->position = total;
+}
+
+
+size_t history_count(shell_t *shell) {
+    history_t *history = &shell->history;
+    return entry_total(history) - history->first;
+}
+
+
+const char *history_get(shell_t *shell, size_t number) {
+    history_t *history = &shell->history;
+    if (number >= history_count(shell)) {
+        return NULL;
+    }
+    return entry_text(history, history->first + number);
+}
+
+
+long history_search(shell_t *shell, const char *query, size_t before) {// Кандидаты - только команды с самой редкой триграммой запроса
+    history_t *history = &shell->history;
+    size_t length = strlen(query);
+    size_t count = history_count(shell);
+    size_t end = history->first + (before < count ? before : count);
+    if (length == 0) {
+        return -1;
+    }
+
+    if (length < 3 || history->trigrams == NULL) {// Короткий запрос - перебор от новых к старым
+        for (size_t i = end; i-- > history->first;) {
+            if (entry_contains(history, i, query, length)) {
+                return (long)(i - history->first);
+            }
+        }
+        return -1;
+    }
+
+    history_trigram_t *rarest = NULL;
+    for (size_t i = 0; i + 3 <= length; i++) {
+        history_trigram_t *slot = trigram_find(history, trigram_key(query + i));
+        if (slot->key == 0) {
+            return -1;// Такой триграммы нет ни в одной команде
+        }
+        if (rarest == NULL || slot->count < rarest->count) {
+            rarest = slot;
+        }
+    }
+
+    size_t low = 0, high = rarest->count;// Первый номер >= end
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (rarest->entries[middle] < end) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    for (size_t k = low; k-- > 0;) {
+        size_t id = rarest->entries[k];
+        if (id < history->first) {
+            break;
+        }
+        if (entry_contains(history, id, query, length)) {
+            return (long)(id - history->first);
+        }
+    }
+    return -1;
+}
+
+
 void history_print(shell_t *shell) {
-    history_entry_t *entry = shell->history_head;
-    int i = 1;
-    
-    while (entry) {
-        printf("%5d  %s\n", i++, entry->command);
-        entry = entry->next;
+    size_t count = history_count(shell);
+
+    for (size_t i = 0; i < count; i++) {
+        const char *command = history_get(shell, i);
+        if (command != NULL) {
+            printf("%5zu  %s\n", i + 1, command);
+        }
     }
 }
 
 const char *history_prev(shell_t *shell) {
-    if (!shell->history_current) return NULL;
-    
-    if (shell->history_current->prev) {
-        shell->history_current = shell->history_current->prev;
+    history_t *history = &shell->history;
+    if (entry_total(history) == history->first) return NULL;
+
+    if (history->position > history->first) {
+        history->position--;
     }
-    
-    return shell->history_current->command;
+
+    return entry_text(history, history->position);
 }
 
 const char *history_next(shell_t *shell) {
-    if (!shell->history_current) return NULL;
-    
-    if (shell->history_current->next) {
-        shell->history_current = shell->history_current->next;
-        return shell->history_current->command;
+    history_t *history = &shell->history;
+    size_t total = entry_total(history);
+    if (total == history->first) return NULL;
+
+    if (history->position + 1 < total) {
+        history->position++;
+        return entry_text(history, history->position);
     }
-    
+
+    history->position = total;
     return ""; // Пустая строка для новой команды
 }
+
+void history_rewind(shell_t *shell) {
+    history_t *history = &shell->history;
+    history->position = entry_total(history);
+}
@@ -2,76 +2,571 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <errno.h>
 #include <termios.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
 #include "job_control.h"
+#include "event_loop.h"
+#include "stats.h"
+
+#define JOB_TABLE_INITIAL 16
+#define PID_HASH_INITIAL 64
+
+#ifndef PIDFD_SIGNAL_PROCESS_GROUP
+#define PIDFD_SIGNAL_PROCESS_GROUP (1U << 2)// Linux 6.9: сигнал группе процесса, на который указывает pidfd
+#endif
+
+typedef struct {// Ячейка хэша pid -> процесс задачи (pid 0 - пустая)
+    pid_t pid;
+    job_t *job;
+    int proc_index;
+} pid_slot_t;
 
 //глобальные переменные для управления задачами
-static job_t *job_list = NULL;//Список задач
-static int next_job_id = 1;//Счетчик ID задач
+static job_t **job_table = NULL;// job_table[id] - задача с номером id (0 не используется)
+static int table_capacity = 0;
+static int table_count = 0;
+static int free_hint = 1;// Все номера меньше free_hint заняты
+
+static pid_slot_t *pid_slots = NULL;
+static size_t pid_capacity = 0;// Степень двойки
+static size_t pid_used = 0;
+
+static job_t *notify_head = NULL;// Задачи, о смене состояния которых еще не сообщили (в порядке событий)
+static job_t *notify_tail = NULL;
+static int report_jobs = 0;// Интерактивный режим: о задачах сообщаем перед приглашением
+static int job_control = 0;// Интерактивный shell на терминале: задачи в своих группах, терминал у задачи переднего плана
+static pid_t shell_pgid = 0;
+static int terminal_fd = -1;// Копия stdin-терминала: у ребенка fd 0 может быть уже пайпом или файлом
+
+static job_t *waited_head = NULL;// Завершившиеся задачи, которых ждет wait (в порядке завершения)
+static job_t *waited_tail = NULL;
+static int wait_set = -1;// Набор epoll выполняющегося wait
+
+static int pidfd_budget = -1;// Сколько дескрипторов можно отдать под pidfd
+static int pidfd_open_count = 0;
+
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;// jobs в конвейере читает таблицу из своего потока
+
+
+static int open_pidfd(pid_t pid) {// pid еще наш: статус не забран, а забирает его только event_loop_reap
+#ifdef SYS_pidfd_open
+    if (pidfd_budget < 0) {// Половина лимита - остальное пайпам и файлам перенаправлений
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+            pidfd_budget = (int)(limit.rlim_cur / 2);
+        } else {
+            pidfd_budget = 512;
+        }
+    }
+    if (pidfd_open_count >= pidfd_budget) {
+        return -1;// Без pidfd процесс ждется через signalfd
+    }
+
+    int fd = (int)syscall(SYS_pidfd_open, pid, 0);// Всегда с O_CLOEXEC
+    if (fd >= 0) {
+        pidfd_open_count++;
+    }
+    return fd;
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+
+static void close_pidfd(job_process_t *proc) {
+    if (proc->pidfd < 0) {
+        return;
+    }
+    if (wait_set >= 0) {// Копия дескриптора в дочернем процессе до exec держала бы его в наборе
+        epoll_ctl(wait_set, EPOLL_CTL_DEL, proc->pidfd, NULL);
+    }
+    close(proc->pidfd);
+    proc->pidfd = -1;
+    pidfd_open_count--;
+}
+
+
+static int pidfd_signal(int pidfd, int sig, unsigned int flags) {
+#ifdef SYS_pidfd_send_signal
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, flags);
+#else
+    (void)pidfd;
+    (void)sig;
+    (void)flags;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+static size_t pid_hash(pid_t pid) {
+    unsigned int h = (unsigned int)pid;
+    h ^= h >> 16;
+    h *= 0x45d9f3bU;
+    h ^= h >> 16;
+    return h & (pid_capacity - 1);
+}
+
+
+static pid_slot_t *pid_lookup(pid_t pid) {// Линейное пробирование. Обработчика SIGCHLD нет: статусы забирает event_loop_reap в основном потоке, поэтому ограничений async-signal-safe здесь нет
+    if (pid_capacity == 0) {
+        return NULL;
+    }
+    for (size_t i = pid_hash(pid); pid_slots[i].pid != 0; i = (i + 1) & (pid_capacity - 1)) {
+        if (pid_slots[i].pid == pid) {
+            return &pid_slots[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void pid_place(pid_t pid, job_t *job, int proc_index) {// Вставка без проверки заполненности
+    size_t i = pid_hash(pid);
+    while (pid_slots[i].pid != 0 && pid_slots[i].pid != pid) {
+        i = (i + 1) & (pid_capacity - 1);
+    }
+    if (pid_slots[i].pid == 0) {
+        pid_used++;
+    }
+    pid_slots[i].pid = pid;
+    pid_slots[i].job = job;
+    pid_slots[i].proc_index = proc_index;
+}
+
 
-job_t *create_job(pid_t pgid, const char *command) {// Создает новую задачу
+static int pid_insert(pid_t pid, job_t *job, int proc_index) {// Таблица заполнена не больше чем наполовину
+    if ((pid_used + 1) * 2 > pid_capacity) {
+        size_t old_capacity = pid_capacity;
+        pid_slot_t *old_slots = pid_slots;
+        size_t capacity = pid_capacity ? pid_capacity * 2 : PID_HASH_INITIAL;
+
+        pid_slot_t *slots = calloc(capacity, sizeof(pid_slot_t));
+        if (slots == NULL) {
+            return -1;
+        }
+        pid_slots = slots;
+        pid_capacity = capacity;
+        pid_used = 0;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_slots[i].pid != 0) {
+                pid_place(old_slots[i].pid, old_slots[i].job, old_slots[i].proc_index);
+            }
+        }
+        free(old_slots);
+    }
+
+    pid_place(pid, job, proc_index);
+    return 0;
+}
+
+
+static void pid_remove(pid_t pid) {// Удаление со сдвигом назад - без надгробий, цепочки остаются короткими
+    pid_slot_t *slot = pid_lookup(pid);
+    if (slot == NULL) {
+        return;
+    }
+
+    size_t hole = slot - pid_slots;
+    size_t i = hole;
+    while (1) {
+        i = (i + 1) & (pid_capacity - 1);
+        if (pid_slots[i].pid == 0) {
+            break;
+        }
+        size_t home = pid_hash(pid_slots[i].pid);
+        if (((i - home) & (pid_capacity - 1)) >= ((i - hole) & (pid_capacity - 1))) {// Запись может переехать в дыру, не оказавшись раньше своей ячейки
+            pid_slots[hole] = pid_slots[i];
+            hole = i;
+        }
+    }
+    pid_slots[hole].pid = 0;
+    pid_slots[hole].job = NULL;
+    pid_used--;
+}
+
+
+job_t *create_job(pid_t pgid, const char *command) {// Создает новую задачу (номер выдает add_job)
     job_t *job = malloc(sizeof(job_t));
     if (job == NULL) {
         return NULL;
     }
     
-    job->job_id = next_job_id++;
+    job->job_id = 0;
     job->pgid = pgid;
     job->command = strdup(command);
     job->state = JOB_RUNNING;
-    job->next = NULL;
+    job->procs = NULL;
+    job->proc_count = 0;
+    job->proc_capacity = 0;
+    job->live_count = 0;
+    job->foreground = 0;
+    job->next_notify = NULL;
+    job->queued = 0;
+    job->waiting = 0;
+    job->next_waited = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    memset(&job->finished, 0, sizeof(job->finished));
+    memset(&job->usage, 0, sizeof(job->usage));
     
     return job;
 }
 
-void add_job(job_t *job) {
-    if (job_list == NULL) {
-        job_list = job;
+
+int job_add_process(job_t *job, pid_t pid, job_state_t state) {// Процесс задачи (стадия конвейера)
+    pthread_mutex_lock(&jobs_lock);
+
+    if (job->proc_count == job->proc_capacity) {
+        int capacity = job->proc_capacity ? job->proc_capacity * 2 : 4;
+        job_process_t *procs = realloc(job->procs, capacity * sizeof(job_process_t));
+        if (procs == NULL) {
+            pthread_mutex_unlock(&jobs_lock);
+            return -1;
+        }
+        job->procs = procs;
+        job->proc_capacity = capacity;
+    }
+
+    int index = job->proc_count++;
+    job->procs[index].pid = pid;
+    job->procs[index].state = state;
+    job->procs[index].status = 0;
+    job->procs[index].pidfd = (state == JOB_DONE) ? -1 : open_pidfd(pid);
+    memset(&job->procs[index].usage, 0, sizeof(struct rusage));
+    job->live_count++;
+
+    if (job->job_id > 0) {// Задача уже в таблице - процесс сразу найдется по pid
+        pid_insert(pid, job, index);
+    }
+
+    pthread_mutex_unlock(&jobs_lock);
+    return 0;
+}
+
+
+static int allocate_job_id(void) {// Наименьший свободный номер
+    int id = free_hint;
+    while (id < table_capacity && job_table[id] != NULL) {
+        id++;
+    }
+
+    if (id >= table_capacity) {
+        int capacity = table_capacity ? table_capacity * 2 : JOB_TABLE_INITIAL;
+        while (capacity <= id) {
+            capacity *= 2;
+        }
+        job_t **table = realloc(job_table, capacity * sizeof(job_t*));
+        if (table == NULL) {
+            return -1;
+        }
+        memset(table + table_capacity, 0, (capacity - table_capacity) * sizeof(job_t*));
+        job_table = table;
+        table_capacity = capacity;
+    }
+
+    free_hint = id + 1;
+    return id;
+}
+
+
+static void remove_job_locked(job_t *job);
+
+
+int add_job(job_t *job) {
+    if (job == NULL) {
+        return -1;
+    }
+
+    if (!report_jobs) {// В скрипте о задачах не сообщаем - номера завершенных сразу свободны
+        job_notify(0);
+    }
+
+    pthread_mutex_lock(&jobs_lock);
+
+    int id = allocate_job_id();
+    if (id < 0) {
+        pthread_mutex_unlock(&jobs_lock);
+        fprintf(stderr, "Ошибка: не удалось добавить задачу\n");
+        free(job->procs);
+        free(job->command);
+        free(job);
+        return -1;
+    }
+
+    job->job_id = id;
+    job_table[id] = job;
+    table_count++;
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].state != JOB_DONE) {
+            pid_insert(job->procs[i].pid, job, i);
+        }
+    }
+
+    pthread_mutex_unlock(&jobs_lock);
+
+    if (!report_jobs) {// Скрипт не ждет ввода, и без этого зомби копились бы вместе с их pidfd.
+        event_loop_reap();// Только после вставки pid: иначе уже завершенный процесс новой задачи потерялся бы
+    }
+    return 0;
+}
+
+
+static void queue_notify(job_t *job) {// В конец очереди: сообщения выводятся в порядке событий
+    if (job->queued) {
+        return;
+    }
+    job->queued = 1;
+    job->next_notify = NULL;
+    if (notify_tail != NULL) {
+        notify_tail->next_notify = job;
     } else {
-        // Ищем конец списка и добавляем задачу
-        job_t *current = job_list;
-        while (current->next != NULL) {
-            current = current->next;
+        notify_head = job;
+    }
+    notify_tail = job;
+}
+
+
+static void queue_waited(job_t *job) {// wait разбирает очередь, не просматривая все задачи
+    job->next_waited = NULL;
+    if (waited_tail != NULL) {
+        waited_tail->next_waited = job;
+    } else {
+        waited_head = job;
+    }
+    waited_tail = job;
+}
+
+
+static job_t *take_waited(void) {
+    job_t *job = waited_head;
+    if (job != NULL) {
+        waited_head = job->next_waited;
+        if (waited_head == NULL) {
+            waited_tail = NULL;
         }
-        current->next = job;
+        job->next_waited = NULL;
     }
+    return job;
 }
 
-// Когда задача завершилась, нужно убрать её из списка, чтобы он не засорялся. Ищет задачу с нужным номером и удаляет её
-void remove_job(int job_id) {// Удаляет задачу по ID
-    job_t *current = job_list;
+
+static void unqueue_notify(job_t *job) {
     job_t *prev = NULL;
-    
-    while (current != NULL) {// Ищем задачу в списке
-        if (current->job_id == job_id) {
-            if (prev != NULL) {// Удаляем задачу из списка
-                prev->next = current->next;
+    for (job_t *current = notify_head; current != NULL; prev = current, current = current->next_notify) {
+        if (current == job) {
+            if (prev != NULL) {
+                prev->next_notify = job->next_notify;
             } else {
-                job_list = current->next;
+                notify_head = job->next_notify;
+            }
+            if (notify_tail == job) {
+                notify_tail = prev;
             }
-            free(current->command);
-            free(current);
-            return;
+            break;
         }
-        prev = current;
-        current = current->next;
     }
+    job->queued = 0;
+    job->next_notify = NULL;
 }
 
-//Когда система сообщает, что что-то случилось с процессом (группой), функция ищет какая это была задача в нашем списке
-job_t *find_job(pid_t pgid) {// Ищет задачу по ID группы процессов
-    job_t *current = job_list;
-    while (current != NULL) {
-        if (current->pgid == pgid) {
-            return current;
+
+static void remove_job_locked(job_t *job) {
+    for (int i = 0; i < job->proc_count; i++) {
+        pid_slot_t *slot = pid_lookup(job->procs[i].pid);
+        if (slot != NULL && slot->job == job) {
+            pid_remove(job->procs[i].pid);
         }
-        current = current->next;
+        close_pidfd(&job->procs[i]);
     }
-    return NULL;
+    if (job->queued) {
+        unqueue_notify(job);
+    }
+
+    job_table[job->job_id] = NULL;
+    table_count--;
+    if (job->job_id < free_hint) {
+        free_hint = job->job_id;
+    }
+
+    free(job->procs);
+    free(job->command);
+    free(job);
+}
+
+
+// Когда задача завершилась, нужно убрать её из таблицы, чтобы номер можно было переиспользовать
+void remove_job(int job_id) {// Удаляет задачу по ID
+    pthread_mutex_lock(&jobs_lock);
+    job_t *job = get_job_by_id(job_id);
+    if (job != NULL) {
+        remove_job_locked(job);
+    }
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+
+//Когда система сообщает, что что-то случилось с процессом, функция находит задачу за O(1)
+job_t *find_job(pid_t pid) {// Ищет задачу по pid любого ее процесса
+    pid_slot_t *slot = pid_lookup(pid);
+    return slot ? slot->job : NULL;
+}
+
+
+job_t *job_update_process(pid_t pid, int status, const struct rusage *usage) {// Статус из wait4 (его забирает только event_loop_reap)
+    pthread_mutex_lock(&jobs_lock);
+
+    pid_slot_t *slot = pid_lookup(pid);
+    if (slot == NULL) {
+        pthread_mutex_unlock(&jobs_lock);
+        return NULL;
+    }
+
+    job_t *job = slot->job;
+    job_process_t *proc = &job->procs[slot->proc_index];
+    job_state_t old_state = job->state;
+
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        proc->state = JOB_DONE;
+        proc->status = status;
+        if (usage != NULL) {
+            proc->usage = *usage;
+            job_usage_add(&job->usage, usage);
+        }
+        job->live_count--;
+        pid_remove(pid);// pid может достаться новому процессу
+        close_pidfd(proc);
+    } else if (WIFSTOPPED(status)) {
+        proc->state = JOB_STOPPED;
+    } else if (WIFCONTINUED(status)) {
+        proc->state = JOB_RUNNING;
+    }
+
+    if (job->live_count == 0) {
+        if (job->state != JOB_DONE) {
+            clock_gettime(CLOCK_MONOTONIC, &job->finished);
+        }
+        job->state = JOB_DONE;
+    } else {
+        job->state = JOB_STOPPED;// Задача работает, если работает хоть один процесс
+        for (int i = 0; i < job->proc_count; i++) {
+            if (job->procs[i].state == JOB_RUNNING) {
+                job->state = JOB_RUNNING;
+                break;
+            }
+        }
+    }
+
+    if (!job->foreground && job->state != old_state && job->state != JOB_RUNNING) {// О задаче переднего плана сообщает тот, кто ее ждет
+        queue_notify(job);
+    }
+    if (job->waiting && job->state == JOB_DONE && old_state != JOB_DONE) {
+        queue_waited(job);
+    }
+
+    pthread_mutex_unlock(&jobs_lock);
+    return job;
+}
+
+
+void job_notify(int print) {// Сообщения о фоновых задачах пачкой; завершенные задачи удаляются
+    pthread_mutex_lock(&jobs_lock);
+
+    while (notify_head != NULL) {
+        job_t *job = notify_head;
+        unqueue_notify(job);
+
+        if (print) {
+            printf("[%d] %s %s\n", job->job_id, job->state == JOB_DONE ? "Done" : "Stopped", job->command);
+        }
+        if (job->state == JOB_DONE) {
+            remove_job_locked(job);
+        }
+    }
+
+    pthread_mutex_unlock(&jobs_lock);
+    if (print) {
+        fflush(stdout);
+    }
+}
+
+
+void job_set_reporting(int enabled) {
+    report_jobs = enabled;
+}
+
+
+void job_control_init(void) {
+    if (!isatty(STDIN_FILENO)) {
+        return;
+    }
+    pid_t pgrp;
+    while ((pgrp = tcgetpgrp(STDIN_FILENO)) >= 0 && pgrp != getpgrp()) {// Запустили в фоне - ждем, пока дадут терминал
+        kill(-getpgrp(), SIGTTIN);
+    }
+    signal(SIGTTOU, SIG_IGN);// tcsetpgrp из своей новой группы, пока она еще не на переднем плане
+    setpgid(0, 0);
+    shell_pgid = getpgrp();
+    terminal_fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+    if (terminal_fd >= 0 && tcsetpgrp(terminal_fd, shell_pgid) == 0) {
+        job_control = 1;
+    }
+}
+
+
+int job_control_enabled(void) {
+    return job_control;
+}
+
+
+int job_terminal(void) {
+    return job_control ? terminal_fd : -1;
+}
+
+
+int job_wait(job_t *job) {// Ждет, пока у задачи не останется работающих процессов; 1 если она остановлена
+    uint64_t start = stats_now();
+    int terminal = job_control && job->foreground;
+    if (terminal) {
+        tcsetpgrp(terminal_fd, job->pgid);// Ввод с терминала, Ctrl+C и Ctrl+Z - группе задачи
+    }
+    event_loop_reap();
+    while (job->state == JOB_RUNNING) {
+        event_loop_wait_child();
+        event_loop_reap();
+    }
+    if (terminal) {
+        tcsetpgrp(terminal_fd, shell_pgid);// Задача завершилась или остановилась - терминал снова у shell
+    }
+    stats_record(STATS_WAIT, start);
+    return job->state == JOB_STOPPED;
+}
+
+
+int job_status(job_t *job) {// Код возврата задачи - код ее последнего процесса
+    if (job->proc_count == 0) {
+        return 0;
+    }
+
+    int status = job->procs[job->proc_count - 1].status;
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return 0;
 }
 
+
 // Меняет статус задачи. Например, если процесс остановился (Ctrl+Z), меняет "Running" на "Stopped"
 void update_job_status(pid_t pgid, job_state_t state) {
     job_t *job = find_job(pgid);
@@ -80,15 +575,152 @@ void update_job_status(pid_t pgid, job_state_t state) {
     }
 }
 
-void print_jobs(void) {// Выводит список всех задачю Выводит на экран все запущенные и остановленные задачи с их номерами и статусами
-    job_t *current = job_list;
+
+//Когда вы пишете fg 2, эта функция находит задачу номер 2 сразу по индексу
+job_t *get_job_by_id(int job_id) {//Ищет задачу по её номеру
+    if (job_id <= 0 || job_id >= table_capacity) {
+        return NULL;
+    }
+    return job_table[job_id];
+}
+
+
+int job_count(void) {
+    return table_count;
+}
+
+
+void job_usage_add(struct rusage *total, const struct rusage *usage) {
+    timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+    if (usage->ru_maxrss > total->ru_maxrss) {// Процессы конвейера работают одновременно - пик не сумма, а максимум
+        total->ru_maxrss = usage->ru_maxrss;
+    }
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+}
+
+
+double job_wall_time(const job_t *job) {
+    struct timespec end = job->finished;
+    if (job->state != JOB_DONE) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+    }
+    return (end.tv_sec - job->started.tv_sec) + (end.tv_nsec - job->started.tv_nsec) / 1e9;
+}
+
+
+double timeval_seconds(const struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+
+void print_duration(builtin_io_t *io, double seconds) {
+    if (seconds < 0) {
+        seconds = 0;
+    }
+    long minutes = (long)(seconds / 60);
+    bio_printf(io, "%ldm%.3fs", minutes, seconds - minutes * 60);
+}
+
+
+void print_usage(builtin_io_t *io, double real, const struct rusage *usage) {// Формат time из bash плюс память и переключения контекста
+    bio_puts(io, "\nreal\t");
+    print_duration(io, real);
+    bio_puts(io, "\nuser\t");
+    print_duration(io, timeval_seconds(&usage->ru_utime));
+    bio_puts(io, "\nsys\t");
+    print_duration(io, timeval_seconds(&usage->ru_stime));
+    bio_printf(io, "\nmaxrss\t%ldK\nctxsw\t%ld/%ld\n", usage->ru_maxrss, usage->ru_nvcsw, usage->ru_nivcsw);
+}
+
+
+void job_forget_all(void) {// Память родительских задач не освобождаем - копия живет недолго
+    pthread_mutex_init(&jobs_lock, NULL);// Мьютекс мог быть захвачен потоком jobs в момент fork
+    job_table = NULL;
+    table_capacity = 0;
+    table_count = 0;
+    free_hint = 1;
+    pid_slots = NULL;
+    pid_capacity = 0;
+    pid_used = 0;
+    notify_head = NULL;
+    notify_tail = NULL;
+    waited_head = NULL;
+    waited_tail = NULL;
+    wait_set = -1;
+    pidfd_open_count = 0;
+    job_control = 0;// Команды копии остаются в ее группе, терминалом она не распоряжается
+}
+
+
+static int signal_job(job_t *job, int sig) {// Сигнал всей группе задачи; -1 и ESRCH, если живых процессов нет
+    event_loop_reap();// Процесс, чей статус забран, уже не держит pgid
+
+    int pidfd = -1;
+    int alive = 0;
+    pthread_mutex_lock(&jobs_lock);
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].state != JOB_DONE) {
+            alive = 1;
+            pidfd = job->procs[i].pidfd;
+            if (pidfd >= 0) {
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&jobs_lock);
+
+    if (!alive) {
+        errno = ESRCH;
+        return -1;
+    }
+    if (!job_control) {// Процессы в группе самого shell - сигнал каждому по отдельности
+        int sent = -1;
+        pthread_mutex_lock(&jobs_lock);
+        for (int i = 0; i < job->proc_count; i++) {
+            if (job->procs[i].state != JOB_DONE && kill(job->procs[i].pid, sig) == 0) {
+                sent = 0;
+            }
+        }
+        pthread_mutex_unlock(&jobs_lock);
+        return sent;
+    }
+    if (pidfd >= 0 && pidfd_signal(pidfd, sig, PIDFD_SIGNAL_PROCESS_GROUP) == 0) {// Группа берется у процесса по pidfd, а не по номеру
+        return 0;
+    }
+    return kill(-job->pgid, sig);// Старое ядро: номер группы занят незабранным процессом задачи и не переиспользован
+}
+
+
+static void continue_job(job_t *job) {// SIGCONT всей группе, процессы снова считаются работающими
+    pthread_mutex_lock(&jobs_lock);
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].state == JOB_STOPPED) {
+            job->procs[i].state = JOB_RUNNING;
+        }
+    }
+    job->state = JOB_RUNNING;
+    pthread_mutex_unlock(&jobs_lock);
+    signal_job(job, SIGCONT);
+}
+
+
+void print_jobs(builtin_io_t *io, int verbose) {// Выводит список всех задачю Выводит на экран все запущенные и остановленные задачи с их номерами и статусами
+    pthread_mutex_lock(&jobs_lock);
     
-    if (current == NULL) {
-        printf("Нет активных задач\n");
+    if (table_count == 0) {
+        pthread_mutex_unlock(&jobs_lock);
+        bio_puts(io, "Нет активных задач\n");
         return;
     }
     
-    while (current != NULL) {
+    for (int id = 1; id < table_capacity; id++) {// Таблица упорядочена по номеру задачи
+        job_t *current = job_table[id];
+        if (current == NULL || current->foreground) {// Задача переднего плана - это и есть текущая команда
+            continue;
+        }
+        
         const char *state_str;
         switch (current->state) {
             case JOB_RUNNING:
@@ -104,124 +736,289 @@ void print_jobs(void) {// Выводит список всех задачю Вы
                 state_str = "Unknown";
         }
         
-        printf("[%d] %d %s %s\n", 
-               current->job_id, current->pgid, state_str, current->command);
-        current = current->next;
-    }
-}
-
-//Когда вы пишете fg 2, эта функция находит задачу номер 2 в списке
-job_t *get_job_by_id(int job_id) {//Ищет задачу по её номеру
-    job_t *current = job_list;
-    while (current != NULL) {
-        if (current->job_id == job_id) {
-            return current;
+        if (!verbose) {
+            bio_printf(io, "[%d] %d %s %s\n", 
+                   current->job_id, current->pgid, state_str, current->command);
+            continue;
         }
-        current = current->next;
-    }
-    return NULL;
-}
 
-
-void sigchld_handler(int sig) {//Обрабатывает сигналы от дочерних процессов
-    (void)sig;
-    
-    int status;
-    pid_t pid;
-    
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0) {// Проверяем все завершившиеся процессы
-        job_t *job = find_job(pid);
-        if (job != NULL) {
-            if (WIFEXITED(status) || WIFSIGNALED(status)) {
-                
-                job->state = JOB_DONE;// Процесс завершился
-                printf("\n[%d] Done %s\n", job->job_id, job->command);
-            } else if (WIFSTOPPED(status)) {
-                
-                job->state = JOB_STOPPED;// помечает как Процесс остановлен
-                printf("\n[%d] Stopped %s\n", job->job_id, job->command);
-            }
-        }
+        bio_printf(io, "[%d] %d %s real ", current->job_id, current->pgid, state_str);// Ресурсы - только уже завершившихся процессов задачи
+        print_duration(io, job_wall_time(current));
+        bio_puts(io, " user ");
+        print_duration(io, timeval_seconds(&current->usage.ru_utime));
+        bio_puts(io, " sys ");
+        print_duration(io, timeval_seconds(&current->usage.ru_stime));
+        bio_printf(io, " maxrss %ldK ctxsw %ld/%ld %s\n", current->usage.ru_maxrss,
+               current->usage.ru_nvcsw, current->usage.ru_nivcsw, current->command);
     }
+    
+    pthread_mutex_unlock(&jobs_lock);
 }
 
 //встроенные команды
 
-int builtin_jobs(char **argv) {//jobs - вывод списка задач
-    (void)argv;
-    print_jobs();//Когда вводим jobs в shell, вызывается эта функция, которая просто вызывает print_jobs()
+static int parse_job_id(const char *arg) {// Номер задачи: "2" или "%2"
+    return atoi(arg[0] == '%' ? arg + 1 : arg);
+}
+
+int builtin_jobs(char **argv, builtin_io_t *io) {//jobs [-v] - вывод списка задач
+    int verbose = (argv[1] != NULL && strcmp(argv[1], "-v") == 0);
+    print_jobs(io, verbose);//Когда вводим jobs в shell, вызывается эта функция, которая просто вызывает print_jobs()
     return 0;
 }
 
-int builtin_fg(char **argv) {//fg - перевод задачи на передний план
+int builtin_fg(char **argv, builtin_io_t *io) {//fg - перевод задачи на передний план
     if (argv[1] == NULL) {
-        fprintf(stderr, "fg: использование: fg <job_id>\n");
+        bio_error(io, "fg: использование: fg <job_id>\n");
         return 1;
     }
     
-    int job_id = atoi(argv[1]);
+    int job_id = parse_job_id(argv[1]);
     job_t *job = get_job_by_id(job_id);
-    if (job == NULL) {
-        fprintf(stderr, "fg: задача не найдена: %d\n", job_id);
+    if (job == NULL || job->state == JOB_DONE) {
+        bio_error(io, "fg: задача не найдена: %d\n", job_id);
         return 1;
     }
     
     // Переводим задачу на передний план
-    tcsetpgrp(STDIN_FILENO, job->pgid);
-    kill(-job->pgid, SIGCONT);
-    job->state = JOB_RUNNING;
-    
-    // Ждем завершения
-    int status;
-    waitpid(job->pgid, &status, WUNTRACED);
+    job->foreground = 1;
+    if (job_control) {
+        tcsetpgrp(terminal_fd, job->pgid);// До SIGCONT: иначе задача, читающая терминал, сразу получит SIGTTIN
+    }
+    continue_job(job);
     
-    // Возвращаем управление shell
-    tcsetpgrp(STDIN_FILENO, getpgrp());
+    int stopped = job_wait(job);// Ждем, пока задача не завершится или снова не остановится; терминал вернет job_wait
+    job->foreground = 0;
     
-    if (WIFEXITED(status) || WIFSIGNALED(status)) {
-        remove_job(job_id);
-    } 
+    if (stopped) {
+        bio_printf(io, "\n[%d] Stopped %s\n", job_id, job->command);
+        return 0;
+    }
     
-    return 0;
+    int status = job_status(job);
+    remove_job(job_id);
+    return status;
 }
 
 
-int builtin_bg(char **argv) {//bg - продолжение задачи в фоне
+int builtin_bg(char **argv, builtin_io_t *io) {//bg - продолжение задачи в фоне
     if (argv[1] == NULL) {
-        fprintf(stderr, "bg: использование: bg <job_id>\n");
+        bio_error(io, "bg: использование: bg <job_id>\n");
         return 1;
     }
     
-    int job_id = atoi(argv[1]);
+    int job_id = parse_job_id(argv[1]);
     job_t *job = get_job_by_id(job_id);
     if (job == NULL) {
-        fprintf(stderr, "bg: задача не найдена: %d\n", job_id);
+        bio_error(io, "bg: задача не найдена: %d\n", job_id);
         return 1;
     }
     
     
-    kill(-job->pgid, SIGCONT);// Продолжаем выполнение задачи
-    job->state = JOB_RUNNING;
-    printf("[%d] %s\n", job_id, job->command);
+    continue_job(job);// Продолжаем выполнение задачи
+    bio_printf(io, "[%d] %s\n", job_id, job->command);
     
     return 0;
 }
 
 
-int builtin_kill(char **argv) {//Команда kill - завершение задачи
+int builtin_kill(char **argv, builtin_io_t *io) {//Команда kill - завершение задачи
     if (argv[1] == NULL) {
-        fprintf(stderr, "kill: использование: kill <job_id>\n");
+        bio_error(io, "kill: использование: kill <job_id>\n");
         return 1;
     }
     
-    int job_id = atoi(argv[1]);
+    int job_id = parse_job_id(argv[1]);
     job_t *job = get_job_by_id(job_id);
     if (job == NULL) {
-        fprintf(stderr, "kill: задача не найдена: %d\n", job_id);
+        bio_error(io, "kill: задача не найдена: %d\n", job_id);
         return 1;
     }
 
-    kill(-job->pgid, SIGTERM);
-    printf("Сигнал TERM отправлен задаче [%d]\n", job_id);
+    if (signal_job(job, SIGTERM) < 0) {
+        bio_perror(io, "kill");
+        return 1;
+    }
+    if (job->state == JOB_STOPPED) {
+        signal_job(job, SIGCONT);// Остановленный процесс получит TERM только после продолжения
+    }
+    bio_printf(io, "Сигнал TERM отправлен задаче [%d]\n", job_id);
     return 0;
 }
+
+
+static job_t *find_wait_target(const char *arg) {// "%2" - задача, число - pid одного из ее процессов
+    if (arg[0] == '%') {
+        return get_job_by_id(atoi(arg + 1));
+    }
+
+    pid_t pid = atoi(arg);
+    if (pid <= 0) {
+        return NULL;
+    }
+    job_t *job = find_job(pid);
+    if (job != NULL) {
+        return job;
+    }
+    for (int id = 1; id < table_capacity; id++) {// Процесс уже завершился и убран из хэша
+        job = job_table[id];
+        for (int i = 0; job != NULL && i < job->proc_count; i++) {
+            if (job->procs[i].pid == pid) {
+                return job;
+            }
+        }
+    }
+    return NULL;
+}
+
+
+static int watch_job(job_t *job) {// Добавляет pidfd процессов задачи в набор wait; 1 если для какого-то pidfd нет
+    int need_signals = 0;
+    for (int i = 0; i < job->proc_count; i++) {
+        job_process_t *proc = &job->procs[i];
+        if (proc->state == JOB_DONE) {
+            continue;
+        }
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;// pidfd становится читаемым, когда процесс завершился
+        event.data.fd = proc->pidfd;
+        if (proc->pidfd < 0 || epoll_ctl(wait_set, EPOLL_CTL_ADD, proc->pidfd, &event) < 0) {
+            need_signals = 1;
+        }
+    }
+    return need_signals;
+}
+
+
+int builtin_wait(char **argv, builtin_io_t *io) {// wait [-n] [%задача | pid ...]
+    int any = 0;// -n: дождаться первой завершившейся
+    int first = 1;
+    if (argv[1] != NULL && strcmp(argv[1], "-n") == 0) {
+        any = 1;
+        first = 2;
+    }
+
+    event_loop_reap();
+
+    int capacity = 0;
+    for (int i = first; argv[i] != NULL; i++) {
+        capacity++;
+    }
+    if (argv[first] == NULL) {
+        capacity = table_count;
+    }
+    job_t **targets = malloc((capacity + 1) * sizeof(job_t*));
+    if (targets == NULL) {
+        bio_perror(io, "wait");
+        return 1;
+    }
+
+    int status = 0;
+    int count = 0;
+    pthread_mutex_lock(&jobs_lock);
+    if (argv[first] == NULL) {// Все фоновые задачи; остановленные не ждем - они не завершатся сами
+        for (int id = 1; id < table_capacity; id++) {
+            job_t *job = job_table[id];
+            if (job != NULL && !job->foreground && job->state != JOB_STOPPED) {
+                targets[count++] = job;
+                job->waiting = 1;
+            }
+        }
+    } else {
+        for (int i = first; argv[i] != NULL; i++) {
+            job_t *job = find_wait_target(argv[i]);
+            if (job == NULL || job->foreground) {
+                bio_error(io, "wait: %s: нет такой задачи\n", argv[i]);
+                status = 127;
+                continue;
+            }
+            if (!job->waiting) {
+                targets[count++] = job;
+                job->waiting = 1;
+            }
+        }
+    }
+
+    wait_set = epoll_create1(EPOLL_CLOEXEC);
+    int need_signals = (wait_set < 0);
+    for (int i = 0; i < count; i++) {
+        if (targets[i]->state == JOB_DONE) {// Завершилась раньше - о ней еще не сообщали
+            queue_waited(targets[i]);
+            continue;
+        }
+        if (wait_set >= 0 && watch_job(targets[i])) {
+            need_signals = 1;
+        }
+    }
+    pthread_mutex_unlock(&jobs_lock);
+
+    if (wait_set >= 0 && need_signals) {// Процессы без pidfd будят нас через SIGCHLD
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = event_loop_signal_fd();
+        if (event.data.fd < 0 || epoll_ctl(wait_set, EPOLL_CTL_ADD, event.data.fd, &event) < 0) {
+            close(wait_set);
+            wait_set = -1;
+        }
+    }
+
+    job_t *finished = NULL;// Первая завершившаяся задача (для -n)
+    int remaining = count;
+    while (remaining > 0) {
+        pthread_mutex_lock(&jobs_lock);
+        job_t *job;
+        while ((job = take_waited()) != NULL) {// Разбираем только готовые задачи, а не всю таблицу
+            remaining--;
+            if (finished == NULL) {
+                finished = job;
+            }
+            if (any) {
+                break;
+            }
+        }
+        pthread_mutex_unlock(&jobs_lock);
+
+        if (remaining == 0 || (any && finished != NULL)) {
+            break;
+        }
+        if (event_loop_wait_set(wait_set) < 0) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&jobs_lock);
+    while (take_waited() != NULL) {// При -n остальные завершившиеся задачи сообщат о себе как обычно
+    }
+    for (int i = 0; i < count; i++) {
+        targets[i]->waiting = 0;
+    }
+    pthread_mutex_unlock(&jobs_lock);
+    if (wait_set >= 0) {
+        close(wait_set);
+        wait_set = -1;
+    }
+
+    if (any) {
+        if (finished != NULL) {
+            status = job_status(finished);
+            remove_job(finished->job_id);// Дождались - сообщение "Done" не нужно
+        } else if (count == 0) {
+            status = 127;
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            if (targets[i]->state != JOB_DONE) {// Ожидание прервалось ошибкой epoll
+                continue;
+            }
+            if (argv[first] != NULL && status != 127) {
+                status = job_status(targets[i]);// Код последней из перечисленных задач
+            }
+            remove_job(targets[i]->job_id);
+        }
+    }
+
+    free(targets);
+    return status;
+}
@@ -0,0 +1,189 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include "launch.h"
+#include "stats.h"
+
+extern char **environ;
+
+static const int default_signals[] = {// Сигналы, которые shell игнорирует или перехватывает
+    SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU, SIGCHLD, SIGPIPE
+};
+
+static int use_fork = -1;// MYSHELL_SPAWN=fork принудительно включает старый путь через fork
+
+
+void spawn_options_init(spawn_options_t *options) {
+    options->fds[0] = -1;
+    options->fds[1] = -1;
+    options->fds[2] = -1;
+    options->pgid = 0;
+    options->tty_fd = -1;
+    options->envp = NULL;
+}
+
+
+void spawn_reset_signals(void) {// Восстанавливаем стандартные обработчики сигналов в дочернем процессе
+    sigset_t empty;
+
+    for (size_t i = 0; i < sizeof(default_signals) / sizeof(default_signals[0]); i++) {
+        signal(default_signals[i], SIG_DFL);
+    }
+
+    sigemptyset(&empty);// Родитель может блокировать SIGCHLD на время ожидания
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+}
+
+
+void spawn_exec(const char *path, char **argv, char **envp) {
+    if (envp == NULL) {
+        envp = environ;
+    }
+    execve(path, argv, envp);
+
+    if (errno == ENOEXEC) {// Скрипт без #! - запускаем через /bin/sh, как это делает execvp
+        int argc = 0;
+        while (argv[argc] != NULL) {
+            argc++;
+        }
+        char **sh_argv = malloc((argc + 2) * sizeof(char *));
+        if (sh_argv != NULL) {
+            sh_argv[0] = "/bin/sh";
+            sh_argv[1] = (char *)path;
+            memcpy(sh_argv + 2, argv + 1, argc * sizeof(char *));
+            execve("/bin/sh", sh_argv, envp);
+            free(sh_argv);
+            errno = ENOEXEC;
+        }
+    }
+}
+
+
+static int fork_process(const char *path, char **argv, const spawn_options_t *options, pid_t *pid_out) {// Запасной путь через fork
+    int report[2];// Канал с O_CLOEXEC: закрылся без данных - exec прошел успешно
+    if (pipe2(report, O_CLOEXEC) == -1) {
+        return errno;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        int err = errno;
+        close(report[0]);
+        close(report[1]);
+        return err;
+    }
+
+    if (pid == 0) {
+        close(report[0]);
+        if (options->pgid >= 0) {
+            setpgid(0, options->pgid);
+            if (options->tty_fd >= 0) {
+                tcsetpgrp(options->tty_fd, getpgrp());// SIGTTOU еще игнорируется, как в shell
+            }
+        }
+        spawn_reset_signals();
+
+        for (int i = 0; i < 3; i++) {
+            if (options->fds[i] >= 0 && options->fds[i] != i) {
+                dup2(options->fds[i], i);
+            }
+        }
+
+        spawn_exec(path, argv, options->envp);
+
+        int err = errno;
+        if (write(report[1], &err, sizeof(err)) < 0) {
+            _exit(127);
+        }
+        _exit(127);
+    }
+
+    close(report[1]);
+    if (options->pgid >= 0) {
+        setpgid(pid, options->pgid ? options->pgid : pid);// Дублируем в родителе, чтобы не было гонки с exec
+    }
+
+    int err = 0;
+    ssize_t n;
+    do {
+        n = read(report[0], &err, sizeof(err));
+    } while (n < 0 && errno == EINTR);
+    close(report[0]);
+
+    if (n == sizeof(err) && err != 0) {// exec не удался - забираем ребенка сами
+        waitpid(pid, NULL, 0);
+        return err;
+    }
+
+    *pid_out = pid;
+    return 0;
+}
+
+
+static int posix_spawn_process(const char *path, char **argv, const spawn_options_t *options, pid_t *pid_out) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t defaults, empty;
+
+    posix_spawn_file_actions_init(&actions);
+    for (int i = 0; i < 3; i++) {// Перенаправления и пайпы - как действия над дескрипторами
+        if (options->fds[i] >= 0 && options->fds[i] != i) {
+            posix_spawn_file_actions_adddup2(&actions, options->fds[i], i);
+        }
+    }
+
+    posix_spawnattr_init(&attr);
+    sigemptyset(&defaults);
+    for (size_t i = 0; i < sizeof(default_signals) / sizeof(default_signals[0]); i++) {
+        sigaddset(&defaults, default_signals[i]);
+    }
+    sigemptyset(&empty);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    if (options->pgid >= 0) {
+        posix_spawnattr_setpgroup(&attr, options->pgid);
+        flags |= POSIX_SPAWN_SETPGROUP;
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+        if (options->tty_fd >= 0) {
+            posix_spawn_file_actions_addtcsetpgrp_np(&actions, options->tty_fd);// Терминал - группе ребенка до exec
+        }
+#endif
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    pid_t pid;
+    int err = posix_spawn(&pid, path, &actions, &attr, argv, options->envp ? options->envp : environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (err == ENOEXEC) {// posix_spawn не запускает скрипты без #! - это умеет fork-путь
+        return fork_process(path, argv, options, pid_out);
+    }
+    if (err == 0) {
+        *pid_out = pid;
+    }
+    return err;
+}
+
+
+int spawn_process(const char *path, char **argv, const spawn_options_t *options, pid_t *pid_out) {
+    if (use_fork < 0) {
+        const char *mode = getenv("MYSHELL_SPAWN");
+        use_fork = (mode != NULL && strcmp(mode, "fork") == 0);
+    }
+
+    uint64_t start = stats_now();
+    int err = use_fork ? fork_process(path, argv, options, pid_out)
+                       : posix_spawn_process(path, argv, options, pid_out);
+    stats_record(STATS_SPAWN, start);// Для fork-пути - до успешного exec ребенка
+    return err;
+}
@@ -3,59 +3,65 @@
 #include <ctype.h>
 #include <stdio.h>
 #include "lexer.h"
+#include "arena.h"
+
+#define LEXER_INITIAL_TOKENS 16
 
 lexer_t *lexer_create(const char *input) {
-    lexer_t *lexer = (lexer_t*)malloc(sizeof(lexer_t));
+    return lexer_create_len(input, strlen(input));
+}
+
+lexer_t *lexer_create_len(const char *input, size_t length) {// Ввод может не заканчиваться нулем (файл через mmap)
+    arena_t *arena = arena_create(ARENA_DEFAULT_BLOCK);// Вся память строки (токены, AST, argv) берется из арены
+    if (arena == NULL) {
+        return NULL;
+    }
+    
+    lexer_t *lexer = (lexer_t*)arena_alloc(arena, sizeof(lexer_t));
     if (lexer == NULL) {
+        arena_destroy(arena);
         return NULL;
     }
     
+    lexer->arena = arena;
     lexer->input = input;
     lexer->position = 0;
-    lexer->length = strlen(input);
+    lexer->length = (int)length;
+    lexer->buffer = NULL;
     lexer->tokens = NULL;
-    lexer->current_token = NULL;
+    lexer->token_count = 0;
+    lexer->token_capacity = 0;
+    lexer->current = 0;
     
     return lexer;
 }
 
-void lexer_destroy(lexer_t *lexer) {
+void lexer_destroy(lexer_t *lexer) {// Токены, AST и сам лексер лежат в арене - освобождаем одним вызовом
     if (lexer == NULL) return;
 
-    token_t *token = lexer->tokens;
-    while (token != NULL) {
-        token_t *next = token->next;
-        if (token->value != NULL) {
-            free(token->value);
-        }
-        free(token);
-        token = next;
-    }
-    
-    free(lexer);
+    arena_destroy(lexer->arena);
 }
 
-static void add_token(lexer_t *lexer, token_type_t type, char *value) {
-    token_t *new_token = (token_t*)malloc(sizeof(token_t));
-    if (new_token == NULL) {
-        return;
-    }
-    
-    new_token->type = type;
-    new_token->value = value;
-    new_token->next = NULL;
-    
-    if (lexer->tokens == NULL) {
-        lexer->tokens = new_token;
-        lexer->current_token = new_token;
-        return;
+static int add_token(lexer_t *lexer, token_type_t type, const char *value, int length) {// Добавление в конец массива за O(1)
+    if (lexer->token_count == lexer->token_capacity) {// Массив удваивается, старый остается в арене до конца строки
+        int capacity = lexer->token_capacity ? lexer->token_capacity * 2 : LEXER_INITIAL_TOKENS;
+        token_t *tokens = (token_t*)arena_alloc(lexer->arena, capacity * sizeof(token_t));
+        if (tokens == NULL) {
+            return -1;
+        }
+        if (lexer->token_count > 0) {
+            memcpy(tokens, lexer->tokens, lexer->token_count * sizeof(token_t));
+        }
+        lexer->tokens = tokens;
+        lexer->token_capacity = capacity;
     }
     
-    token_t *current = lexer->tokens;
-    while (current->next != NULL) {
-        current = current->next;
-    }
-    current->next = new_token;
+    token_t *token = &lexer->tokens[lexer->token_count++];
+    token->type = type;
+    token->value = value;
+    token->length = length;
+    token->flags = 0;
+    return 0;
 }
 
 int is_special_char(char c) {
@@ -73,214 +79,328 @@ int is_special_char(char c) {
     }
 }
 
+static int is_separator(token_type_t type) {// После этих токенов перевод строки ничего не добавляет (cmd && \n cmd2)
+    switch (type) {
+        case TOKEN_SEMICOLON:
+        case TOKEN_AND:
+        case TOKEN_OR:
+        case TOKEN_PIPE:
+        case TOKEN_BACKGROUND:
+        case TOKEN_LPAREN:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
 int is_whitespace(char c) {
     return c == ' ' || c == '\t' || c == '\n' || c == '\r';
 }
 
-char *handle_quotes(lexer_t *lexer, char quote_type) {
-    int start_pos = lexer->position + 1;
-    int len = 0;
-    
-    lexer->position++;
-    
-    while (lexer->position < lexer->length) {
-        char current = lexer->input[lexer->position];
-        
-        if (current == quote_type) {
-            break;
+int is_expansion_start(char c) {// Что после $ начинает подстановку: имя, ${, $(, $? $$ $! или цифра
+    return isalpha((unsigned char)c) || isdigit((unsigned char)c) || c == '_' ||
+           c == '{' || c == '(' || c == '?' || c == '$' || c == '!';
+}
+
+// Конец ${...}: pos указывает на '{'. Внутри могут быть пробелы, кавычки и вложенные ${}.
+// -1 - скобка не закрыта
+static int skip_braces(const char *buf, int pos, int length) {
+    int depth = 0;
+    char quote = 0;
+    while (pos < length) {
+        char c = buf[pos];
+        if (c == '\\' && quote != '\'') {
+            pos += 2;
+            continue;
         }
-        
-        if (quote_type == '"' && current == '\\') {
-            lexer->position++;
-            if (lexer->position < lexer->length) {
-                len++;
-                lexer->position++;
+        if (quote != 0) {
+            if (c == quote) {
+                quote = 0;
             }
-        } else {
-            len++;
-            lexer->position++;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}' && --depth == 0) {
+            return pos + 1;
         }
+        pos++;
     }
-    
-    if (lexer->position >= lexer->length || lexer->input[lexer->position] != quote_type) {
-        fprintf(stderr, "Ошибка: Незакрытая кавычка\n");
-        return NULL;
-    }
-    
-    char *result = (char*)malloc(len + 1);
-    if (result == NULL) {
-        return NULL;
+    return -1;
+}
+
+// Конец подстановки команды: pos указывает на ( после $ или на открывающую `.
+// Скобки в $(...) считаются с вложенностью, кавычки и \ пропускаются - ")" в кавычках команду не закрывает
+int skip_command(const char *buf, int pos, int length) {
+    if (buf[pos] == '`') {
+        for (pos++; pos < length; pos++) {
+            if (buf[pos] == '\\') {
+                pos++;
+            } else if (buf[pos] == '`') {
+                return pos + 1;
+            }
+        }
+        return -1;
     }
-    
-    int src_pos = start_pos;
-    int dst_pos = 0;
-    
-    // Копируем с обработкой экранирования для двойных кавычек
-    while (src_pos < lexer->position && dst_pos < len) {
-        if (quote_type == '"' && lexer->input[src_pos] == '\\') {
-            src_pos++; // Пропускаем обратный слеш
-            if (src_pos < lexer->position) {
-                result[dst_pos++] = lexer->input[src_pos++];
+
+    int depth = 0;
+    char quote = 0;
+    while (pos < length) {
+        char c = buf[pos];
+        if (c == '\\' && quote != '\'') {
+            pos += 2;
+            continue;
+        }
+        if (quote != 0) {
+            if (c == quote) {
+                quote = 0;
             }
-        } else {
-            result[dst_pos++] = lexer->input[src_pos++];
+        } else if (c == '\'' || c == '"' || c == '`') {
+            quote = c;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && --depth == 0) {
+            return pos + 1;
         }
+        pos++;
     }
-    
-    result[dst_pos] = '\0';
-    
-    lexer->position++; // Пропускаем закрывающую кавычку
-    
-    return result;
+    return -1;
 }
 
-char *handle_word(lexer_t *lexer) {
-    int start_pos = lexer->position;
-    int end_pos = lexer->position;
-    
-    while (end_pos < lexer->length) {
-        char current = lexer->input[end_pos];
-        
-        // Останавливаемся на пробелах, спецсимволах или кавычках
-        if (is_whitespace(current) || is_special_char(current) || 
-            current == '\'' || current == '"') {
+// Границы слова в исходном тексте и нужно ли его раскрывать (WORD_*). Только смотрит, ничего не пишет.
+// Возвращает конец слова, -2 при незакрытой кавычке, -3 при незакрытой ${, -4 при незакрытой $( или `
+static int find_word_end(const char *buf, int pos, int length, int *flags) {
+    char quote = 0;
+    int bracket = 0;// Был [ вне кавычек: шаблоном слово станет только с ] после него ([ -f x ] - не шаблон)
+    int braces = 0;// Открытые { вне кавычек
+    int brace_list = 0;// Внутри них была , или .. - иначе {} (find -exec) остается словом
+    while (pos < length) {
+        char c = buf[pos];
+        if (quote == 0 && (is_whitespace(c) || is_special_char(c))) {
             break;
         }
-        
-        if (current == '\\') { // Обработка экранирования
-            end_pos++; // Пропускаем обратный слеш
-            if (end_pos < lexer->length) {
-                end_pos++; // Учитываем экранированный символ
+        if (quote == '\'') {
+            if (c == '\'') {
+                quote = 0;
+            }
+            pos++;
+        } else if (c == '\\') {
+            pos += 2;
+        } else if (c == '\'' || c == '"') {
+            if (quote == 0) {
+                quote = c;
+            } else if (c == quote) {
+                quote = 0;
+            }
+            pos++;
+        } else if (c == '$' && pos + 1 < length && is_expansion_start(buf[pos + 1])) {
+            *flags |= WORD_EXPAND;
+            if (buf[pos + 1] == '{') {
+                pos = skip_braces(buf, pos + 1, length);
+                if (pos < 0) {
+                    return -3;
+                }
+            } else if (buf[pos + 1] == '(') {
+                *flags |= WORD_SUBST;
+                pos = skip_command(buf, pos + 1, length);
+                if (pos < 0) {
+                    return -4;
+                }
+            } else {
+                pos += 2;
+            }
+        } else if (c == '`') {// В двойных кавычках тоже подстановка
+            *flags |= WORD_EXPAND | WORD_SUBST;
+            pos = skip_command(buf, pos, length);
+            if (pos < 0) {
+                return -4;
+            }
+        } else {
+            if (quote == 0 && (c == '*' || c == '?' || (c == ']' && bracket))) {
+                *flags |= WORD_GLOB;
+            }
+            bracket |= (quote == 0 && c == '[');
+            if (quote == 0 && c == '{') {
+                braces++;
+            } else if (quote == 0 && braces > 0 && (c == ',' || (c == '.' && pos + 1 < length && buf[pos + 1] == '.'))) {
+                brace_list = 1;
+            } else if (quote == 0 && c == '}' && braces > 0) {
+                braces--;
+                if (brace_list) {
+                    *flags |= WORD_BRACE;
+                }
+            }
+            pos++;
+        }
+    }
+    if (quote != 0) {
+        return -2;
+    }
+    return pos < length ? pos : length;
+}
+
+// Следующая команда верхнего уровня в тексте скрипта: пустые строки и комментарии
+// пропускаются, *start - начало команды, *end - позиция после перевода строки,
+// которым она кончается. Перевод строки внутри кавычек, $(...), скобок, после
+// \ и после && || | команду не заканчивает. *start == length - команд больше нет.
+// Возвращает 1 если команда закончена переводом строки, 0 - текст кончился раньше
+// (из пайпа нужно дочитать, в конце файла - выполнить как есть)
+int lexer_next_command(const char *buf, size_t length, size_t *start, size_t *end) {
+    size_t pos = *start;
+    while (pos < length && (is_whitespace(buf[pos]) || buf[pos] == '#')) {
+        if (buf[pos] == '#') {
+            while (pos < length && buf[pos] != '\n') {
+                pos++;
             }
         } else {
-            end_pos++;
+            pos++;
         }
     }
-    
-    int actual_len = 0;
-    
-    int temp_pos = start_pos;// Подсчитываем фактическую длину (без символов экранирования)
-    while (temp_pos < end_pos) {
-        if (lexer->input[temp_pos] == '\\') {
-            temp_pos++; // Пропускаем обратный слеш
-            if (temp_pos < end_pos) {
-                actual_len++;
-                temp_pos++;
+    *start = pos;
+
+    int depth = 0;// Открытые ( подсекций
+    int continued = 0;// Последним был && || | или |& - команда продолжается на следующей строке
+    while (pos < length) {
+        char c = buf[pos];
+        char next = (pos + 1 < length) ? buf[pos + 1] : '\0';
+        if (c == '\n') {
+            pos++;
+            if (depth == 0 && !continued) {
+                *end = pos;
+                return 1;
+            }
+        } else if (is_whitespace(c)) {
+            pos++;
+        } else if (c == '#') {
+            while (pos < length && buf[pos] != '\n') {
+                pos++;
+            }
+        } else if (c == '|' || c == '&') {
+            continued = (c == '|' || next == '&');// & (фон) и &> команду не продолжают
+            pos += (next == '&' || (c == '|' && next == '|')) ? 2 : 1;
+        } else if (is_special_char(c)) {
+            if (c == '(') {
+                depth++;
+            } else if (c == ')' && depth > 0) {
+                depth--;
             }
+            continued = 0;
+            pos++;
         } else {
-            actual_len++;
-            temp_pos++;
+            int flags = 0;
+            int word_end = find_word_end(buf, (int)pos, (int)length, &flags);
+            if (word_end < 0) {
+                break;// Незакрытая кавычка - до конца текста, ошибку сообщит лексер
+            }
+            pos = word_end;
+            continued = 0;
         }
     }
+    *end = length;
+    return 0;
+}
+
+// Разбирает слово (может содержать кавычки и экранирование) прямо в буфере лексера.
+// Результат никогда не длиннее исходного текста, поэтому байты пишутся на место:
+// обычное слово не копируется вовсе, слово с кавычками сжимается внутри своего же диапазона.
+// Слово с $ или шаблоном остается как есть вместе с кавычками - их снимет раскрытие
+// (expand.c), которому нужно знать, что стояло в кавычках: "$x" и "*" не раскрываются.
+// Возвращает длину слова, -1 если слова нет, -2 при незакрытой кавычке, -3 при незакрытой ${, -4 при незакрытой $( или `
+int scan_word(lexer_t *lexer, int *flags) {
+    char *buf = lexer->buffer;
+    int pos = lexer->position;
+    int dst = pos;
+    int quoted = 0;// Было ли в слове "" или '' - тогда пустое слово тоже слово
     
-    if (actual_len == 0) {
-        lexer->position = end_pos;
-        return NULL;
+    *flags = 0;
+    int end = find_word_end(buf, pos, lexer->length, flags);
+    if (end < 0) {
+        lexer->position = lexer->length;
+        return end;
     }
-    
-    char *result = (char*)malloc(actual_len + 1);
-    if (result == NULL) {
-        lexer->position = end_pos;
-        return NULL;
+    if (*flags != 0) {
+        lexer->position = end;
+        return end - pos;
     }
     
-    int src_pos = start_pos;// Копируем с обработкой экранирования
-    int dst_pos = 0;
-    while (src_pos < end_pos && dst_pos < actual_len) {
-        if (lexer->input[src_pos] == '\\') {
-            src_pos++; // Пропускаем обратный слеш
-            if (src_pos < end_pos) {
-                result[dst_pos++] = lexer->input[src_pos++];
+    while (pos < end) {
+        char current = buf[pos];
+        
+        if (current == '\'' || current == '"') {// Кавычки: внутри одинарных все буквально, в двойных работает обратный слеш
+            quoted = 1;
+            pos++;
+            while (buf[pos] != current) {
+                if (current == '"' && buf[pos] == '\\' && strchr("$`\"\\\n", buf[pos + 1]) != NULL) {
+                    pos++;// В двойных кавычках слеш экранирует только $ ` " \ и перевод строки
+                }
+                buf[dst++] = buf[pos++];
+            }
+            pos++;// Пропускаем закрывающую кавычку
+        } else if (current == '\\') {// Экранирование вне кавычек
+            pos++;
+            if (pos < end) {
+                buf[dst++] = buf[pos++];
             }
         } else {
-            result[dst_pos++] = lexer->input[src_pos++];
+            if (dst != pos) {// Пока не было кавычек, байты уже на своем месте
+                buf[dst] = current;
+            }
+            dst++;
+            pos++;
         }
     }
-    result[dst_pos] = '\0';
     
-    lexer->position = end_pos;
-    return result;
+    int start = lexer->position;
+    lexer->position = end;
+    
+    if (dst == start && !quoted) {
+        return -1;
+    }
+    return dst - start;
 }
 
-// Обработка составного слова (может содержать кавычки и обычный текст)
-static char *handle_compound_word(lexer_t *lexer) {
-    char *buffer = NULL;
-    int buffer_len = 0;
-    
-    while (lexer->position < lexer->length) {
-        char current = lexer->input[lexer->position];
-        
-        // Если встретили пробел или спецсимвол - заканчиваем
-        if (is_whitespace(current) || is_special_char(current)) {
-            break;
+// Продолжение строки: \ с переводом строки вне одинарных кавычек и комментариев убирается
+// до разбора на слова, как в sh (echo a \<перевод строки> b - одна команда "echo a b").
+// Текст только сжимается на месте, возвращает новую длину
+static int join_continued_lines(char *buf, int length) {
+    if (memchr(buf, '\\', length) == NULL) {
+        return length;
+    }
+    int dst = 0;
+    char quote = 0;
+    int in_word = 0;// # начинает комментарий только в начале слова
+    int pos = 0;
+    while (pos < length) {
+        char c = buf[pos];
+        if (c == '\\' && quote != '\'' && pos + 1 < length) {
+            if (buf[pos + 1] == '\n') {
+                pos += 2;
+                continue;
+            }
+            buf[dst++] = buf[pos++];// Экранированный символ переносим вместе со слешем
+            buf[dst++] = buf[pos++];
+            in_word = 1;
+            continue;
         }
-        
-        // Если встретили кавычку - обрабатываем как quoted string
-        if (current == '\'' || current == '"') {
-            char *quoted = handle_quotes(lexer, current);
-            if (quoted == NULL) {
-                free(buffer);
-                return NULL;
+        if (quote != 0) {
+            if (c == quote) {
+                quote = 0;
             }
-            
-            // Расширяем буфер если нужно
-            int quoted_len = strlen(quoted);
-            int new_len = buffer_len + quoted_len;
-            
-            if (buffer == NULL) {
-                buffer = (char*)malloc(new_len + 1);
-                if (buffer == NULL) {
-                    free(quoted);
-                    return NULL;
-                }
-                buffer_len = 0;
-            } else {
-                char *new_buffer = (char*)realloc(buffer, new_len + 1);
-                if (new_buffer == NULL) {
-                    free(buffer);
-                    free(quoted);
-                    return NULL;
-                }
-                buffer = new_buffer;
+            in_word = 1;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            in_word = 1;
+        } else if (c == '#' && !in_word) {
+            while (pos < length && buf[pos] != '\n') {
+                buf[dst++] = buf[pos++];
             }
-            
-            strcpy(buffer + buffer_len, quoted);
-            buffer_len = new_len;
-            free(quoted);
+            continue;
         } else {
-            // Обрабатываем обычное слово до следующей кавычки или пробела
-            char *word = handle_word(lexer);
-            if (word == NULL) {
-                break;
-            }
-            
-            int word_len = strlen(word);
-            int new_len = buffer_len + word_len;
-            
-            if (buffer == NULL) {
-                buffer = (char*)malloc(new_len + 1);
-                if (buffer == NULL) {
-                    free(word);
-                    return NULL;
-                }
-                buffer_len = 0;
-            } else {
-                char *new_buffer = (char*)realloc(buffer, new_len + 1);
-                if (new_buffer == NULL) {
-                    free(buffer);
-                    free(word);
-                    return NULL;
-                }
-                buffer = new_buffer;
-            }
-            
-            strcpy(buffer + buffer_len, word);
-            buffer_len = new_len;
-            free(word);
+            in_word = !(is_whitespace(c) || is_special_char(c));
         }
+        buf[dst++] = buf[pos++];
     }
-    
-    return buffer;
+    return dst;
 }
 
 token_t *lexer_tokenize(lexer_t *lexer) {
@@ -288,58 +408,72 @@ token_t *lexer_tokenize(lexer_t *lexer) {
         return NULL;
     }
     
+    lexer->buffer = arena_strndup(lexer->arena, lexer->input, lexer->length);// Единственная копия строки - токены ссылаются в нее
+    if (lexer->buffer == NULL) {
+        return NULL;
+    }
+    lexer->length = join_continued_lines(lexer->buffer, lexer->length);
+    
+    const char *buf = lexer->buffer;
     lexer->position = 0; 
+    lexer->token_count = 0;
     
     while (lexer->position < lexer->length) {
-        char current = lexer->input[lexer->position];
+        char current = buf[lexer->position];
+        char next = (lexer->position + 1 < lexer->length) ? buf[lexer->position + 1] : '\0';
+        
+        if (current == '\n') {// Перевод строки разделяет команды как ';'
+            if (lexer->token_count > 0 && !is_separator(lexer->tokens[lexer->token_count - 1].type)) {
+                add_token(lexer, TOKEN_SEMICOLON, "\n", 1);
+            }
+            lexer->position++;
+            continue;
+        }
         
         if (is_whitespace(current)) {
             lexer->position++;
             continue;
         }
         
-        if (current == '#') {
-            break;
+        if (current == '#') {// Комментарий до конца строки
+            while (lexer->position < lexer->length && buf[lexer->position] != '\n') {
+                lexer->position++;
+            }
+            continue;
         }
         
         //спец символы - двухсимвольные операторы
-        if (current == '|' && lexer->position + 1 < lexer->length && 
-            lexer->input[lexer->position + 1] == '|') {
-            add_token(lexer, TOKEN_OR, strdup("||"));
+        if (current == '|' && next == '|') {
+            add_token(lexer, TOKEN_OR, "||", 2);
             lexer->position += 2;
             continue;
         }
         
-        if (current == '|' && lexer->position + 1 < lexer->length && 
-            lexer->input[lexer->position + 1] == '&') {
-            add_token(lexer, TOKEN_REDIR_ERR, strdup("|&"));
+        if (current == '|' && next == '&') {
+            add_token(lexer, TOKEN_REDIR_ERR, "|&", 2);
             lexer->position += 2;
             continue;
         }
         
-        if (current == '&' && lexer->position + 1 < lexer->length && 
-            lexer->input[lexer->position + 1] == '&') {
-            add_token(lexer, TOKEN_AND, strdup("&&"));
+        if (current == '&' && next == '&') {
+            add_token(lexer, TOKEN_AND, "&&", 2);
             lexer->position += 2;
             continue;
         }
         
-        if (current == '&' && lexer->position + 1 < lexer->length && 
-            lexer->input[lexer->position + 1] == '>') {
-            if (lexer->position + 2 < lexer->length && 
-                lexer->input[lexer->position + 2] == '>') {
-                add_token(lexer, TOKEN_REDIR_ERR, strdup("&>>"));
+        if (current == '&' && next == '>') {
+            if (lexer->position + 2 < lexer->length && buf[lexer->position + 2] == '>') {
+                add_token(lexer, TOKEN_REDIR_ERR, "&>>", 3);
                 lexer->position += 3;
             } else {
-                add_token(lexer, TOKEN_REDIR_ERR, strdup("&>"));
+                add_token(lexer, TOKEN_REDIR_ERR, "&>", 2);
                 lexer->position += 2;
             }
             continue;
         }
         
-        if (current == '>' && lexer->position + 1 < lexer->length && 
-            lexer->input[lexer->position + 1] == '>') {
-            add_token(lexer, TOKEN_REDIR_APPEND, strdup(">>"));
+        if (current == '>' && next == '>') {
+            add_token(lexer, TOKEN_REDIR_APPEND, ">>", 2);
             lexer->position += 2;
             continue;
         }
@@ -347,74 +481,86 @@ token_t *lexer_tokenize(lexer_t *lexer) {
         // Односимвольные спецсимволы
         switch (current) {
             case '|':
-                add_token(lexer, TOKEN_PIPE, strdup("|"));
+                add_token(lexer, TOKEN_PIPE, "|", 1);
                 lexer->position++;
                 continue;
                 
             case '&':
-                add_token(lexer, TOKEN_BACKGROUND, strdup("&"));
+                add_token(lexer, TOKEN_BACKGROUND, "&", 1);
                 lexer->position++;
                 continue;
                 
             case ';':
-                add_token(lexer, TOKEN_SEMICOLON, strdup(";"));
+                add_token(lexer, TOKEN_SEMICOLON, ";", 1);
                 lexer->position++;
                 continue;
                 
             case '>':
-                add_token(lexer, TOKEN_REDIR_OUT, strdup(">"));
+                add_token(lexer, TOKEN_REDIR_OUT, ">", 1);
                 lexer->position++;
                 continue;
                 
             case '<':
-                add_token(lexer, TOKEN_REDIR_IN, strdup("<"));
+                add_token(lexer, TOKEN_REDIR_IN, "<", 1);
                 lexer->position++;
                 continue;
                 
             case '(':
-                add_token(lexer, TOKEN_LPAREN, strdup("("));
+                add_token(lexer, TOKEN_LPAREN, "(", 1);
                 lexer->position++;
                 continue;
                 
             case ')':
-                add_token(lexer, TOKEN_RPAREN, strdup(")"));
+                add_token(lexer, TOKEN_RPAREN, ")", 1);
                 lexer->position++;
                 continue;
         }
         
         // Обработка слов (включая составные с кавычками)
-        if (current == '\'' || current == '"' || 
-            (!is_special_char(current) && !is_whitespace(current))) {
-            char *word_value = handle_compound_word(lexer);
-            if (word_value != NULL) {
-                add_token(lexer, TOKEN_WORD, word_value);
-            }
-            continue;
+        int start = lexer->position;
+        int flags;
+        int length = scan_word(lexer, &flags);
+        if (length <= -2) {
+            static const char *const errors[] = { "Незакрытая кавычка", "незакрытая ${", "незакрытая $( или `" };
+            fprintf(stderr, "Ошибка: %s\n", errors[-length - 2]);
+            lexer->tokens = NULL;// Недоразобранный массив парсеру не отдаем
+            lexer->token_count = 0;
+            return NULL;
         }
-        
-        // Если ничего не подошло, пропускаем символ
-        lexer->position++;
+        if (length >= 0 && add_token(lexer, TOKEN_WORD, buf + start, length) == 0) {
+            lexer->tokens[lexer->token_count - 1].flags = flags;
+        }
+    }
+    
+    if (add_token(lexer, TOKEN_EOF, NULL, 0) < 0) {
+        lexer->tokens = NULL;
+        lexer->token_count = 0;
+        return NULL;
     }
     
-    add_token(lexer, TOKEN_EOF, NULL);
+    // Завершаем слова нулем только теперь: ноль может лечь на уже разобранный разделитель
+    for (int i = 0; i < lexer->token_count; i++) {
+        token_t *token = &lexer->tokens[i];
+        if (token->type == TOKEN_WORD) {
+            lexer->buffer[(token->value - buf) + token->length] = '\0';
+        }
+    }
     
-    lexer->current_token = lexer->tokens;
+    lexer->current = 0;
     
     return lexer->tokens;
 }
 
 token_t *lexer_get_next_token(lexer_t *lexer) {
-    if (lexer == NULL || lexer->current_token == NULL) {
+    if (lexer == NULL || lexer->tokens == NULL || lexer->current >= lexer->token_count) {
         return NULL;
     }
     
-    token_t *token = lexer->current_token;
-    lexer->current_token = token->next;
-    return token;
+    return &lexer->tokens[lexer->current++];
 }
 
 void lexer_rewind(lexer_t *lexer) {
     if (lexer != NULL) {
-        lexer->current_token = lexer->tokens;
+        lexer->current = 0;
     }
 }
@@ -0,0 +1,621 @@
+#define _GNU_SOURCE// memrchr
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include "line_editor.h"
+#include "completion.h"
+#include "builtin_io.h"
+#include "event_loop.h"
+#include "prompt.h"
+
+#define CTRL_KEY(c) ((c) & 0x1f)
+#define ESC 27
+#define BACKSPACE 127
+#define SEARCH_PREFIX "(reverse-i-search)`"
+#define SEARCH_FAILED_PREFIX "(failed reverse-i-search)`"
+#define ESCAPED_CHARS " \t\n|&;<>()\"'\\$`*?["// В дополненном слове экранируются обратным слешем
+
+enum {// Коды клавиш за пределами байтов
+    KEY_NONE = -2,
+    KEY_EOF = -1,
+    KEY_LEFT = 1000,
+    KEY_RIGHT,
+    KEY_UP,
+    KEY_DOWN,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_ESCAPE
+};
+
+static unsigned char input[EDITOR_READ_CHUNK];// Прочитано, но не обработано (хвост вставки переходит в следующую строку)
+static size_t input_len = 0;
+static size_t input_pos = 0;
+
+static char *output = NULL;// Перерисовка собирается здесь и выводится одним write
+static size_t output_len = 0;
+static size_t output_capacity = 0;
+
+
+static int is_continuation(unsigned char c) {// Продолжение многобайтового символа UTF-8
+    return (c & 0xC0) == 0x80;
+}
+
+
+static size_t display_width(const char *text, size_t length) {// Символы, а не байты
+    size_t width = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (!is_continuation((unsigned char)text[i])) {
+            width++;
+        }
+    }
+    return width;
+}
+
+
+static int read_byte(void) {
+    while (input_pos == input_len) {
+        if (event_loop_wait_readable(STDIN_FILENO) < 0) {
+            return KEY_EOF;
+        }
+        ssize_t n = read(STDIN_FILENO, input, sizeof(input));
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (n <= 0) {
+            return KEY_EOF;
+        }
+        input_len = n;
+        input_pos = 0;
+    }
+    return input[input_pos++];
+}
+
+
+static int byte_pending(int timeout_ms) {// Есть ли продолжение escape-последовательности
+    if (input_pos < input_len) {
+        return 1;
+    }
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    return poll(&pfd, 1, timeout_ms) > 0;
+}
+
+
+static int read_escape(void) {// ESC [ A, ESC [ 3 ~, ESC O H ...
+    if (!byte_pending(EDITOR_ESCAPE_TIMEOUT_MS)) {
+        return KEY_ESCAPE;// Одиночный Esc
+    }
+
+    int c = read_byte();
+    if (c != '[' && c != 'O') {
+        return c == KEY_EOF ? KEY_EOF : KEY_ESCAPE;// Alt+клавиша не поддерживается
+    }
+
+    int param = 0;
+    int final = read_byte();
+    while (final >= '0' && final <= '9') {
+        param = param * 10 + (final - '0');
+        final = read_byte();
+    }
+    while (final == ';' || (final >= '0' && final <= '9')) {// Модификаторы (Ctrl+стрелка) пропускаем
+        final = read_byte();
+    }
+
+    switch (final) {
+        case 'A': return KEY_UP;
+        case 'B': return KEY_DOWN;
+        case 'C': return KEY_RIGHT;
+        case 'D': return KEY_LEFT;
+        case 'H': return KEY_HOME;
+        case 'F': return KEY_END;
+        case '~':
+            if (param == 1 || param == 7) return KEY_HOME;
+            if (param == 4 || param == 8) return KEY_END;
+            if (param == 3) return KEY_DELETE;
+            return KEY_NONE;
+        case KEY_EOF: return KEY_EOF;
+        default: return KEY_NONE;
+    }
+}
+
+
+static int read_key(void) {
+    int c = read_byte();
+    return c == ESC ? read_escape() : c;
+}
+
+
+static int output_append(const char *text, size_t length) {
+    if (output_len + length > output_capacity) {
+        size_t capacity = output_capacity ? output_capacity : 256;
+        while (capacity < output_len + length) {
+            capacity *= 2;
+        }
+        char *grown = realloc(output, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        output = grown;
+        output_capacity = capacity;
+    }
+    memcpy(output + output_len, text, length);
+    output_len += length;
+    return 0;
+}
+
+
+static void output_flush(void) {
+    write_all(STDOUT_FILENO, output, output_len);
+    output_len = 0;
+}
+
+
+static void refresh(shell_t *shell, const char *prefix, size_t prefix_len) {// Перерисовывает последнюю строку приглашения и ввод
+    char move[32];
+    size_t column = display_width(prefix, prefix_len) + display_width(shell->line_buffer, shell->cursor_pos);
+
+    output_append("\r", 1);
+    output_append(prefix, prefix_len);
+    output_append(shell->line_buffer, shell->line_len);
+    output_append("\x1b[K\r", 4);// Стираем остаток прежней строки и ставим курсор заново
+    if (column > 0) {
+        int n = snprintf(move, sizeof(move), "\x1b[%zuC", column);
+        output_append(move, n);
+    }
+    output_flush();
+}
+
+
+static void refresh_prompt(shell_t *shell) {
+    size_t length;
+    const char *prompt = prompt_render(&length);
+    const char *last_line = memrchr(prompt, '\n', length);// Многострочное PS1: перерисовываем только последнюю строку
+    if (last_line != NULL) {
+        length -= last_line + 1 - prompt;
+        prompt = last_line + 1;
+    }
+    refresh(shell, prompt, length);
+}
+
+
+static int reserve(shell_t *shell, size_t length) {// Место под length байт и \0
+    if (length < shell->line_capacity) {
+        return 0;
+    }
+    size_t capacity = shell->line_capacity ? shell->line_capacity : 128;
+    while (capacity <= length) {
+        capacity *= 2;
+    }
+    char *grown = realloc(shell->line_buffer, capacity);
+    if (grown == NULL) {
+        return -1;
+    }
+    shell->line_buffer = grown;
+    shell->line_capacity = capacity;
+    return 0;
+}
+
+
+static void set_line(shell_t *shell, const char *text) {// Загрузка из истории, курсор в конец
+    size_t length = strlen(text);
+    if (reserve(shell, length) < 0) {
+        return;
+    }
+    memcpy(shell->line_buffer, text, length);
+    shell->line_len = length;
+    shell->cursor_pos = length;
+}
+
+
+static void insert_char(shell_t *shell, char c) {
+    if (reserve(shell, shell->line_len + 1) < 0) {
+        return;
+    }
+    memmove(shell->line_buffer + shell->cursor_pos + 1, shell->line_buffer + shell->cursor_pos,
+            shell->line_len - shell->cursor_pos);
+    shell->line_buffer[shell->cursor_pos++] = c;
+    shell->line_len++;
+}
+
+
+static void delete_range(shell_t *shell, size_t start, size_t end) {// Курсор встает на start
+    memmove(shell->line_buffer + start, shell->line_buffer + end, shell->line_len - end);
+    shell->line_len -= end - start;
+    shell->cursor_pos = start;
+}
+
+
+static size_t char_start(shell_t *shell, size_t pos) {// Начало символа перед pos
+    while (pos > 0) {
+        pos--;
+        if (!is_continuation((unsigned char)shell->line_buffer[pos])) {
+            break;
+        }
+    }
+    return pos;
+}
+
+
+static size_t char_end(shell_t *shell, size_t pos) {// Конец символа, начинающегося в pos
+    if (pos < shell->line_len) {
+        pos++;
+    }
+    while (pos < shell->line_len && is_continuation((unsigned char)shell->line_buffer[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+
+static char *finish_line(shell_t *shell) {// Курсор в конец, перевод строки, копия ввода
+    shell->cursor_pos = shell->line_len;
+    refresh_prompt(shell);
+    write_all(STDOUT_FILENO, "\n", 1);
+
+    char *line = malloc(shell->line_len + 1);
+    if (line != NULL) {
+        memcpy(line, shell->line_buffer, shell->line_len);
+        line[shell->line_len] = '\0';
+    }
+    return line;
+}
+
+
+static void replace_word(shell_t *shell, size_t start, const char *text, size_t length, int add_space) {// Слово до курсора - на text с экранированием
+    char *escaped = malloc(length * 2 + 2);
+    if (escaped == NULL) {
+        return;
+    }
+    size_t escaped_len = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (strchr(ESCAPED_CHARS, text[i]) != NULL || (text[i] == '#' && i == 0)) {
+            escaped[escaped_len++] = '\\';
+        }
+        escaped[escaped_len++] = text[i];
+    }
+    if (add_space) {
+        escaped[escaped_len++] = ' ';
+    }
+
+    size_t tail = shell->line_len - shell->cursor_pos;
+    size_t line_len = start + escaped_len + tail;
+    if (reserve(shell, line_len) == 0) {
+        memmove(shell->line_buffer + start + escaped_len, shell->line_buffer + shell->cursor_pos, tail);
+        memcpy(shell->line_buffer + start, escaped, escaped_len);
+        shell->line_len = line_len;
+        shell->cursor_pos = start + escaped_len;
+    }
+    free(escaped);
+}
+
+
+static const char *display_name(const char *match) {// В списке - только последний компонент пути
+    size_t length = strlen(match);
+    if (length > 1 && match[length - 1] == '/') {
+        length--;
+    }
+    while (length > 0 && match[length - 1] != '/') {
+        length--;
+    }
+    return match + length;
+}
+
+
+static void list_matches(const completion_t *completion) {// Варианты столбцами, как ls
+    output_append("\n", 1);
+    if (completion->count > EDITOR_MAX_LIST) {
+        char message[64];
+        int n = snprintf(message, sizeof(message), "Вариантов: %zu\n", completion->count);
+        output_append(message, n);
+        output_flush();
+        prompt_print();
+        return;
+    }
+
+    size_t widest = 0;
+    for (size_t i = 0; i < completion->count; i++) {
+        const char *name = display_name(completion->matches[i]);
+        size_t width = display_width(name, strlen(name));
+        if (width > widest) {
+            widest = width;
+        }
+    }
+
+    struct winsize ws;
+    size_t screen = (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) ? ws.ws_col : 80;
+    size_t column_width = widest + 2;
+    size_t columns = screen / column_width ? screen / column_width : 1;
+    size_t rows = (completion->count + columns - 1) / columns;
+
+    for (size_t row = 0; row < rows; row++) {
+        for (size_t column = 0; column < columns; column++) {
+            size_t i = column * rows + row;
+            if (i >= completion->count) {
+                break;
+            }
+            const char *name = display_name(completion->matches[i]);
+            size_t length = strlen(name);
+            output_append(name, length);
+            if (column + 1 < columns && i + rows < completion->count) {
+                for (size_t pad = display_width(name, length); pad < column_width; pad++) {
+                    output_append(" ", 1);
+                }
+            }
+        }
+        output_append("\n", 1);
+    }
+    output_flush();
+    prompt_print();
+}
+
+
+static void complete(shell_t *shell, int show_list) {// Tab: общий префикс вариантов, на втором Tab - их список
+    completion_t completion;
+    if (completion_complete(shell->line_buffer, shell->cursor_pos, &completion) < 0) {
+        write_all(STDOUT_FILENO, "\a", 1);
+        completion_free(&completion);
+        return;
+    }
+
+    const char *first = completion.matches[0];
+    if (completion.count == 1) {
+        size_t length = strlen(first);
+        replace_word(shell, completion.word_start, first, length, first[length - 1] != '/');
+    } else if (completion.common_length > completion.word_length) {
+        replace_word(shell, completion.word_start, first, completion.common_length, 0);
+    } else if (show_list) {
+        list_matches(&completion);
+    } else {
+        write_all(STDOUT_FILENO, "\a", 1);
+    }
+    completion_free(&completion);
+}
+
+
+static void search_refresh(shell_t *shell, const char *query, size_t query_len, int failed) {
+    const char *start = failed ? SEARCH_FAILED_PREFIX : SEARCH_PREFIX;
+
+    char *prefix = malloc(strlen(start) + query_len + 4);
+    if (prefix == NULL) {
+        return;
+    }
+    size_t length = strlen(start);
+    memcpy(prefix, start, length);
+    memcpy(prefix + length, query, query_len);
+    length += query_len;
+    memcpy(prefix + length, "': ", 3);
+    length += 3;
+
+    refresh(shell, prefix, length);
+    free(prefix);
+}
+
+
+static int search_show(shell_t *shell, long match, const char *query) {// Найденная команда в строку, курсор на совпадение
+    const char *text = history_get(shell, match);
+    if (text == NULL) {
+        return -1;
+    }
+    set_line(shell, text);
+    shell->cursor_pos = strstr(text, query) - text;
+    return 0;
+}
+
+
+// Ctrl-R: каждое нажатие - поиск по индексу триграмм, а не перебор истории.
+// Возвращает клавишу, завершившую поиск, чтобы ее обработал обычный редактор.
+static int reverse_search(shell_t *shell) {
+    char *original = malloc(shell->line_len + 1);// Для Ctrl-G
+    if (original == NULL) {
+        return KEY_NONE;
+    }
+    memcpy(original, shell->line_buffer, shell->line_len);
+    original[shell->line_len] = '\0';
+    size_t original_cursor = shell->cursor_pos;
+
+    char *query = NULL;
+    size_t query_len = 0;
+    size_t query_capacity = 0;
+    long match = -1;
+    int failed = 0;
+    int key = KEY_NONE;
+
+    while (1) {
+        if (input_pos == input_len) {// Вставка из буфера обмена - рисуем один раз в конце
+            search_refresh(shell, query ? query : "", query_len, failed);
+        }
+
+        key = read_key();
+        if (key == KEY_EOF) {
+            break;
+        }
+
+        long from = -1;// С какого номера (не включая) искать; -1 - без нового поиска
+        if (key == CTRL_KEY('r')) {
+            from = match >= 0 ? match : (long)history_count(shell);
+        } else if (key == BACKSPACE || key == CTRL_KEY('h')) {
+            while (query_len > 0 && is_continuation((unsigned char)query[--query_len])) {
+            }
+            from = (long)history_count(shell);// Короче запрос - снова от самой новой команды
+        } else if (key == CTRL_KEY('g') || key == CTRL_KEY('c')) {
+            set_line(shell, original);
+            shell->cursor_pos = original_cursor;
+            key = KEY_NONE;
+            break;
+        } else if ((key >= 32 && key < 127) || (key >= 128 && key < 256)) {
+            if (query_len + 2 > query_capacity) {
+                size_t capacity = query_capacity ? query_capacity * 2 : 64;
+                char *grown = realloc(query, capacity);
+                if (grown == NULL) {
+                    continue;
+                }
+                query = grown;
+                query_capacity = capacity;
+            }
+            query[query_len++] = (char)key;
+            from = match >= 0 ? match + 1 : (long)history_count(shell);// Текущее совпадение может подойти и к длинному запросу
+        } else {
+            break;// Enter, стрелки и прочее - выходим с найденной строкой
+        }
+
+        if (from < 0 || query == NULL) {
+            continue;
+        }
+        query[query_len] = '\0';
+        if (query_len > 0 && is_continuation((unsigned char)query[query_len - 1]) && byte_pending(0)) {
+            continue;// Символ UTF-8 пришел не целиком - ищем, когда будет полным
+        }
+
+        long found = query_len > 0 ? history_search(shell, query, from) : -1;
+        if (found >= 0 && search_show(shell, found, query) == 0) {
+            match = found;
+            failed = 0;
+        } else {
+            failed = query_len > 0;// Совпадения нет - оставляем прежнее
+        }
+    }
+
+    free(query);
+    free(original);
+    return key;
+}
+
+
+static int enable_raw_mode(struct termios *saved) {// Посимвольный ввод без эха; Ctrl-C обрабатываем сами
+    if (tcgetattr(STDIN_FILENO, saved) < 0) {
+        return -1;
+    }
+    struct termios raw = *saved;
+    raw.c_iflag &= ~(ICRNL | IXON | BRKINT | ISTRIP);
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    return tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+}
+
+
+static void disable_raw_mode(const struct termios *saved) {
+    tcsetattr(STDIN_FILENO, TCSADRAIN, saved);
+}
+
+
+char *line_editor_read(shell_t *shell) {// Приглашение уже выведено - редактор перерисовывает только его последнюю строку
+    struct termios saved;
+    if (enable_raw_mode(&saved) < 0) {
+        perror("tcsetattr");
+        return NULL;
+    }
+
+    if (reserve(shell, 0) < 0) {
+        disable_raw_mode(&saved);
+        return NULL;
+    }
+    shell->line_len = 0;
+    shell->cursor_pos = 0;
+    history_rewind(shell);
+
+    char *line = NULL;
+    int key = KEY_NONE;
+    int previous = KEY_NONE;
+    while (1) {
+        if (key == KEY_NONE) {
+            key = read_key();
+        }
+
+        int current = key;
+        key = KEY_NONE;
+        switch (current) {
+            case KEY_EOF:
+                goto done;
+            case '\r':
+            case '\n':
+                line = finish_line(shell);
+                goto done;
+            case CTRL_KEY('c'):// Отмена строки: пустая команда и новое приглашение
+                write_all(STDOUT_FILENO, "^C\n", 3);
+                shell->line_len = 0;
+                line = strdup("");
+                goto done;
+            case CTRL_KEY('d'):
+                if (shell->line_len == 0) {
+                    goto done;// Ctrl-D на пустой строке - выход
+                }
+                delete_range(shell, shell->cursor_pos, char_end(shell, shell->cursor_pos));
+                break;
+            case BACKSPACE:
+            case CTRL_KEY('h'):
+                delete_range(shell, char_start(shell, shell->cursor_pos), shell->cursor_pos);
+                break;
+            case KEY_DELETE:
+                delete_range(shell, shell->cursor_pos, char_end(shell, shell->cursor_pos));
+                break;
+            case KEY_LEFT:
+            case CTRL_KEY('b'):
+                shell->cursor_pos = char_start(shell, shell->cursor_pos);
+                break;
+            case KEY_RIGHT:
+            case CTRL_KEY('f'):
+                shell->cursor_pos = char_end(shell, shell->cursor_pos);
+                break;
+            case KEY_HOME:
+            case CTRL_KEY('a'):
+                shell->cursor_pos = 0;
+                break;
+            case KEY_END:
+            case CTRL_KEY('e'):
+                shell->cursor_pos = shell->line_len;
+                break;
+            case CTRL_KEY('u'):
+                delete_range(shell, 0, shell->cursor_pos);
+                break;
+            case CTRL_KEY('k'):
+                shell->line_len = shell->cursor_pos;
+                break;
+            case KEY_UP:
+            case CTRL_KEY('p'): {
+                const char *command = history_prev(shell);
+                if (command != NULL) {
+                    set_line(shell, command);
+                }
+                break;
+            }
+            case KEY_DOWN:
+            case CTRL_KEY('n'): {
+                const char *command = history_next(shell);
+                if (command != NULL) {
+                    set_line(shell, command);
+                }
+                break;
+            }
+            case CTRL_KEY('l'):
+                write_all(STDOUT_FILENO, "\x1b[H\x1b[2J", 7);
+                prompt_print();
+                break;
+            case CTRL_KEY('r'):
+                key = reverse_search(shell);
+                break;
+            case '\t':
+                complete(shell, previous == '\t');
+                break;
+            default:
+                if ((current >= 32 && current < 127) || (current >= 128 && current < 256)) {
+                    insert_char(shell, (char)current);
+                }
+                break;// Остальные управляющие клавиши и Esc пропускаем
+        }
+
+        if (key == KEY_NONE && input_pos == input_len) {// Вставка из буфера обмена - рисуем один раз в конце
+            refresh_prompt(shell);
+        }
+        previous = current;
+    }
+
+done:
+    disable_raw_mode(&saved);
+    return line;
+}
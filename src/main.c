@@ -1,25 +1,40 @@
 #include <stdio.h>
-#include "lexer.h"
+#include <string.h>
+#include <unistd.h>
+#include "shell.h"
+#include "executor.h"
 
-int main() {
-    printf("Testing lexer...\n\n");
-    
-    char *test ="ls\\>";
-    
-    lexer_t *lexer = lexer_create(test);
+static int exit_code(int status) {// Статус выполнения -> код возврата процесса
+    return status < 0 ? 1 : status;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {// myshell -c 'команды'
+        if (argc < 3) {
+            fprintf(stderr, "%s: -c: требуется аргумент\n", argv[0]);
+            return 2;
+        }
+        setup_signal_handlers();
+        return exit_code(shell_execute_string(argv[2]));
+    }
+
+    if (argc > 1) {// myshell file.sh - пакетный режим без приглашения
+        setup_signal_handlers();
+        return exit_code(shell_execute_file(argv[1]));
+    }
+
+    if (!isatty(STDIN_FILENO)) {// Команды пришли через пайп или из файла: тоже пакетный режим
+        setup_signal_handlers();
+        return exit_code(shell_execute_fd(STDIN_FILENO));
+    }
 
-    token_t *tokens = lexer_tokenize(lexer);
-    
-    token_t *current = tokens;
-    while (current) {
-        printf("Token: %d, Value: %s\n", 
-               current->type, 
-               current->value ? current->value : "NULL");
-        current = current->next;
+    shell_t *shell = shell_create();// Интерактивный режим
+    if (shell == NULL) {
+        fprintf(stderr, "Ошибка: не удалось создать shell\n");
+        return 1;
     }
-    
-    lexer_destroy(lexer);
-    
-    printf("\ntest completed!\n");
+
+    shell_run(shell);
+    shell_destroy(shell);
     return 0;
 }
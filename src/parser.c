@@ -4,6 +4,8 @@
 #include "parser.h"
 
 static ast_node_t *parse_redirects(parser_t *parser, ast_node_t *command_node);
+static ast_node_t *parse_pipeline_stage(parser_t *parser);
+static int starts_command(token_t *token);
 
 
 parser_t *parser_create(lexer_t *lexer) {
@@ -12,23 +14,21 @@ parser_t *parser_create(lexer_t *lexer) {
     }
     
     
-    parser_t *parser = (parser_t*)malloc(sizeof(parser_t));// Выделяем память для парсера
+    parser_t *parser = (parser_t*)arena_alloc(lexer->arena, sizeof(parser_t));// Парсер живет в арене лексера
     if (parser == NULL) {
         return NULL;
     }
     
     
     parser->lexer = lexer;// Сохраняем лексер и начинаем с первого токена
-    parser->current_token = lexer->tokens;
+    parser->current_token = lexer->tokens;// Массив токенов всегда заканчивается TOKEN_EOF
     
     return parser;
 }
 
 
-void parser_destroy(parser_t *parser) {// Освобождаем память парсера
-    if (parser != NULL) {
-        free(parser);
-    }
+void parser_destroy(parser_t *parser) {// Память парсера и AST освобождается вместе с ареной лексера
+    (void)parser;
 }
 
 
@@ -45,7 +45,9 @@ static token_t *parser_consume(parser_t *parser, token_type_t expected_type) {//
     
    
     token_t *token = parser->current_token; // Сохраняем токен и двигаемся вперед
-    parser->current_token = parser->current_token->next;
+    if (token->type != TOKEN_EOF) {
+        parser->current_token++;
+    }
     return token;
 }
 
@@ -56,13 +58,41 @@ ast_node_t *parse(parser_t *parser) {
     }
     
    
-    return parse_pipeline(parser);// Начинаем с разбора конвейеров
+    ast_node_t *node = parse_command(parser);// Начинаем со списка команд: конвейеры связываются операторами &&, ||, ;, &
+    
+    token_t *token = parser_peek(parser);
+    if (node != NULL && token != NULL && token->type != TOKEN_EOF) {// Весь ввод должен разобраться до конца
+        fprintf(stderr, "Ошибка: неожиданный токен '%s'\n", token->value);
+        return NULL;
+    }
+    return node;
+}
+
+
+static int is_time_word(token_t *token) {// time - зарезервированное слово только в начале конвейера
+    return token != NULL && token->type == TOKEN_WORD && token->length == 4 && memcmp(token->value, "time", 4) == 0;
 }
 
 
 ast_node_t *parse_pipeline(parser_t *parser) {// Разбираем конвейеры: команда1 | команда2 | команда3
     
-    ast_node_t *left = parse_command(parser);//Переменная left теперь содержит узел первой команды (до конвейера)
+    if (is_time_word(parser_peek(parser))) {// time cmd1 | cmd2 - замеряется весь конвейер
+        parser_consume(parser, TOKEN_WORD);
+        
+        ast_node_t *time_node = ast_create_node(parser->lexer->arena, NODE_TIME);
+        if (time_node == NULL) {
+            return NULL;
+        }
+        if (starts_command(parser_peek(parser))) {
+            time_node->left = parse_pipeline(parser);
+            if (time_node->left == NULL) {
+                return NULL;
+            }
+        }
+        return time_node;
+    }
+    
+    ast_node_t *left = parse_pipeline_stage(parser);//Переменная left теперь содержит узел первой команды (до конвейера)
     if (left == NULL) {
         return NULL;
     }
@@ -76,18 +106,15 @@ ast_node_t *parse_pipeline(parser_t *parser) {// Разбираем конвей
             parser_consume(parser, TOKEN_PIPE);
             
             
-            ast_node_t *right = parse_command(parser);// Разбираем правую команду
+            ast_node_t *right = parse_pipeline_stage(parser);// Разбираем правую команду
             if (right == NULL) {
-                ast_destroy(left);
                 fprintf(stderr, "Ошибка: ожидается команда после '|'\n");
                 return NULL;
             }
             
             
-            ast_node_t *pipe_node = ast_create_node(NODE_PIPE);// Создаем узел конвейера
+            ast_node_t *pipe_node = ast_create_node(parser->lexer->arena, NODE_PIPE);// Создаем узел конвейера
             if (pipe_node == NULL) {
-                ast_destroy(left);
-                ast_destroy(right);
                 return NULL;
             }
             
@@ -100,17 +127,14 @@ ast_node_t *parse_pipeline(parser_t *parser) {// Разбираем конвей
         else if (token->type == TOKEN_REDIR_ERR && strcmp(token->value, "|&") == 0) { // Конвейер с перенаправлением ошибок |&
             parser_consume(parser, TOKEN_REDIR_ERR);
             
-            ast_node_t *right = parse_command(parser);
+            ast_node_t *right = parse_pipeline_stage(parser);
             if (right == NULL) {
-                ast_destroy(left);
                 fprintf(stderr, "Ошибка: ожидается команда после '|&'\n");
                 return NULL;
             }
             
-            ast_node_t *pipe_node = ast_create_node(NODE_PIPE);
+            ast_node_t *pipe_node = ast_create_node(parser->lexer->arena, NODE_PIPE);
             if (pipe_node == NULL) {
-                ast_destroy(left);
-                ast_destroy(right);
                 return NULL;
             }
             
@@ -128,77 +152,107 @@ ast_node_t *parse_pipeline(parser_t *parser) {// Разбираем конвей
 }
 
 
-ast_node_t *parse_command(parser_t *parser) {// Разбираем команды с операторами: &&, ||, ;, &
-    
-    ast_node_t *node = parse_simple_command(parser);// Сначала разбираем простую команду
+static ast_node_t *parse_pipeline_stage(parser_t *parser) {// Одна стадия конвейера: простая команда или подсекция с перенаправлениями
+    ast_node_t *node = parse_simple_command(parser);
     if (node == NULL) {
         return NULL;
     }
     
+    return parse_redirects(parser, node);// Добавляем перенаправления если есть
+}
+
+
+static int starts_command(token_t *token) {// Может ли токен начинать новую команду
+    return token != NULL && (token->type == TOKEN_WORD || token->type == TOKEN_LPAREN);
+}
+
+
+static ast_node_t *parse_and_or(parser_t *parser) {// Конвейеры, связанные && и || (слева направо)
     
-    node = parse_redirects(parser, node);// Добавляем перенаправления если есть
+    ast_node_t *node = parse_pipeline(parser);// Сначала разбираем конвейер (или одиночную команду)
     if (node == NULL) {
         return NULL;
     }
     
-    
-    while (parser_peek(parser) != NULL) {// Обрабатываем операторы: cmd1 && cmd2, cmd1 || cmd2, cmd1 ; cmd2
+    while (parser_peek(parser) != NULL) {
         token_t *token = parser_peek(parser);
-        ast_node_t *new_node = NULL;
         node_type_t node_type;
         
+        if (token->type == TOKEN_AND) {
+            node_type = NODE_AND;// &&
+        } else if (token->type == TOKEN_OR) {
+            node_type = NODE_OR; // ||
+        } else {
+            break;
+        }
+        parser_consume(parser, token->type);
+        
+        ast_node_t *new_node = ast_create_node(parser->lexer->arena, node_type);
+        if (new_node == NULL) {
+            return NULL;
+        }
+        
+        new_node->left = node;
+        new_node->right = parse_pipeline(parser);// Разбираем правый конвейер
+        
+        if (new_node->right == NULL) {
+            fprintf(stderr, "Ошибка: ожидается команда после оператора\n");
+            return NULL;
+        }
+        
+        node = new_node;
+    }
+    
+    return node;
+}
+
+
+ast_node_t *parse_command(parser_t *parser) {// Разбираем список: and-or списки через ; и & (они слабее && и ||)
+    
+    ast_node_t *node = parse_and_or(parser);
+    if (node == NULL) {
+        return NULL;
+    }
+    ast_node_t **last = &node;// Последний элемент списка - именно он уходит в фон по &
+    
+    while (parser_peek(parser) != NULL) {
+        token_t *token = parser_peek(parser);
         
-        switch (token->type) {//Определяем тип оператора
-            case TOKEN_AND:
-                parser_consume(parser, TOKEN_AND);
-                node_type = NODE_AND;// &&
-                break;
-                
-            case TOKEN_OR:
-                parser_consume(parser, TOKEN_OR);
-                node_type = NODE_OR; // ||
-                break;
-                
-            case TOKEN_SEMICOLON:
-                parser_consume(parser, TOKEN_SEMICOLON);
-                node_type = NODE_SEMICOLON; // ;
-                break;
-                
-            case TOKEN_BACKGROUND:
-                parser_consume(parser, TOKEN_BACKGROUND);
-                node_type = NODE_BACKGROUND; //&
-                
-                new_node = ast_create_node(node_type);// Создаем узел для &
-                if (new_node == NULL) {
-                    ast_destroy(node);
-                    return NULL;
-                }
-                new_node->left = node;
-                new_node->right = NULL; // У & нет правой части
-                node = new_node;
-                continue;// Переходим к следующему токену
-                
-            default:
-                return node;// Больше нет операторов
+        if (token->type == TOKEN_BACKGROUND) {// a; b & - в фон уходит только b
+            parser_consume(parser, TOKEN_BACKGROUND);
+            
+            ast_node_t *background = ast_create_node(parser->lexer->arena, NODE_BACKGROUND);
+            if (background == NULL) {
+                return NULL;
+            }
+            background->left = *last;
+            background->right = NULL; // У & нет правой части
+            *last = background;
+        } else if (token->type == TOKEN_SEMICOLON) {
+            parser_consume(parser, TOKEN_SEMICOLON);
+        } else {
+            break;// Больше нет операторов
         }
         
+        if (!starts_command(parser_peek(parser))) {// ';', '&' или перевод строки в конце списка
+            break;
+        }
         
-        new_node = ast_create_node(node_type);// Создаем узел для оператора (кроме &)
+        ast_node_t *new_node = ast_create_node(parser->lexer->arena, NODE_SEMICOLON);// cmd1 & cmd2 - дальше идет обычная последовательность
         if (new_node == NULL) {
-            ast_destroy(node);
             return NULL;
         }
         
         new_node->left = node;
-        new_node->right = parse_command(parser);// Разбираем правую команду
+        new_node->right = parse_and_or(parser);
         
         if (new_node->right == NULL) {
-            ast_destroy(new_node);
             fprintf(stderr, "Ошибка: ожидается команда после оператора\n");
-            return node;
+            return NULL;
         }
         
         node = new_node;
+        last = &new_node->right;
     }
     
     return node;
@@ -210,20 +264,18 @@ ast_node_t *parse_simple_command(parser_t *parser) {// Разбираем про
     if (parser_peek(parser) != NULL && parser_peek(parser)->type == TOKEN_LPAREN) {// Проверяем есть ли открывающая скобка(подсекция)
         parser_consume(parser, TOKEN_LPAREN);
         
-        ast_node_t *subshell_node = ast_create_node(NODE_SUBSHELL);//Создаем узел для подсекции
+        ast_node_t *subshell_node = ast_create_node(parser->lexer->arena, NODE_SUBSHELL);//Создаем узел для подсекции
         if (subshell_node == NULL) {
             return NULL;
         }
         
-        subshell_node->left = parse_pipeline(parser);// Разбираем команды внутри скобок
+        subshell_node->left = parse_command(parser);// Разбираем команды внутри скобок
         if (subshell_node->left == NULL) {
-            ast_destroy(subshell_node);
             fprintf(stderr, "Ошибка: ожидается команда внутри скобок\n");
             return NULL;
         }
         
         if (parser_peek(parser) == NULL || parser_peek(parser)->type != TOKEN_RPAREN) {// Проверяем закрывающую скобку
-            ast_destroy(subshell_node);
             fprintf(stderr, "Ошибка: ожидается закрывающая скобка ')'\n");
             return NULL;
         }
@@ -233,71 +285,46 @@ ast_node_t *parse_simple_command(parser_t *parser) {// Разбираем про
     }
     
 
-    char **argv = NULL; //собираем все слова
-    int argc = 0;
-    int capacity = 10;  // Начальный размер массива
-    
-    argv = (char**)malloc(capacity * sizeof(char*));
-    if (argv == NULL) {
-        return NULL;
-    }
-    
-    memset(argv, 0, capacity * sizeof(char*));
-    
-    
-    while (parser_peek(parser) != NULL && parser_peek(parser)->type == TOKEN_WORD) {// Собираем все слова команды (ls -l /home)
-        token_t *word_token = parser_consume(parser, TOKEN_WORD);
-        
-        
-        if (argc >= capacity) {// Если массив заполнен, увеличиваем его
-            capacity *= 2;
-            char **new_argv = (char**)realloc(argv, capacity * sizeof(char*));
-            if (new_argv == NULL) {
-                
-                for (int i = 0; i < argc; i++) {// Очищаем уже выделенную память
-                    free(argv[i]);
-                }
-                free(argv);
-                return NULL;
-            }
-            argv = new_argv;
-            
-            memset(argv + argc, 0, (capacity - argc) * sizeof(char*));//заполняем новую память NULLами
-        }
-        
-        
-        argv[argc] = strdup(word_token->value);// Копируем слово в массив
-        if (argv[argc] == NULL) {
-            for (int i = 0; i < argc; i++) {
-                free(argv[i]);
-            }
-            free(argv);
-            return NULL;
-        }
+    int argc = 0;// Считаем слова заранее, чтобы выделить argv одним куском
+    int expand = 0;// Есть ли слова с подстановками
+    token_t *token = parser_peek(parser);
+    while (token != NULL && token->type == TOKEN_WORD) {
+        expand |= token->flags;
         argc++;
+        token++;
     }
     
-    
     if (argc == 0) {// Если не нашли ни одного слова - ошибка
-        free(argv);
         return NULL;
     }
     
-    if (argc < capacity) {
-        argv[argc] = NULL;
+    char **argv = (char**)arena_alloc(parser->lexer->arena, (argc + 1) * sizeof(char*));
+    if (argv == NULL) {
+        return NULL;
     }
     
+    unsigned char *word_flags = NULL;// Флаги нужны только командам с подстановками
+    if (expand) {
+        word_flags = (unsigned char *)arena_alloc(parser->lexer->arena, argc);
+        if (word_flags == NULL) {
+            return NULL;
+        }
+    }
     
-    ast_node_t *command_node = ast_create_command_node(argv, argc);// Создаем узел для собранных аргументов
-    if (command_node == NULL) {//если не удалось создать узел, очищаем память
-        for (int i = 0; i < argc; i++) {
-            free(argv[i]);//осв кажд строку
+    for (int i = 0; i < argc; i++) {// Собираем все слова команды (ls -l /home) - строки уже лежат в арене, не копируем
+        token_t *word_token = parser_consume(parser, TOKEN_WORD);
+        argv[i] = (char *)word_token->value;
+        if (word_flags != NULL) {
+            word_flags[i] = (unsigned char)word_token->flags;
         }
-        free(argv);
-        return NULL;
     }
+    argv[argc] = NULL;
     
-    return command_node;
+    ast_node_t *node = ast_create_command_node(parser->lexer->arena, argv, argc);// Создаем узел для собранных аргументов
+    if (node != NULL) {
+        node->data.command.word_flags = word_flags;
+    }
+    return node;
 }
 
 
@@ -310,19 +337,18 @@ static ast_node_t *parse_redirects(parser_t *parser, ast_node_t *command_node) {
             token_t *file_token = parser_consume(parser, TOKEN_WORD);
             
             if (file_token == NULL) {
-                ast_destroy(command_node);
                 fprintf(stderr, "Ошибка: ожидается имя файла после '<'\n");
                 return NULL;
             }
             
             
-            ast_node_t *redirect_node = ast_create_node(NODE_REDIRECT);// изм создали узел перенаправления
+            ast_node_t *redirect_node = ast_create_node(parser->lexer->arena, NODE_REDIRECT);// изм создали узел перенаправления
             if (redirect_node == NULL) {
-                ast_destroy(command_node);
                 return NULL;
             }
             redirect_node->left = command_node;
-            redirect_node->data.redirect.in_file = strdup(file_token->value);//изм
+            redirect_node->data.redirect.file_flags = file_token->flags;
+            redirect_node->data.redirect.in_file = (char *)file_token->value;//изм
             command_node = redirect_node;
         }
         else if (token->type == TOKEN_REDIR_OUT) {
@@ -330,18 +356,17 @@ static ast_node_t *parse_redirects(parser_t *parser, ast_node_t *command_node) {
             token_t *file_token = parser_consume(parser, TOKEN_WORD);
             
             if (file_token == NULL) {
-                ast_destroy(command_node);
                 fprintf(stderr, "Ошибка: ожидается имя файла после '>'\n");
                 return NULL;
             }
             
-            ast_node_t *redirect_node = ast_create_node(NODE_REDIRECT);
+            ast_node_t *redirect_node = ast_create_node(parser->lexer->arena, NODE_REDIRECT);
             if (redirect_node == NULL) {
-                ast_destroy(command_node);
                 return NULL;
             }
             redirect_node->left = command_node;
-            redirect_node->data.redirect.out_file = strdup(file_token->value);  //изм
+            redirect_node->data.redirect.file_flags = file_token->flags;
+            redirect_node->data.redirect.out_file = (char *)file_token->value;  //изм
             redirect_node->data.redirect.append = 0;  //изм
             command_node = redirect_node;
         }
@@ -350,39 +375,37 @@ static ast_node_t *parse_redirects(parser_t *parser, ast_node_t *command_node) {
             token_t *file_token = parser_consume(parser, TOKEN_WORD);
             
             if (file_token == NULL) {
-                ast_destroy(command_node);
                 fprintf(stderr, "Ошибка: ожидается имя файла после '>>'\n");
                 return NULL;
             }
             
-            ast_node_t *redirect_node = ast_create_node(NODE_REDIRECT);
+            ast_node_t *redirect_node = ast_create_node(parser->lexer->arena, NODE_REDIRECT);
             if (redirect_node == NULL) {
-                ast_destroy(command_node);
                 return NULL;
             }
             redirect_node->left = command_node;
-            redirect_node->data.redirect.out_file = strdup(file_token->value);  //изм
+            redirect_node->data.redirect.file_flags = file_token->flags;
+            redirect_node->data.redirect.out_file = (char *)file_token->value;  //изм
             redirect_node->data.redirect.append = 1;  //изм
             command_node = redirect_node;
         }
-        else if (token->type == TOKEN_REDIR_ERR) {
+        else if (token->type == TOKEN_REDIR_ERR && strcmp(token->value, "|&") != 0) {// |& - это конвейер, а не перенаправление
             const char *redirect_op = token->value;
             parser_consume(parser, TOKEN_REDIR_ERR);
             token_t *file_token = parser_consume(parser, TOKEN_WORD);
             
             if (file_token == NULL) {
-                ast_destroy(command_node);
                 fprintf(stderr, "Ошибка: ожидается имя файла после '%s'\n", redirect_op);
                 return NULL;
             }
             
-            ast_node_t *redirect_node = ast_create_node(NODE_REDIRECT);
+            ast_node_t *redirect_node = ast_create_node(parser->lexer->arena, NODE_REDIRECT);
             if (redirect_node == NULL) {
-                ast_destroy(command_node);
                 return NULL;
             }
             redirect_node->left = command_node;
-            redirect_node->data.redirect.err_file = strdup(file_token->value);  //изм
+            redirect_node->data.redirect.file_flags = file_token->flags;
+            redirect_node->data.redirect.err_file = (char *)file_token->value;  //изм
             
             
             if (strcmp(redirect_op, "&>>") == 0) {// Определяем режим: перезапись или добавление
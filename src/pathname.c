@@ -0,0 +1,540 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <wctype.h>
+#include "pathname.h"
+#include "dir_cache.h"
+
+typedef enum {
+    OP_LITERAL,
+    OP_ANY,// ?
+    OP_STAR,
+    OP_CLASS
+} op_type_t;
+
+typedef struct {
+    op_type_t type;
+    size_t offset;// LITERAL - начало байтов в text, CLASS - первый диапазон в ranges
+    size_t length;// LITERAL - число байтов, CLASS - число диапазонов
+    int negate;
+    unsigned classes;// CLASS: биты [:имя:] по номеру в class_names
+} op_t;
+
+typedef struct {
+    uint32_t low;
+    uint32_t high;
+} range_t;
+
+typedef struct {
+    size_t first_op;
+    size_t op_count;
+    int magic;// Есть метасимволы - нужен список каталога
+} segment_t;
+
+typedef struct {// Пути одного шага обхода: строки подряд в text
+    char *text;
+    size_t length;
+    size_t text_capacity;
+    size_t *starts;
+    size_t count;
+    size_t capacity;
+} path_list_t;
+
+static struct {// Скомпилированный шаблон; массивы переживают слово и не выделяются заново
+    char *text;// Буквальные байты всех операций, без экранирования
+    size_t text_length;
+    size_t text_capacity;
+    op_t *ops;
+    size_t op_count;
+    size_t op_capacity;
+    range_t *ranges;
+    size_t range_count;
+    size_t range_capacity;
+    segment_t *segments;
+    size_t segment_count;
+    size_t segment_capacity;
+    int absolute;
+    int trailing_slash;// a*/ - только каталоги, со слешем на конце
+    int magic;
+} compiled;
+
+static path_list_t lists[2];
+static char *scratch = NULL;// Путь каталога для dir_cache
+static size_t scratch_capacity = 0;
+
+static const char *class_names[] = {
+    "alnum", "alpha", "blank", "cntrl", "digit", "graph",
+    "lower", "print", "punct", "space", "upper", "xdigit"
+};
+#define CLASS_COUNT (sizeof(class_names) / sizeof(class_names[0]))
+static wctype_t class_types[CLASS_COUNT];
+
+
+static int reserve(void **array, size_t *capacity, size_t need, size_t size, size_t initial) {
+    if (need <= *capacity) {
+        return 0;
+    }
+    size_t grown = *capacity ? *capacity : initial;
+    while (grown < need) {
+        grown *= 2;
+    }
+    void *memory = realloc(*array, grown * size);
+    if (memory == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    *array = memory;
+    *capacity = grown;
+    return 0;
+}
+
+
+static size_t utf8_decode(const char *s, uint32_t *code) {// Длина символа в байтах; неверная последовательность - один байт
+    const unsigned char *u = (const unsigned char *)s;
+    size_t length = u[0] < 0x80 ? 1 : (u[0] >> 5) == 0x6 ? 2 : (u[0] >> 4) == 0xE ? 3 : (u[0] >> 3) == 0x1E ? 4 : 0;
+    for (size_t i = 1; i < length; i++) {
+        if ((u[i] & 0xC0) != 0x80) {
+            length = 0;
+            break;
+        }
+    }
+    if (length <= 1) {
+        *code = u[0];
+        return 1;
+    }
+    uint32_t value = u[0] & (0x7F >> length);
+    for (size_t i = 1; i < length; i++) {
+        value = (value << 6) | (u[i] & 0x3F);
+    }
+    *code = value;
+    return length;
+}
+
+
+static int add_op(op_type_t type, size_t offset, size_t length) {
+    if (reserve((void **)&compiled.ops, &compiled.op_capacity, compiled.op_count + 1, sizeof(op_t), PATHNAME_INITIAL_ITEMS) < 0) {
+        return -1;
+    }
+    op_t *op = &compiled.ops[compiled.op_count++];
+    op->type = type;
+    op->offset = offset;
+    op->length = length;
+    op->negate = 0;
+    op->classes = 0;
+    return 0;
+}
+
+
+static int add_literal(const char *bytes, size_t length, size_t first_op) {// Соседние литералы сливаются в одну операцию
+    if (reserve((void **)&compiled.text, &compiled.text_capacity, compiled.text_length + length, 1, PATHNAME_INITIAL_TEXT) < 0) {
+        return -1;
+    }
+    memcpy(compiled.text + compiled.text_length, bytes, length);
+    op_t *last = compiled.op_count > first_op ? &compiled.ops[compiled.op_count - 1] : NULL;
+    if (last != NULL && last->type == OP_LITERAL && last->offset + last->length == compiled.text_length) {
+        last->length += length;
+    } else if (add_op(OP_LITERAL, compiled.text_length, length) < 0) {
+        return -1;
+    }
+    compiled.text_length += length;
+    return 0;
+}
+
+
+static int add_range(uint32_t low, uint32_t high) {
+    if (reserve((void **)&compiled.ranges, &compiled.range_capacity, compiled.range_count + 1, sizeof(range_t), PATHNAME_INITIAL_ITEMS) < 0) {
+        return -1;
+    }
+    compiled.ranges[compiled.range_count].low = low;
+    compiled.ranges[compiled.range_count].high = high;
+    compiled.range_count++;
+    return 0;
+}
+
+
+// [...] от p (на '[') до end. Конец выражения или NULL, если это не класс
+// (нет ], неизвестный [:имя:]) - тогда [ считается обычным символом
+static const char *compile_class(const char *p, const char *end) {
+    const char *q = p + 1;
+    int negate = 0;
+    if (q < end && (*q == '!' || *q == '^')) {
+        negate = 1;
+        q++;
+    }
+
+    size_t first_range = compiled.range_count;
+    unsigned classes = 0;
+    int first = 1;// ] сразу после [ или [! - обычный символ
+    while (q < end && (*q != ']' || first)) {
+        first = 0;
+        if (q[0] == '[' && q + 1 < end && q[1] == ':') {
+            const char *name = q + 2;
+            const char *close = name;
+            while (close + 1 < end && !(close[0] == ':' && close[1] == ']')) {
+                close++;
+            }
+            if (close + 1 >= end) {
+                q = end;
+                break;
+            }
+            size_t i = 0;
+            while (i < CLASS_COUNT && !(strlen(class_names[i]) == (size_t)(close - name) &&
+                                        memcmp(class_names[i], name, close - name) == 0)) {
+                i++;
+            }
+            if (i == CLASS_COUNT) {
+                q = end;// Неизвестный класс - не шаблон
+                break;
+            }
+            if (class_types[i] == 0) {
+                class_types[i] = wctype(class_names[i]);
+            }
+            classes |= 1u << i;
+            q = close + 2;
+            continue;
+        }
+
+        uint32_t low, high;
+        if (*q == '\\' && q + 1 < end) {
+            q++;
+        }
+        q += utf8_decode(q, &low);
+        high = low;
+        if (q + 1 < end && q[0] == '-' && q[1] != ']') {
+            q++;
+            if (*q == '\\' && q + 1 < end) {
+                q++;
+            }
+            q += utf8_decode(q, &high);
+        }
+        if (add_range(low, high) < 0) {
+            q = end;
+            break;
+        }
+    }
+    if (q >= end) {
+        compiled.range_count = first_range;
+        return NULL;
+    }
+
+    if (add_op(OP_CLASS, first_range, compiled.range_count - first_range) < 0) {
+        return NULL;
+    }
+    compiled.ops[compiled.op_count - 1].negate = negate;
+    compiled.ops[compiled.op_count - 1].classes = classes;
+    return q + 1;
+}
+
+
+static int compile_segment(const char *p, const char *end) {
+    if (reserve((void **)&compiled.segments, &compiled.segment_capacity, compiled.segment_count + 1, sizeof(segment_t), PATHNAME_INITIAL_ITEMS) < 0) {
+        return -1;
+    }
+    segment_t *segment = &compiled.segments[compiled.segment_count++];
+    segment->first_op = compiled.op_count;
+    segment->magic = 0;
+
+    while (p < end) {
+        if (*p == '\\' && p + 1 < end) {
+            if (add_literal(p + 1, 1, segment->first_op) < 0) {
+                return -1;
+            }
+            p += 2;
+        } else if (*p == '*') {
+            if (compiled.op_count == segment->first_op || compiled.ops[compiled.op_count - 1].type != OP_STAR) {// ** - то же, что *
+                if (add_op(OP_STAR, 0, 0) < 0) {
+                    return -1;
+                }
+            }
+            segment->magic = 1;
+            p++;
+        } else if (*p == '?') {
+            if (add_op(OP_ANY, 0, 0) < 0) {
+                return -1;
+            }
+            segment->magic = 1;
+            p++;
+        } else {
+            const char *next = *p == '[' ? compile_class(p, end) : NULL;
+            if (next != NULL) {
+                segment->magic = 1;
+                p = next;
+            } else if (add_literal(p++, 1, segment->first_op) < 0) {
+                return -1;
+            }
+        }
+    }
+    segment->op_count = compiled.op_count - segment->first_op;
+    compiled.magic |= segment->magic;
+    return 0;
+}
+
+
+static int compile(const char *pattern) {
+    compiled.text_length = 0;
+    compiled.op_count = 0;
+    compiled.range_count = 0;
+    compiled.segment_count = 0;
+    compiled.magic = 0;
+    compiled.absolute = pattern[0] == '/';
+    compiled.trailing_slash = 0;
+
+    const char *p = pattern;
+    while (*p != '\0') {
+        while (*p == '/') {
+            p++;
+        }
+        if (*p == '\0') {
+            compiled.trailing_slash = compiled.segment_count > 0;
+            break;
+        }
+        const char *end = p;
+        while (*end != '\0' && *end != '/') {
+            end += (end[0] == '\\' && end[1] != '\0') ? 2 : 1;
+        }
+        if (compile_segment(p, end) < 0) {
+            return -1;
+        }
+        p = end;
+    }
+    return 0;
+}
+
+
+static int class_match(const op_t *op, uint32_t code) {
+    int found = 0;
+    for (size_t i = 0; i < op->length && !found; i++) {
+        const range_t *range = &compiled.ranges[op->offset + i];
+        found = code >= range->low && code <= range->high;
+    }
+    for (size_t i = 0; i < CLASS_COUNT && !found; i++) {
+        found = (op->classes & (1u << i)) && iswctype((wint_t)code, class_types[i]);
+    }
+    return found != op->negate;
+}
+
+
+// Сопоставление с откатом к последней *: после неудачи * забирает еще один символ.
+// Одной запомненной * достаточно - все, что до нее, уже совпало
+static int match_ops(const op_t *ops, size_t count, const char *s) {
+    size_t i = 0;
+    size_t star_op = 0;
+    const char *star_s = NULL;
+    uint32_t code;
+
+    while (1) {
+        if (i < count) {
+            const op_t *op = &ops[i];
+            if (op->type == OP_STAR) {
+                star_op = ++i;
+                star_s = s;
+                continue;
+            }
+            if (op->type == OP_LITERAL && strncmp(s, compiled.text + op->offset, op->length) == 0) {
+                s += op->length;
+                i++;
+                continue;
+            }
+            if (op->type == OP_ANY && *s != '\0') {
+                s += utf8_decode(s, &code);
+                i++;
+                continue;
+            }
+            if (op->type == OP_CLASS && *s != '\0') {
+                size_t length = utf8_decode(s, &code);
+                if (class_match(op, code)) {
+                    s += length;
+                    i++;
+                    continue;
+                }
+            }
+        } else if (*s == '\0') {
+            return 1;
+        }
+
+        if (star_s == NULL || *star_s == '\0') {
+            return 0;
+        }
+        star_s += utf8_decode(star_s, &code);
+        s = star_s;
+        i = star_op;
+    }
+}
+
+
+static int list_add(path_list_t *list, const char *base, size_t base_length, const char *name, int slash) {
+    size_t name_length = strlen(name);
+    size_t need = list->length + base_length + name_length + 2;
+    if (reserve((void **)&list->text, &list->text_capacity, need, 1, PATHNAME_INITIAL_TEXT) < 0 ||
+        reserve((void **)&list->starts, &list->capacity, list->count + 1, sizeof(size_t), PATHNAME_INITIAL_ITEMS) < 0) {
+        return -1;
+    }
+    list->starts[list->count++] = list->length;
+    char *out = list->text + list->length;// base может лежать в другом списке, но не в этом
+    memcpy(out, base, base_length);
+    memcpy(out + base_length, name, name_length);
+    size_t length = base_length + name_length;
+    if (slash) {
+        out[length++] = '/';
+    }
+    out[length] = '\0';
+    list->length += length + 1;
+    return 0;
+}
+
+
+static const char *listing_path(const char *base, size_t base_length, const char *cwd) {// Ключ dir_cache: абсолютный путь без слеша на конце
+    size_t cwd_length = compiled.absolute ? 0 : strlen(cwd) + 1;
+    if (reserve((void **)&scratch, &scratch_capacity, cwd_length + base_length + 2, 1, PATHNAME_INITIAL_TEXT) < 0) {
+        return NULL;
+    }
+    size_t length = 0;
+    if (!compiled.absolute) {
+        memcpy(scratch, cwd, cwd_length - 1);
+        length = cwd_length - 1;
+        if (scratch[length - 1] != '/') {// cwd может быть /
+            scratch[length++] = '/';
+        }
+    }
+    memcpy(scratch + length, base, base_length);
+    length += base_length;
+    while (length > 1 && scratch[length - 1] == '/') {
+        length--;
+    }
+    scratch[length] = '\0';
+    return scratch;
+}
+
+
+static size_t prefix_lower_bound(const dir_listing_t *listing, const char *prefix, size_t length) {
+    size_t low = 0, high = listing->count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (strncmp(listing->entries[middle].name, prefix, length) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+
+// Совпадения сегмента в одном каталоге - в список следующего шага.
+// last - сегмент последний: совпадение без слеша, если шаблон не кончается на /
+static int match_directory(const segment_t *segment, const char *base, size_t base_length, const char *cwd, int last, path_list_t *next) {
+    const char *path = listing_path(base, base_length, cwd);
+    if (path == NULL) {
+        return -1;
+    }
+    const dir_listing_t *listing = dir_cache_get_current(path);
+    if (listing == NULL) {
+        return 0;// Нет каталога - нет и совпадений
+    }
+
+    const op_t *ops = &compiled.ops[segment->first_op];
+    size_t count = segment->op_count;
+    const char *prefix = "";
+    size_t prefix_length = 0;
+    if (count > 0 && ops[0].type == OP_LITERAL) {// foo*.log - только имена на foo, двоичным поиском
+        prefix = compiled.text + ops[0].offset;
+        prefix_length = ops[0].length;
+        ops++;
+        count--;
+    }
+    const char *suffix = NULL;
+    size_t suffix_length = 0;
+    if (count > 1 && ops[count - 1].type == OP_LITERAL) {// *.log - хвост сравнивается до сопоставления
+        suffix = compiled.text + ops[count - 1].offset;
+        suffix_length = ops[count - 1].length;
+    }
+    int dirs_only = !last || compiled.trailing_slash;
+    int hidden = prefix_length > 0 && prefix[0] == '.';// Имена на . совпадают только с явной точкой
+
+    for (size_t i = prefix_lower_bound(listing, prefix, prefix_length); i < listing->count; i++) {
+        const dir_entry_t *entry = &listing->entries[i];
+        if (strncmp(entry->name, prefix, prefix_length) != 0) {
+            break;
+        }
+        if (entry->name[0] == '.' && !hidden) {
+            continue;
+        }
+        const char *rest = entry->name + prefix_length;
+        if (suffix != NULL) {
+            size_t rest_length = strlen(rest);
+            if (rest_length < suffix_length || memcmp(rest + rest_length - suffix_length, suffix, suffix_length) != 0) {
+                continue;
+            }
+        }
+        if (!match_ops(ops, count, rest) || (dirs_only && !dir_entry_is_dir(listing, entry))) {
+            continue;
+        }
+        if (list_add(next, base, base_length, entry->name, dirs_only) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+int pathname_expand(const char *pattern, pathname_add_t add, void *context) {
+    if (compile(pattern) < 0) {
+        return -1;
+    }
+    if (!compiled.magic) {
+        return 0;
+    }
+
+    char cwd[PATH_MAX];
+    if (!compiled.absolute && getcwd(cwd, sizeof(cwd)) == NULL) {
+        return 0;
+    }
+
+    path_list_t *current = &lists[0];
+    path_list_t *next = &lists[1];
+    current->length = 0;
+    current->count = 0;
+    if (list_add(current, "", 0, compiled.absolute ? "/" : "", 0) < 0) {
+        return -1;
+    }
+
+    for (size_t s = 0; s < compiled.segment_count && current->count > 0; s++) {// Шаг - один сегмент по всем каталогам сразу
+        const segment_t *segment = &compiled.segments[s];
+        int last = (s + 1 == compiled.segment_count);
+        next->length = 0;
+        next->count = 0;
+
+        for (size_t i = 0; i < current->count; i++) {
+            const char *base = current->text + current->starts[i];
+            size_t base_length = strlen(base);
+            if (!segment->magic && !last) {// Буквальный каталог в середине пути - без чтения родителя
+                const op_t *op = &compiled.ops[segment->first_op];
+                char name[NAME_MAX + 1];
+                size_t length = op->length < NAME_MAX ? op->length : NAME_MAX;
+                memcpy(name, compiled.text + op->offset, length);
+                name[length] = '\0';
+                if (list_add(next, base, base_length, name, 1) < 0) {
+                    return -1;
+                }
+            } else if (match_directory(segment, base, base_length, cwd, last, next) < 0) {
+                return -1;
+            }
+        }
+
+        path_list_t *swap = current;
+        current = next;
+        next = swap;
+    }
+
+    for (size_t i = 0; i < current->count; i++) {
+        const char *path = current->text + current->starts[i];
+        if (add(context, path, strlen(path)) != 0) {
+            return -1;
+        }
+    }
+    return (int)current->count;
+}
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <sys/utsname.h>
+#include "prompt.h"
+#include "variables.h"
+
+typedef enum {
+    SEG_LITERAL,
+    SEG_USER,
+    SEG_HOST,
+    SEG_HOST_FULL,
+    SEG_CWD,
+    SEG_CWD_BASE,
+    SEG_PROMPT_CHAR
+} segment_type_t;
+
+typedef struct {
+    segment_type_t type;
+    const char *text;// Для SEG_LITERAL - кусок разобранного шаблона
+    size_t length;
+} segment_t;
+
+static char *username = NULL;
+static char *hostname = NULL;
+static size_t host_short_len = 0;// Длина имени хоста до первой точки
+static char *home = NULL;
+static char prompt_char = '$';
+
+static char *cwd = NULL;// Каталог для показа (с ~ вместо HOME)
+static int cwd_valid = 0;
+
+static char *template_text = NULL;// Шаблон после снятия escape-последовательностей
+static segment_t *segments = NULL;
+static int segment_count = 0;
+
+static char *buffer = NULL;// Готовое приглашение
+static size_t buffer_len = 0;
+static size_t buffer_capacity = 0;
+static int buffer_valid = 0;
+
+
+static void add_segment(segment_type_t type, const char *text, size_t length) {
+    segments[segment_count].type = type;
+    segments[segment_count].text = text;
+    segments[segment_count].length = length;
+    segment_count++;
+}
+
+
+void prompt_set_template(const char *ps1) {// Разбор PS1 в сегменты: соседние буквальные символы склеиваются в один
+    if (ps1 == NULL) {
+        ps1 = PROMPT_DEFAULT_PS1;
+    }
+
+    size_t length = strlen(ps1);
+    char *text = malloc(length + 1);
+    segment_t *parsed = malloc((length + 1) * sizeof(segment_t));// Сегментов не больше, чем символов
+    if (text == NULL || parsed == NULL) {
+        free(text);
+        free(parsed);
+        fprintf(stderr, "Ошибка: не удалось разобрать PS1\n");
+        return;
+    }
+
+    free(template_text);
+    free(segments);
+    template_text = text;
+    segments = parsed;
+    segment_count = 0;
+
+    size_t out = 0;
+    size_t literal_start = 0;
+    for (size_t i = 0; i < length; i++) {
+        segment_type_t type = SEG_LITERAL;
+        char literal = ps1[i];
+
+        if (ps1[i] == '\\' && i + 1 < length) {
+            switch (ps1[i + 1]) {
+                case 'u': type = SEG_USER; break;
+                case 'h': type = SEG_HOST; break;
+                case 'H': type = SEG_HOST_FULL; break;
+                case 'w': type = SEG_CWD; break;
+                case 'W': type = SEG_CWD_BASE; break;
+                case '$': type = SEG_PROMPT_CHAR; break;
+                case 'n': literal = '\n'; break;
+                case '\\': literal = '\\'; break;
+                default:// Неизвестную последовательность показываем как есть
+                    text[out++] = '\\';
+                    literal = ps1[i + 1];
+                    break;
+            }
+            i++;
+        }
+
+        if (type == SEG_LITERAL) {
+            text[out++] = literal;
+            continue;
+        }
+
+        if (out > literal_start) {
+            add_segment(SEG_LITERAL, text + literal_start, out - literal_start);
+        }
+        add_segment(type, NULL, 0);
+        literal_start = out;
+    }
+    if (out > literal_start) {
+        add_segment(SEG_LITERAL, text + literal_start, out - literal_start);
+    }
+
+    buffer_valid = 0;
+}
+
+
+void prompt_init(void) {// Все медленные вызовы (getpwuid может идти в NSS/LDAP) - только здесь
+    struct passwd *pw = getpwuid(getuid());
+    free(username);
+    username = strdup(pw ? pw->pw_name : "unknown");
+
+    struct utsname uts;
+    free(hostname);
+    hostname = strdup(uname(&uts) == 0 ? uts.nodename : "unknown");
+    host_short_len = hostname ? strcspn(hostname, ".") : 0;
+
+    const char *home_env = var_get("HOME");
+    free(home);
+    home = home_env ? strdup(home_env) : NULL;
+
+    prompt_char = geteuid() == 0 ? '#' : '$';
+
+    prompt_set_template(var_get("PS1"));
+    prompt_cwd_changed();
+}
+
+
+void prompt_cwd_changed(void) {// Сам getcwd откладывается до следующей отрисовки
+    cwd_valid = 0;
+    buffer_valid = 0;
+}
+
+
+static void update_cwd(void) {// Текущий каталог, HOME сокращается до ~
+    free(cwd);
+    cwd = getcwd(NULL, 0);
+    cwd_valid = 1;
+    if (cwd == NULL) {
+        cwd = strdup("unknown");
+        return;
+    }
+
+    if (home == NULL || *home == '\0') {
+        return;
+    }
+
+    size_t home_len = strlen(home);
+    if (strncmp(cwd, home, home_len) == 0 && (cwd[home_len] == '/' || cwd[home_len] == '\0')) {// /home/user2 не считается внутри /home/user
+        size_t rest = strlen(cwd + home_len);
+        cwd[0] = '~';
+        memmove(cwd + 1, cwd + home_len, rest + 1);
+    }
+}
+
+
+static int append(const char *text, size_t length) {
+    if (buffer_len + length + 1 > buffer_capacity) {
+        size_t capacity = buffer_capacity ? buffer_capacity : 64;
+        while (buffer_len + length + 1 > capacity) {
+            capacity *= 2;
+        }
+        char *grown = realloc(buffer, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        buffer = grown;
+        buffer_capacity = capacity;
+    }
+
+    memcpy(buffer + buffer_len, text, length);
+    buffer_len += length;
+    buffer[buffer_len] = '\0';
+    return 0;
+}
+
+
+const char *prompt_render(size_t *length) {// Пересобирает строку только если она устарела
+    if (segments == NULL) {
+        prompt_init();
+    }
+    if (!cwd_valid) {
+        update_cwd();
+    }
+
+    if (!buffer_valid) {
+        buffer_len = 0;
+        for (int i = 0; i < segment_count; i++) {
+            const segment_t *seg = &segments[i];
+            const char *base;
+
+            switch (seg->type) {
+                case SEG_LITERAL:
+                    append(seg->text, seg->length);
+                    break;
+                case SEG_USER:
+                    append(username, strlen(username));
+                    break;
+                case SEG_HOST:
+                    append(hostname, host_short_len);
+                    break;
+                case SEG_HOST_FULL:
+                    append(hostname, strlen(hostname));
+                    break;
+                case SEG_CWD:
+                    append(cwd, strlen(cwd));
+                    break;
+                case SEG_CWD_BASE:
+                    base = strrchr(cwd, '/');
+                    base = (base != NULL && base[1] != '\0') ? base + 1 : cwd;
+                    append(base, strlen(base));
+                    break;
+                case SEG_PROMPT_CHAR:
+                    append(&prompt_char, 1);
+                    break;
+            }
+        }
+        buffer_valid = 1;
+    }
+
+    if (length != NULL) {
+        *length = buffer_len;
+    }
+    return buffer ? buffer : "";
+}
+
+
+void prompt_print(void) {// Одним write, без printf и промежуточных строк
+    size_t length;
+    const char *text = prompt_render(&length);
+
+    fflush(stdout);// Вывод builtin-команд должен оказаться до приглашения
+    while (length > 0) {
+        ssize_t n = write(STDOUT_FILENO, text, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        text += n;
+        length -= n;
+    }
+}
+
+
+void prompt_cleanup(void) {
+    free(username);
+    free(hostname);
+    free(home);
+    free(cwd);
+    free(template_text);
+    free(segments);
+    free(buffer);
+    username = hostname = home = cwd = template_text = buffer = NULL;
+    segments = NULL;
+    segment_count = 0;
+    buffer_len = buffer_capacity = 0;
+    cwd_valid = buffer_valid = 0;
+}
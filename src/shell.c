@@ -1,53 +1,27 @@
 #include <stdio.h>///изм
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
-#include <pwd.h>
-#include <sys/utsname.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "shell.h"
 #include "lexer.h"
 #include "parser.h"
 #include "executor.h"
+#include "ast_cache.h"
+#include "prompt.h"
+#include "job_control.h"
+#include "event_loop.h"
+#include "stats.h"
+#include "line_editor.h"
+#include "command_hash.h"
 
-#define MAX_INPUT_LENGTH 1024
-
-static char *get_username() {// Получаем имя пользователя из системы
-    struct passwd *pw = getpwuid(getuid());  // Получаем информацию о пользователе
-    return pw ? strdup(pw->pw_name) : strdup("unknown");
-}
-
-
-static char *get_hostname() {// Получаем имя компьютера
-    static struct utsname uts;
-    
-    if (uname(&uts) == 0) {
-        return strdup(uts.nodename);
-    }
-    return strdup("unknown");
-}
-
-
-static char *get_current_dir() {// Получаем текущую директорию (сокращаем домашнюю до ~)
-    char *cwd = getcwd(NULL, 0);
-    if (cwd == NULL) {
-        return strdup("unknown");
-    }
-    
-    char *home = getenv("HOME");
-
-    if (home != NULL && strncmp(cwd, home, strlen(home)) == 0) {
-        char *short_path = malloc(strlen(cwd) - strlen(home) + 2);
-        if (short_path) {
-            short_path[0] = '~';
-            strcpy(short_path + 1, cwd + strlen(home));
-            free(cwd);
-            return short_path;
-        }
-    }
-
-    return cwd;
-}
-
+#define INPUT_CHUNK_SIZE 128// Начальный размер буфера строки в read_input
+#define SCRIPT_READ_CHUNK 65536// Шаг чтения скрипта, который нельзя отобразить в память (пайп)
+#define SYNTAX_ERROR (-2)// parse_and_execute: команда не разобрана и не выполнялась
+#define SYNTAX_ERROR_STATUS 2// Код скрипта, остановленного ошибкой разбора (как у sh)
 
 shell_t *shell_create(void) {// Создаем структуру shell - выделяем память и инициализируем
     shell_t *shell = (shell_t*)malloc(sizeof(shell_t));
@@ -56,7 +30,13 @@ shell_t *shell_create(void) {// Создаем структуру shell - выд
     }
     
     shell->running = 1;
-    shell->prompt = NULL;
+    memset(&shell->history, 0, sizeof(shell->history));// История загружается в shell_run
+    shell->history.fd = -1;
+    shell->history.index_fd = -1;
+    shell->line_buffer = NULL;
+    shell->line_capacity = 0;
+    shell->cursor_pos = 0;
+    shell->line_len = 0;
     
     return shell;
 }
@@ -64,92 +44,99 @@ shell_t *shell_create(void) {// Создаем структуру shell - выд
 
 void shell_destroy(shell_t *shell) {// Освобождаем память когда shell закрывается
     if (shell != NULL) {
-        if (shell->prompt != NULL) {
-            free(shell->prompt);
-        }
+        history_close(shell);
+        free(shell->line_buffer);
         free(shell);
     }
+    prompt_cleanup();
 }
 
-static void print_prompt() {
-    char *username = get_username();
-    char *hostname = get_hostname();
-    char *current_dir = get_current_dir();
-    
-    printf("%s@%s:%s$ ", username, hostname, current_dir);
-    fflush(stdout);
-    
-    free(username);
-    free(hostname);
-    free(current_dir);
-}
+static char *input_pending = NULL;// Прочитано из терминала, но еще не отдано построчно
+static size_t pending_len = 0;
+static size_t pending_capacity = 0;
 
-static char *read_input() {//изм
-    size_t capacity = INPUT_CHUNK_SIZE;
-    size_t len = 0;
-    char *buffer = malloc(capacity);//динамическое выделение памяти
-    
-    if (buffer == NULL) {
+
+static char *take_line(size_t len, size_t consumed) {// Отдает первые len байт как строку и сдвигает остаток
+    char *line = malloc(len + 1);
+    if (line == NULL) {
         return NULL;
     }
-    
-    buffer[0] = '\0';
-    
+    memcpy(line, input_pending, len);
+    line[len] = '\0';
+
+    pending_len -= consumed;
+    memmove(input_pending, input_pending + consumed, pending_len);
+    return line;
+}
+
+
+static char *read_input() {//изм: читаем сами через read, пока ждем - цикл событий забирает фоновые процессы
     while (1) {
-        if (fgets(buffer + len, capacity - len, stdin) == NULL) {// Читаем по кусочкам
-            if (len == 0) {
-                free(buffer);
-                return NULL;  // Ctrl+D или EOF
-            }
-            break;
+        char *newline = pending_len ? memchr(input_pending, '\n', pending_len) : NULL;
+        if (newline != NULL) {
+            size_t len = newline - input_pending;
+            return take_line(len, len + 1);// Без \n
         }
-        
-        len += strlen(buffer + len);
-        
-        if (len > 0 && buffer[len - 1] == '\n') {// Проверяем, есть ли символ новой строки
-            buffer[len - 1] = '\0';// Убираем \n
-            
-            char *trimmed = realloc(buffer, len);// Оптимизируем память - обрезаем буфер до нужного размера
-            if (trimmed != NULL) {
-                return trimmed;
+
+        if (pending_len + INPUT_CHUNK_SIZE > pending_capacity) {
+            size_t capacity = pending_capacity ? pending_capacity * 2 : INPUT_CHUNK_SIZE * 2;
+            char *grown = realloc(input_pending, capacity);//увеличение буфера при необходимости
+            if (grown == NULL) {
+                return NULL;
             }
-            return buffer;  // Если realloc не удался, возвращаем как есть
+            input_pending = grown;
+            pending_capacity = capacity;
         }
-        
-        if (len + 1 >= capacity) {
-            capacity *= 2;
-            char *new_buffer = realloc(buffer, capacity);//увеличение буфера при необходимости
-            if (new_buffer == NULL) {
-                free(buffer);//Память освобождается
-                return NULL;
+
+        if (event_loop_wait_readable(STDIN_FILENO) < 0) {
+            return NULL;
+        }
+
+        ssize_t n = read(STDIN_FILENO, input_pending + pending_len, pending_capacity - pending_len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (pending_len == 0) {
+                return NULL;  // Ctrl+D или EOF
             }
-            buffer = new_buffer;
+            return take_line(pending_len, pending_len);// Последняя строка без \n
         }
+        pending_len += n;
     }
-    
-    return buffer;
 }
 
-static int process_command(const char *input) {// Обрабатываем команду: разбираем и выполняем
-    if (strlen(input) == 0) { // Проверяем пустая ли команда
-        return 0;  // Пустая команда - ничего не делаем
+static int parse_and_execute(const char *input, size_t length, int *cached) {// Разбор (или дерево из кэша) и выполнение
+    ast_cache_entry_t *entry = ast_cache_lookup(input, length);// Такую строку уже разбирали - выполняем готовое дерево
+    if (entry != NULL) {
+        *cached = 1;
+        int status = execute_ast(entry->ast);
+        ast_cache_release(entry);
+        return status;
     }
-
     
-    lexer_t *lexer = lexer_create(input);//Разбиваем строку на токены (слова)
+    uint64_t start = stats_now();
+    lexer_t *lexer = lexer_create_len(input, length);//Разбиваем текст на токены (слова)
     if (lexer == NULL) {
         fprintf(stderr, "Ошибка: не удалось создать лексер\n");
         return -1;
     }
     
     token_t *tokens = lexer_tokenize(lexer);
+    stats_record(STATS_LEX, start);
     if (tokens == NULL) {
         fprintf(stderr, "Ошибка: не удалось разобрать команду на токены\n");
         lexer_destroy(lexer);
-        return -1;
+        return SYNTAX_ERROR;
     }
     
+    if (tokens[0].type == TOKEN_EOF) {// Только пробелы или комментарии
+        lexer_destroy(lexer);
+        return 0;
+    }
     
+    
+    start = stats_now();
     parser_t *parser = parser_create(lexer);// Строим дерево команд из токенов
     if (parser == NULL) {
         fprintf(stderr, "Ошибка: не удалось создать парсер\n");
@@ -158,41 +145,210 @@ static int process_command(const char *input) {// Обрабатываем ко
     }
     
     ast_node_t *ast = parse(parser);
+    parser_destroy(parser);
+    stats_record(STATS_PARSE, start);
     if (ast == NULL) {
         fprintf(stderr, "Ошибка: не удалось разобрать команду\n");
-    } else {
-        
-        execute_ast(ast);//Выполняем команду
-        ast_destroy(ast);
+        lexer_destroy(lexer);
+        return SYNTAX_ERROR;
     }
     
-    parser_destroy(parser);
-    lexer_destroy(lexer);
+    entry = ast_cache_insert(input, length, lexer->arena, ast);// Арена лексера (токены, argv, дерево) переходит к кэшу
+    if (entry == NULL) {
+        int status = execute_ast(ast);//Выполняем команду
+        lexer_destroy(lexer);
+        return status;
+    }
+    
+    int status = execute_ast(entry->ast);//Выполняем команду
+    ast_cache_release(entry);
     
+    return status;
+}
+
+
+static int process_command(const char *input, size_t length) {// Обрабатываем команду (строку или одну команду скрипта): разбираем и выполняем
+    if (length == 0) { // Проверяем пустая ли команда
+        return 0;  // Пустая команда - ничего не делаем
+    }
+
+    command_hash_next_generation();// Каталоги PATH перепроверяются раз за команду, а не при каждом поиске
+
+    stats_command_t stats;
+    int cached = 0;
+    stats_command_begin(&stats);
+    int status = parse_and_execute(input, length, &cached);
+    stats_command_end(&stats, input, length, status, cached);
+    return status;
+}
+
+
+static int run_commands(const char *script, size_t length, int at_eof, size_t *consumed, int *status) {// Выполняет готовые команды текста, *consumed - сколько текста они заняли
+    size_t start = 0;
+    while (1) {
+        size_t end;
+        int complete = lexer_next_command(script, length, &start, &end);
+        if (start == length || (!complete && !at_eof)) {// Недописанную команду ждем, пока не дочитаем
+            break;
+        }
+        int result = process_command(script + start, end - start);
+        if (result == SYNTAX_ERROR) {
+            return SYNTAX_ERROR;
+        }
+        *status = result;
+        start = end;
+    }
+    *consumed = start;
     return 0;
 }
 
 
+static int execute_script(const char *script, size_t length) {// По одной команде верхнего уровня, как sh: ошибка разбора в конце не мешает выполнить начало
+    int status = 0;
+    size_t consumed;
+    if (run_commands(script, length, 1, &consumed, &status) == SYNTAX_ERROR) {
+        return SYNTAX_ERROR_STATUS;// Дальше скрипт не выполняется
+    }
+    return status;
+}
+
+
+int shell_execute_string(const char *input) {// Выполняет строку (-c 'команды')
+    return execute_script(input, strlen(input));
+}
+
+
+static int execute_stream(int fd) {// Скрипт из пайпа: каждая команда выполняется, как только дочитана, в буфере - только недочитанный хвост
+    size_t chunk = (fd == STDIN_FILENO) ? 1 : SCRIPT_READ_CHUNK;// Скрипт на stdin читают и его команды (read) - лишнего не забираем, как sh
+    size_t capacity = SCRIPT_READ_CHUNK;
+    size_t len = 0;
+    char *buffer = malloc(capacity);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    int status = 0;
+    int at_eof = 0;
+    int new_line = 0;// С прошлого разбора пришел перевод строки - могла закончиться команда
+    while (1) {
+        if (new_line || at_eof) {
+            size_t ready = len;
+            while (!at_eof && buffer[ready - 1] != '\n') {// Неполная строка (в т.ч. комментарий) ждет дочитывания
+                ready--;
+            }
+            size_t consumed;
+            if (run_commands(buffer, ready, at_eof, &consumed, &status) == SYNTAX_ERROR) {
+                free(buffer);
+                return SYNTAX_ERROR_STATUS;
+            }
+            if (at_eof) {
+                break;
+            }
+            memmove(buffer, buffer + consumed, len - consumed);
+            len -= consumed;
+            new_line = 0;
+        }
+
+        if (len == capacity) {// Растет только под одну очень длинную команду
+            capacity *= 2;
+            char *new_buffer = realloc(buffer, capacity);
+            if (new_buffer == NULL) {
+                free(buffer);
+                return -1;
+            }
+            buffer = new_buffer;
+        }
+
+        ssize_t n = read(fd, buffer + len, chunk > 1 ? capacity - len : 1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            free(buffer);
+            return -1;
+        }
+        if (n == 0) {
+            at_eof = 1;
+            continue;
+        }
+        new_line = memchr(buffer + len, '\n', n) != NULL;
+        len += n;
+    }
+
+    free(buffer);
+    return status;
+}
+
+
+int shell_execute_fd(int fd) {// Выполняет скрипт из дескриптора: обычный файл отображается в память без построчного чтения
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("fstat");
+        return -1;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        return execute_stream(fd);
+    }
+    if (st.st_size == 0) {
+        return 0;
+    }
+
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return execute_stream(fd);
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);// Команды берутся из файла подряд
+
+    int status = execute_script(map, st.st_size);
+    munmap(map, st.st_size);
+    return status;
+}
+
+
+int shell_execute_file(const char *path) {// Выполняет файл скрипта (myshell file.sh, source file)
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return 127;
+    }
+
+    int status = shell_execute_fd(fd);
+    close(fd);
+    return status;
+}
+
+
 void shell_run(shell_t *shell) {// Главный цикл shell - работает пока пользователь не выйдет
     printf("Введите 'help' для списка команд, 'exit' для выхода\n\n");
 
+    job_control_init();// Своя группа процессов и терминал - до первого приглашения
     setup_signal_handlers();
+    prompt_init();// Пользователь, хост и шаблон PS1 определяются один раз
+    job_set_reporting(1);
+    history_load(shell);
     
     while (shell->running) {
-        print_prompt();
+        event_loop_reap();
+        job_notify(1);// Сообщения о фоновых задачах пачкой, перед приглашением
+        prompt_print();
 
-        char *input = read_input();
+        char *input = isatty(STDIN_FILENO) ? line_editor_read(shell) : read_input();
 
         if (input == NULL) {
             printf("\nВыход из shell\n");
             break;  // Выход по Ctrl+D
         }
+        history_add(shell, input);// Сразу в файл: история не теряется, если shell завершится аварийно
  
         if (strcmp(input, "exit") == 0) {
+            free(input);
             break;  // Выход по команде exit
         }
         
         // Обрабатываем обычную команду
-        process_command(input);
+        process_command(input, strlen(input));
+        free(input);
     }
 }
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "stats.h"
+
+#define STATS_RECORD_MAX_COMMAND 512// Длиннее (скрипт целиком) обрезаем в записи
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t buckets[STATS_BUCKETS];
+} histogram_t;
+
+static histogram_t histograms[STATS_PHASES];
+
+static const char *phase_names[STATS_PHASES] = {
+    "lex", "parse", "spawn", "wait", "builtin", "command"
+};
+
+static int record_fd = -2;// -2 - переменная еще не читалась, -1 - записи выключены
+static pid_t record_pid = 0;// Копия shell после fork закрыла унаследованный дескриптор - откроет свой
+
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+static int bucket_index(uint64_t ns) {// Номер старшего бита
+    if (ns == 0) {
+        return 0;
+    }
+    int index = 63 - __builtin_clzll(ns);
+    return index < STATS_BUCKETS ? index : STATS_BUCKETS - 1;
+}
+
+
+void stats_record(stats_phase_t phase, uint64_t start_ns) {
+    uint64_t ns = stats_now() - start_ns;
+    histogram_t *histogram = &histograms[phase];
+
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->buckets[bucket_index(ns)], 1, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&histogram->max_ns, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    uint64_t min = __atomic_load_n(&histogram->min_ns, __ATOMIC_RELAXED);
+    while ((min == 0 || ns < min) && !__atomic_compare_exchange_n(&histogram->min_ns, &min, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+
+void stats_command_begin(stats_command_t *command) {
+    command->start_ns = stats_now();
+    for (int i = 0; i < STATS_PHASES; i++) {
+        command->phase_ns[i] = __atomic_load_n(&histograms[i].sum_ns, __ATOMIC_RELAXED);
+    }
+}
+
+
+static int open_record_file(void) {// Файл открывается один раз, при первой команде
+    if (record_fd != -2 && record_pid == getpid()) {
+        return record_fd;
+    }
+    record_pid = getpid();
+
+    const char *path = getenv(STATS_FILE_ENV);
+    record_fd = -1;
+    if (path != NULL && path[0] != '\0') {
+        record_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (record_fd < 0) {
+            fprintf(stderr, "Ошибка: %s: ", STATS_FILE_ENV);
+            perror(path);
+        }
+    }
+    return record_fd;
+}
+
+
+static size_t append_json_string(char *out, size_t size, const char *text, size_t length) {// Строка в кавычках; возвращает длину
+    size_t used = 0;
+    out[used++] = '"';
+    for (size_t i = 0; i < length && used + 8 < size; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            out[used++] = '\\';
+            out[used++] = (char)c;
+        } else if (c == '\n') {
+            out[used++] = '\\';
+            out[used++] = 'n';
+        } else if (c == '\t') {
+            out[used++] = '\\';
+            out[used++] = 't';
+        } else if (c < 0x20) {
+            used += snprintf(out + used, size - used, "\\u%04x", c);
+        } else {
+            out[used++] = (char)c;// UTF-8 пишем как есть
+        }
+    }
+    out[used++] = '"';
+    return used;
+}
+
+
+void stats_command_end(stats_command_t *command, const char *text, size_t length, int status, int cached) {
+    stats_record(STATS_COMMAND, command->start_ns);
+
+    int fd = open_record_file();
+    if (fd < 0) {
+        return;
+    }
+
+    char record[STATS_RECORD_MAX_COMMAND * 6 + 512];// Худший случай экранирования - \u00XX на байт
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+
+    size_t used = (size_t)snprintf(record, sizeof(record), "{\"time\": %lld.%03ld, \"command\": ",
+                                   (long long)wall.tv_sec, wall.tv_nsec / 1000000);
+    used += append_json_string(record + used, sizeof(record) - used, text,
+                               length < STATS_RECORD_MAX_COMMAND ? length : STATS_RECORD_MAX_COMMAND);
+    used += (size_t)snprintf(record + used, sizeof(record) - used, ", \"status\": %d, \"cached\": %s",
+                             status, cached ? "true" : "false");
+    for (int i = 0; i < STATS_PHASES; i++) {
+        uint64_t ns = __atomic_load_n(&histograms[i].sum_ns, __ATOMIC_RELAXED) - command->phase_ns[i];
+        used += (size_t)snprintf(record + used, sizeof(record) - used, ", \"%s_ns\": %llu",
+                                 phase_names[i], (unsigned long long)ns);
+    }
+    used += (size_t)snprintf(record + used, sizeof(record) - used, "}\n");
+
+    if (write_all(fd, record, used) < 0) {// Одна запись одним write - строки разных shell не перемешиваются
+        perror(STATS_FILE_ENV);
+        close(fd);
+        record_fd = -1;
+    }
+}
+
+
+void stats_reset(void) {
+    memset(histograms, 0, sizeof(histograms));
+}
+
+
+static void print_ns(builtin_io_t *io, uint64_t ns) {// Короткая запись с единицами: 850ns, 12.5us, 3.1ms, 2.0s
+    if (ns < 1000) {
+        bio_printf(io, "%lluns", (unsigned long long)ns);
+    } else if (ns < 1000000) {
+        bio_printf(io, "%.1fus", ns / 1e3);
+    } else if (ns < 1000000000) {
+        bio_printf(io, "%.1fms", ns / 1e6);
+    } else {
+        bio_printf(io, "%.1fs", ns / 1e9);
+    }
+}
+
+
+void stats_print(builtin_io_t *io) {
+    for (int i = 0; i < STATS_PHASES; i++) {
+        histogram_t *histogram = &histograms[i];
+        if (histogram->count == 0) {
+            bio_printf(io, "%s: нет замеров\n", phase_names[i]);
+            continue;
+        }
+
+        bio_printf(io, "%s: %llu замеров, среднее ", phase_names[i], (unsigned long long)histogram->count);
+        print_ns(io, histogram->sum_ns / histogram->count);
+        bio_puts(io, ", мин ");
+        print_ns(io, histogram->min_ns);
+        bio_puts(io, ", макс ");
+        print_ns(io, histogram->max_ns);
+        bio_puts(io, "\n");
+
+        uint64_t peak = 0;
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            if (histogram->buckets[b] > peak) {
+                peak = histogram->buckets[b];
+            }
+        }
+        for (int b = 0; b < STATS_BUCKETS; b++) {// Пустые корзины не печатаем
+            uint64_t count = histogram->buckets[b];
+            if (count == 0) {
+                continue;
+            }
+            if (b == STATS_BUCKETS - 1) {
+                bio_puts(io, "  >= ");
+                print_ns(io, 1ULL << b);
+            } else {
+                bio_puts(io, "  < ");
+                print_ns(io, 1ULL << (b + 1));
+            }
+            bio_printf(io, "\t%8llu ", (unsigned long long)count);
+            int bar = (int)(count * 40 / peak);
+            for (int k = 0; k < (bar > 0 ? bar : 1); k++) {
+                bio_write(io, "#", 1);
+            }
+            bio_write(io, "\n", 1);
+        }
+    }
+}
+
+
+int builtin_shellstats(char **argv, builtin_io_t *io) {//shellstats [-r] - гистограммы времени фаз
+    if (argv[1] == NULL) {
+        stats_print(io);
+        return 0;
+    }
+    if (strcmp(argv[1], "-r") == 0 && argv[2] == NULL) {
+        stats_reset();
+        return 0;
+    }
+    bio_error(io, "shellstats: использование: shellstats [-r]\n");
+    return 2;
+}
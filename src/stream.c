@@ -0,0 +1,502 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "stream.h"
+
+// Встроенные cat и tee: данные идут между дескрипторами в ядре,
+// shell копирует через свой буфер, только когда ядро не умеет иначе.
+
+
+static int unsupported(int err) {// Способ не подходит для этих дескрипторов - пробуем следующий
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == EBADF;
+}
+
+
+typedef ssize_t (*copy_call_t)(int in_fd, int out_fd, size_t length);
+
+static ssize_t call_copy_file_range(int in_fd, int out_fd, size_t length) {
+    return copy_file_range(in_fd, NULL, out_fd, NULL, length, 0);
+}
+
+static ssize_t call_splice(int in_fd, int out_fd, size_t length) {
+    return splice(in_fd, NULL, out_fd, NULL, length, SPLICE_F_MOVE);
+}
+
+static ssize_t call_sendfile(int in_fd, int out_fd, size_t length) {
+    return sendfile(out_fd, in_fd, NULL, length);
+}
+
+
+static int copy_with(copy_call_t call, int in_fd, int out_fd, long long *total) {// 0 - дошли до конца, 1 - способ не подходит, -1 - ошибка
+    while (1) {
+        ssize_t n = call(in_fd, out_fd, STREAM_CHUNK);
+        if (n > 0) {
+            *total += n;
+            continue;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return unsupported(errno) ? 1 : -1;// Смещения общие с read/write - следующий способ продолжит с того же места
+    }
+}
+
+
+static int copy_with_buffer(int in_fd, int out_fd, long long *total) {
+    char *buffer = malloc(STREAM_BUFFER_SIZE);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    int status = 0;
+    while (1) {
+        ssize_t n = read(in_fd, buffer, STREAM_BUFFER_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            status = n < 0 ? -1 : 0;
+            break;
+        }
+        if (write_all(out_fd, buffer, n) < 0) {
+            status = -1;
+            break;
+        }
+        *total += n;
+    }
+
+    int err = errno;
+    free(buffer);
+    errno = err;
+    return status;
+}
+
+
+long long stream_copy(int in_fd, int out_fd) {
+    struct stat in_st, out_st;
+    if (fstat(in_fd, &in_st) < 0 || fstat(out_fd, &out_st) < 0) {
+        return -1;
+    }
+
+    long long total = 0;
+    int result = 1;
+    if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode)) {
+        result = copy_with(call_copy_file_range, in_fd, out_fd, &total);
+    }
+    if (result == 1 && (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode))) {
+        result = copy_with(call_splice, in_fd, out_fd, &total);
+    }
+    if (result == 1 && S_ISREG(in_st.st_mode)) {
+        result = copy_with(call_sendfile, in_fd, out_fd, &total);
+    }
+    if (result == 1) {
+        result = copy_with_buffer(in_fd, out_fd, &total);
+    }
+    return result < 0 ? -1 : total;
+}
+
+
+static int skip_option(const char *arg, const char *allowed) {// 1 - опция из allowed, 0 - операнд, -1 - чужая опция
+    if (arg[0] != '-' || arg[1] == '\0') {
+        return 0;// "-" - стандартный ввод, это операнд
+    }
+    for (const char *p = arg + 1; *p != '\0'; p++) {
+        if (strchr(allowed, *p) == NULL) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+
+static int accepts_options(char **argv, const char *allowed) {
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            return 1;
+        }
+        if (skip_option(argv[i], allowed) < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+int cat_accepts(char **argv) {// -n, -A и т.п. меняют данные - это уже не копирование
+    return accepts_options(argv, "u");
+}
+
+
+int tee_accepts(char **argv) {// -i, -p и длинные опции - к внешнему tee
+    return accepts_options(argv, "a");
+}
+
+
+int stream_reads_stdin(char **argv) {
+    if (strcmp(argv[0], "cat") != 0) {
+        return 1;
+    }
+    int operands = 0;
+    int options_done = 0;
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (!options_done && strcmp(argv[i], "--") == 0) {
+            options_done = 1;
+        } else if (!options_done && skip_option(argv[i], "u") > 0) {
+            continue;
+        } else if (strcmp(argv[i], "-") == 0) {
+            return 1;
+        } else {
+            operands++;
+        }
+    }
+    return operands == 0;
+}
+
+
+static int same_file(int in_fd, int out_fd) {// cat f >> f писал бы бесконечно
+    struct stat in_st, out_st;
+    if (fstat(in_fd, &in_st) < 0 || fstat(out_fd, &out_st) < 0) {
+        return 0;
+    }
+    return S_ISREG(out_st.st_mode) && in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino;
+}
+
+
+static int cat_one(const char *name, int in_fd, builtin_io_t *io) {// 0 - успех, 1 - ошибка файла, -1 - вывод закрыт
+    if (same_file(in_fd, io->out_fd)) {
+        bio_error(io, "cat: %s: входной файл совпадает с выходным\n", name);
+        return 1;
+    }
+    if (stream_copy(in_fd, io->out_fd) >= 0) {
+        return 0;
+    }
+    if (errno == EPIPE) {
+        return -1;// Читатель ушел - молча заканчиваем, как внешний cat по SIGPIPE
+    }
+    bio_error(io, "cat: %s: %s\n", name, strerror(errno));
+    return 1;
+}
+
+
+int builtin_cat(char **argv, builtin_io_t *io) {//cat - вывести файлы (без опций, кроме -u)
+    bio_flush(io);// Дальше пишем мимо буфера
+
+    int status = 0;
+    int operands = 0;
+    int options_done = 0;
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (!options_done && strcmp(argv[i], "--") == 0) {
+            options_done = 1;
+            continue;
+        }
+        if (!options_done && skip_option(argv[i], "u") > 0) {
+            continue;// -u: и так без буферизации
+        }
+        operands++;
+
+        int result;
+        if (strcmp(argv[i], "-") == 0) {
+            result = cat_one("-", io->in_fd, io);
+        } else {
+            int fd = open(argv[i], O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                bio_error(io, "cat: %s: %s\n", argv[i], strerror(errno));
+                status = 1;
+                continue;
+            }
+            result = cat_one(argv[i], fd, io);
+            close(fd);
+        }
+        if (result < 0) {
+            return 1;
+        }
+        if (result > 0) {
+            status = 1;
+        }
+    }
+
+    if (operands == 0 && cat_one("-", io->in_fd, io) != 0) {
+        status = 1;
+    }
+    return status;
+}
+
+
+typedef struct {
+    int fd;// -1 - вывод закрылся или сломался, данные ему больше не пишем
+    int use_splice;// 0 - ядро не принимает splice в этот дескриптор
+    const char *name;
+} tee_target_t;
+
+
+typedef struct {
+    tee_target_t *targets;
+    int count;
+    int live;
+    int status;
+    char *buffer;// STREAM_BUFFER_SIZE
+    builtin_io_t *io;
+} tee_state_t;
+
+
+static void drop_target(tee_state_t *state, tee_target_t *target) {
+    state->status = 1;
+    if (errno == EPIPE) {
+        state->live = 0;// Как внешний tee по SIGPIPE: иначе yes | tee log | head писал бы log вечно
+        return;
+    }
+    bio_error(state->io, "tee: %s: %s\n", target->name, strerror(errno));
+    if (target->fd != state->io->out_fd) {
+        close(target->fd);
+    }
+    target->fd = -1;
+    state->live--;
+}
+
+
+static int move_bytes(int from, tee_target_t *target, size_t length, tee_state_t *state) {// Забирает ровно length байт из пайпа from и отдает их target
+    while (length > 0) {
+        ssize_t n;
+        if (target != NULL && target->fd >= 0 && target->use_splice) {
+            n = splice(from, NULL, target->fd, NULL, length, SPLICE_F_MOVE);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && unsupported(errno)) {
+                target->use_splice = 0;
+                continue;
+            }
+            if (n < 0) {
+                drop_target(state, target);
+                target = NULL;// Остаток данных все равно нужно забрать из пайпа
+                continue;
+            }
+        } else {
+            n = read(from, state->buffer, length < STREAM_BUFFER_SIZE ? length : STREAM_BUFFER_SIZE);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return -1;
+            }
+            if (target != NULL && target->fd >= 0 && write_all(target->fd, state->buffer, n) < 0) {
+                drop_target(state, target);
+                target = NULL;
+            }
+        }
+        length -= n;
+    }
+    return 0;
+}
+
+
+static int tee_write_all(tee_state_t *state, const char *data, size_t length, int first) {// Обычная запись во все выводы начиная с first
+    for (int i = first; i < state->count; i++) {
+        tee_target_t *target = &state->targets[i];
+        if (target->fd >= 0 && write_all(target->fd, data, length) < 0) {
+            drop_target(state, target);
+        }
+    }
+    return state->live > 0 ? 0 : -1;
+}
+
+
+static int tee_read_chunk(tee_state_t *state, int in_fd, size_t length, int first) {// Кусок, который не удалось размножить tee(2), - через буфер
+    while (length > 0) {
+        ssize_t n = read(in_fd, state->buffer, length < STREAM_BUFFER_SIZE ? length : STREAM_BUFFER_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        if (tee_write_all(state, state->buffer, n, first) < 0) {
+            return -1;
+        }
+        length -= n;
+    }
+    return 0;
+}
+
+
+static int tee_with_buffer(tee_state_t *state, int in_fd) {
+    while (state->live > 0) {
+        ssize_t n = read(in_fd, state->buffer, STREAM_BUFFER_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            bio_perror(state->io, "tee");
+            return -1;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        tee_write_all(state, state->buffer, n, 0);
+    }
+    return 0;
+}
+
+
+static int last_live(tee_state_t *state) {
+    for (int i = state->count - 1; i >= 0; i--) {
+        if (state->targets[i].fd >= 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+// Вход - пайп: tee(2) копирует его страницы во вспомогательный пайп без чтения,
+// оттуда splice отдает их очередному выводу. Последний вывод получает данные
+// splice прямо из входа - это и снимает их со входа.
+static int tee_with_splice(tee_state_t *state, int in_fd) {// 1 - tee(2) здесь не работает
+    int scratch[2];
+    if (pipe2(scratch, O_CLOEXEC) < 0) {
+        return 1;
+    }
+    int size = fcntl(in_fd, F_GETPIPE_SZ);// Копия куска должна поместиться во вспомогательный пайп целиком
+    if (size > 0) {
+        fcntl(scratch[1], F_SETPIPE_SZ, size);
+    }
+
+    int result = 0;
+    while (state->live > 0) {
+        int last = last_live(state);
+        if (state->live == 1) {// Остался один вывод - дальше обычный splice
+            if (stream_copy(in_fd, state->targets[last].fd) < 0) {
+                drop_target(state, &state->targets[last]);
+            }
+            break;
+        }
+
+        ssize_t n = tee(in_fd, scratch[1], STREAM_CHUNK, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            result = unsupported(errno) ? 1 : -1;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        int copied = 1;// Копия во вспомогательном пайпе уже есть для первого вывода
+        int i;
+        for (i = 0; i < last; i++) {
+            tee_target_t *target = &state->targets[i];
+            if (target->fd < 0) {
+                continue;
+            }
+            if (!copied) {
+                ssize_t m = tee(in_fd, scratch[1], n, 0);
+                if (m != n) {// Вспомогательный пайп оказался меньше - этот кусок через буфер
+                    if (m > 0) {
+                        move_bytes(scratch[0], NULL, m, state);
+                    }
+                    break;
+                }
+            }
+            copied = 0;
+            move_bytes(scratch[0], target, n, state);
+        }
+
+        if (i < last) {
+            result = tee_read_chunk(state, in_fd, n, i);
+        } else {
+            if (copied) {// Первым живым оказался последний вывод - копия не понадобилась
+                move_bytes(scratch[0], NULL, n, state);
+            }
+            result = move_bytes(in_fd, &state->targets[last], n, state);
+        }
+        if (result < 0) {
+            break;
+        }
+    }
+
+    close(scratch[0]);
+    close(scratch[1]);
+    if (result < 0 && state->live > 0) {
+        bio_perror(state->io, "tee");
+    }
+    return result;
+}
+
+
+int builtin_tee(char **argv, builtin_io_t *io) {//tee - копировать ввод в вывод и в файлы
+    bio_flush(io);
+
+    int append = 0;
+    int first = 1;
+    for (; argv[first] != NULL; first++) {
+        if (strcmp(argv[first], "--") == 0) {
+            first++;
+            break;
+        }
+        if (skip_option(argv[first], "a") <= 0) {
+            break;
+        }
+        append = 1;
+    }
+
+    int files = 0;
+    while (argv[first + files] != NULL) {
+        files++;
+    }
+
+    tee_state_t state = { 0 };
+    state.io = io;
+    state.targets = calloc(files + 1, sizeof(tee_target_t));
+    state.buffer = malloc(STREAM_BUFFER_SIZE);
+    if (state.targets == NULL || state.buffer == NULL) {
+        free(state.targets);
+        free(state.buffer);
+        bio_perror(io, "tee");
+        return 1;
+    }
+
+    state.targets[state.count++] = (tee_target_t){ io->out_fd, 1, "стандартный вывод" };
+    for (int i = 0; i < files; i++) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+        int fd = open(argv[first + i], flags, 0666);
+        if (fd < 0) {
+            bio_error(io, "tee: %s: %s\n", argv[first + i], strerror(errno));
+            state.status = 1;
+            continue;
+        }
+        state.targets[state.count++] = (tee_target_t){ fd, 1, argv[first + i] };
+    }
+    state.live = state.count;
+
+    struct stat st;
+    int result = 1;
+    if (fstat(io->in_fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        result = tee_with_splice(&state, io->in_fd);
+    }
+    if (result == 1) {
+        result = tee_with_buffer(&state, io->in_fd);
+    }
+    if (result < 0) {
+        state.status = 1;
+    }
+
+    for (int i = 1; i < state.count; i++) {
+        if (state.targets[i].fd >= 0) {
+            close(state.targets[i].fd);
+        }
+    }
+    free(state.targets);
+    free(state.buffer);
+    return state.status;
+}
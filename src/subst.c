@@ -0,0 +1,196 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "subst.h"
+#include "lexer.h"
+#include "parser.h"
+#include "ast_cache.h"
+#include "executor.h"
+#include "builtins.h"
+#include "variables.h"
+#include "expand.h"
+
+static int in_process(ast_node_t *node) {// Дерево из встроенных команд, которые можно выполнить без копии shell
+    if (node == NULL) {
+        return 1;
+    }
+    switch (node->type) {
+        case NODE_COMMAND: {
+            char **argv = node->data.command.argv;
+            const unsigned char *flags = node->data.command.word_flags;
+            if (node->data.command.argc == 0 || (flags != NULL && flags[0] != 0) || var_assignment_count(argv) > 0) {
+                return 0;// Имя из подстановки заранее не известно, VAR=val меняет shell
+            }
+            const builtin_t *builtin = find_builtin_argv(argv);
+            return builtin != NULL && (builtin->flags & BUILTIN_PIPE_SAFE) && !(builtin->flags & BUILTIN_STREAM);// cat и tee пишут прямо в дескриптор
+        }
+        case NODE_AND:
+        case NODE_OR:
+        case NODE_SEMICOLON:
+            return in_process(node->left) && in_process(node->right);
+        default:
+            return 0;
+    }
+}
+
+
+static int run_node(ast_node_t *node, bio_sink_t *output);
+
+
+static int run_in_process(ast_node_t *node, bio_sink_t *output) {// Как execute_command, но вывод встроенных команд - в память
+    if (node == NULL) {
+        return 0;
+    }
+    int status = run_node(node, output);
+    var_set_status(status < 0 ? 1 : status);
+    return status;
+}
+
+
+static int run_node(ast_node_t *node, bio_sink_t *output) {
+    int status;
+    switch (node->type) {
+        case NODE_AND:
+            status = run_in_process(node->left, output);
+            return status == 0 ? run_in_process(node->right, output) : status;
+        case NODE_OR:
+            status = run_in_process(node->left, output);
+            return status != 0 ? run_in_process(node->right, output) : status;
+        case NODE_SEMICOLON:
+            run_in_process(node->left, output);
+            return run_in_process(node->right, output);
+        default:
+            break;
+    }
+
+    char **argv = node->data.command.argv;
+    int argc = node->data.command.argc;
+    expand_t *expansion = NULL;
+    if (node->data.command.word_flags != NULL) {
+        expansion = expand_acquire();
+        if (expansion == NULL) {
+            perror("malloc");
+            return 1;
+        }
+        argv = expand_command(expansion, argv, node->data.command.word_flags, argc, &argc);
+        if (argv == NULL) {
+            expand_release(expansion);
+            return 1;
+        }
+    }
+
+    int fds[3] = { STDIN_FILENO, -1, STDERR_FILENO };
+    status = run_builtin_sink(find_builtin_argv(argv), argv, fds, output);// Имя буквальное - раскрытие его не меняет
+    expand_release(expansion);
+    return status;
+}
+
+
+static int open_capture(void) {// Безымянный файл в памяти; без memfd (старое ядро) - безымянный файл во /tmp
+    int fd = memfd_create("subst", MFD_CLOEXEC);
+    if (fd < 0) {
+        fd = open("/tmp", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    }
+    return fd;
+}
+
+
+static int run_captured(ast_node_t *node, bio_sink_t *output) {// Задача в копии shell с выводом в memfd
+    int fd = open_capture();
+    if (fd < 0) {
+        perror("memfd_create");
+        return -1;
+    }
+    exec_context_t *context = create_exec_context();
+    if (context == NULL) {
+        perror("malloc");
+        close(fd);
+        return -1;
+    }
+    context->out_fd = fd;
+    int status = execute_pipeline(node, context);// И одиночная команда идет как конвейер из одной стадии - со своей группой и Ctrl+C
+    free_exec_context(context);
+    var_set_status(status < 0 ? 1 : status);
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {// Процессы уже завершились - файл целиком, читаем его одним отображением
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap");
+            status = -1;
+        } else {
+            if (bio_sink_append(output, data, st.st_size) < 0) {
+                perror("malloc");
+                status = -1;
+            }
+            munmap(data, st.st_size);
+        }
+    }
+    close(fd);
+    return status;
+}
+
+
+int subst_run(const char *text, size_t length, bio_sink_t *output) {
+    output->length = 0;
+    if (bio_sink_append(output, "", 0) < 0) {// Буфер есть всегда, даже под пустой вывод
+        perror("malloc");
+        return -1;
+    }
+
+    lexer_t *lexer = NULL;
+    ast_cache_entry_t *entry = ast_cache_lookup(text, length);// $(...) в цикле разбирается один раз
+    ast_node_t *ast = entry != NULL ? entry->ast : NULL;
+    if (entry == NULL) {
+        lexer = lexer_create_len(text, length);
+        token_t *tokens = lexer != NULL ? lexer_tokenize(lexer) : NULL;
+        if (tokens == NULL || tokens[0].type == TOKEN_EOF) {// $() - пустой вывод
+            int status = tokens == NULL ? -1 : 0;
+            lexer_destroy(lexer);
+            output->data[0] = '\0';
+            return status;
+        }
+        parser_t *parser = parser_create(lexer);
+        ast = parser != NULL ? parse(parser) : NULL;
+        parser_destroy(parser);
+        if (ast == NULL) {
+            fprintf(stderr, "Ошибка: не удалось разобрать команду в подстановке\n");
+            lexer_destroy(lexer);
+            return -1;
+        }
+        entry = ast_cache_insert(text, length, lexer->arena, ast);// Арена переходит к кэшу
+        if (entry != NULL) {
+            lexer = NULL;
+            ast = entry->ast;
+        }
+    }
+
+    int status = in_process(ast) ? run_in_process(ast, output) : run_captured(ast, output);
+
+    if (entry != NULL) {
+        ast_cache_release(entry);
+    } else {
+        lexer_destroy(lexer);
+    }
+
+    char *nul = memchr(output->data, '\0', output->length);// В строку нули не попадут - выбрасываем, как bash
+    if (nul != NULL) {
+        size_t kept = nul - output->data;
+        for (size_t i = kept + 1; i < output->length; i++) {
+            if (output->data[i] != '\0') {
+                output->data[kept++] = output->data[i];
+            }
+        }
+        output->length = kept;
+    }
+    while (output->length > 0 && output->data[output->length - 1] == '\n') {// Завершающие переводы строк - на месте
+        output->length--;
+    }
+    output->data[output->length] = '\0';
+    return status;
+}
@@ -42,7 +42,7 @@ void test_parser(const char *test_name, const char *input) {
             default: type_str = "UNKNOWN"; break;
         }
         printf("%s:'%s' ", type_str, current->value ? current->value : "NULL");
-        current = current->next;
+        current++;
     }
     printf("\n");
     
@@ -60,7 +60,6 @@ void test_parser(const char *test_name, const char *input) {
         printf("AST:\n");
         ast_print(ast, 0);
         printf("OK\n");
-        ast_destroy(ast);
     }
     
     parser_destroy(parser);
@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include "variables.h"
+#include "prompt.h"
+#include "command_hash.h"
+
+extern char **environ;
+
+typedef struct var {
+    char *entry;// "ИМЯ=значение"; у экспортированной без значения - просто "ИМЯ"
+    size_t name_length;
+    int flags;
+    int has_value;
+    unsigned long hash;
+    struct var *next;
+} var_t;
+
+struct var_saved {// Что было до временных присваиваний
+    int count;
+    struct {
+        char *name;
+        char *value;// NULL - значения не было
+        int flags;
+        int existed;
+    } items[];
+};
+
+static var_t **buckets = NULL;
+static size_t bucket_count = 0;
+static size_t var_count = 0;
+
+static char **envp_cache = NULL;
+static size_t envp_capacity = 0;
+static int envp_dirty = 1;
+static size_t envp_bytes = 0;// Размер envp для ARG_MAX: строки с нулями и указатели
+
+static int last_status = 0;
+static char status_text[16] = "0";
+static char pid_text[24];// $$ - pid самого shell, в подсекциях тоже
+static char background_text[24];// $! - пусто, пока фоновых задач не было
+
+
+static unsigned long hash_name(const char *name, size_t length) {// FNV-1a
+    unsigned long hash = 2166136261UL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+
+static void insert(var_t *var) {
+    size_t index = var->hash & (bucket_count - 1);
+    var->next = buckets[index];
+    buckets[index] = var;
+}
+
+
+static void grow(void) {// Таблица растет вдвое, когда переменных больше, чем корзин
+    size_t old_count = bucket_count;
+    var_t **old = buckets;
+    var_t **grown = calloc(old_count * 2, sizeof(var_t *));
+    if (grown == NULL) {
+        return;// Останемся с длинными цепочками
+    }
+
+    buckets = grown;
+    bucket_count = old_count * 2;
+    for (size_t i = 0; i < old_count; i++) {
+        var_t *var = old[i];
+        while (var != NULL) {
+            var_t *next = var->next;
+            insert(var);
+            var = next;
+        }
+    }
+    free(old);
+}
+
+
+static var_t *lookup(const char *name, size_t length, unsigned long hash) {
+    for (var_t *var = buckets[hash & (bucket_count - 1)]; var != NULL; var = var->next) {
+        if (var->hash == hash && var->name_length == length && memcmp(var->entry, name, length) == 0) {
+            return var;
+        }
+    }
+    return NULL;
+}
+
+
+static void variable_changed(const char *name, size_t length, const char *value) {// Переменные, которые shell кэширует у себя
+    if (length == 3 && memcmp(name, "PS1", 3) == 0) {
+        prompt_set_template(value);
+    } else if (length == 4 && memcmp(name, "PATH", 4) == 0) {
+        command_hash_clear();
+    }
+}
+
+
+static int store(const char *name, size_t length, const char *value, int flags, int replace_flags) {
+    char *entry = malloc(length + (value ? strlen(value) + 2 : 1));
+    if (entry == NULL) {
+        return -1;
+    }
+    memcpy(entry, name, length);
+    entry[length] = '\0';
+    if (value != NULL) {
+        entry[length] = '=';
+        strcpy(entry + length + 1, value);
+    }
+
+    unsigned long hash = hash_name(name, length);
+    var_t *var = lookup(name, length, hash);
+    if (var == NULL) {
+        var = calloc(1, sizeof(var_t));
+        if (var == NULL) {
+            free(entry);
+            return -1;
+        }
+        var->name_length = length;
+        var->hash = hash;
+        insert(var);
+        var_count++;
+    } else {
+        if (var->flags & VAR_EXPORT) {
+            envp_dirty = 1;// Старая строка лежит в кэше envp
+        }
+        free(var->entry);
+    }
+
+    var->entry = entry;
+    var->has_value = (value != NULL);
+    var->flags = replace_flags ? flags : (var->flags | flags);
+    if (var->flags & VAR_EXPORT) {
+        envp_dirty = 1;
+    }
+
+    variable_changed(entry, length, value);
+    if (var_count > bucket_count) {
+        grow();
+    }
+    return 0;
+}
+
+
+static void vars_init(void) {// Таблица заполняется при первом обращении
+    if (buckets != NULL) {
+        return;
+    }
+    bucket_count = VAR_INITIAL_BUCKETS;
+    buckets = calloc(bucket_count, sizeof(var_t *));
+    if (buckets == NULL) {
+        fprintf(stderr, "Ошибка: не удалось выделить память под переменные\n");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(pid_text, sizeof(pid_text), "%d", (int)getpid());
+
+    for (char **env = environ; env != NULL && *env != NULL; env++) {
+        const char *equals = strchr(*env, '=');
+        if (equals != NULL && var_valid_name(*env, equals - *env)) {
+            store(*env, equals - *env, equals + 1, VAR_EXPORT, 1);
+        }
+    }
+}
+
+
+int var_valid_name(const char *name, size_t length) {
+    if (length == 0 || (!isalpha((unsigned char)name[0]) && name[0] != '_')) {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++) {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '_') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+const char *var_get(const char *name) {
+    return var_get_len(name, strlen(name));
+}
+
+
+const char *var_get_len(const char *name, size_t length) {
+    if (length == 1) {
+        switch (name[0]) {
+            case '?': return status_text;
+            case '$': vars_init(); return pid_text;
+            case '!': return background_text[0] ? background_text : NULL;
+            default: break;
+        }
+    }
+
+    vars_init();
+    var_t *var = lookup(name, length, hash_name(name, length));
+    if (var == NULL || !var->has_value) {
+        return NULL;
+    }
+    return var->entry + length + 1;
+}
+
+
+int var_set(const char *name, const char *value, int flags) {
+    size_t length = strlen(name);
+    if (!var_valid_name(name, length)) {
+        return -1;
+    }
+    vars_init();
+    return store(name, length, value, flags, 0);
+}
+
+
+int var_unset(const char *name) {
+    size_t length = strlen(name);
+    if (!var_valid_name(name, length)) {
+        return -1;
+    }
+    vars_init();
+
+    unsigned long hash = hash_name(name, length);
+    var_t **link = &buckets[hash & (bucket_count - 1)];
+    while (*link != NULL) {
+        var_t *var = *link;
+        if (var->hash == hash && var->name_length == length && memcmp(var->entry, name, length) == 0) {
+            *link = var->next;
+            if (var->flags & VAR_EXPORT) {
+                envp_dirty = 1;
+            }
+            free(var->entry);
+            free(var);
+            var_count--;
+            variable_changed(name, length, NULL);
+            return 0;
+        }
+        link = &var->next;
+    }
+    return 0;// Незаданную переменную удалить не ошибка
+}
+
+
+int var_export(const char *name, int export) {
+    size_t length = strlen(name);
+    if (!var_valid_name(name, length)) {
+        return -1;
+    }
+    vars_init();
+
+    var_t *var = lookup(name, length, hash_name(name, length));
+    if (var == NULL) {
+        return export ? store(name, length, NULL, VAR_EXPORT, 1) : 0;
+    }
+    int flags = export ? (var->flags | VAR_EXPORT) : (var->flags & ~VAR_EXPORT);
+    if (flags != var->flags) {
+        var->flags = flags;
+        envp_dirty = 1;
+    }
+    return 0;
+}
+
+
+char **var_envp(void) {
+    vars_init();
+    if (!envp_dirty) {
+        return envp_cache;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+        for (var_t *var = buckets[i]; var != NULL; var = var->next) {
+            count += (var->flags & VAR_EXPORT) && var->has_value;
+        }
+    }
+    if (count + 1 > envp_capacity) {
+        char **grown = realloc(envp_cache, (count + 1) * sizeof(char *));
+        if (grown == NULL) {
+            return envp_cache != NULL ? envp_cache : environ;// Старый кэш лучше, чем ничего
+        }
+        envp_cache = grown;
+        envp_capacity = count + 1;
+    }
+
+    size_t n = 0;
+    envp_bytes = sizeof(char *);// Завершающий NULL
+    for (size_t i = 0; i < bucket_count; i++) {
+        for (var_t *var = buckets[i]; var != NULL; var = var->next) {
+            if ((var->flags & VAR_EXPORT) && var->has_value) {
+                envp_cache[n++] = var->entry;
+                envp_bytes += strlen(var->entry) + 1 + sizeof(char *);
+            }
+        }
+    }
+    envp_cache[n] = NULL;
+    envp_dirty = 0;
+    return envp_cache;
+}
+
+
+size_t var_envp_size(void) {
+    var_envp();// Пересчитывается вместе с кэшем
+    return envp_bytes;
+}
+
+
+static int same_name(const char *entry, const char *assignment) {// Сравнивает имена в "ИМЯ=..."
+    size_t length = strcspn(assignment, "=");
+    return strncmp(entry, assignment, length) == 0 && entry[length] == '=';
+}
+
+
+char **var_envp_with(char **assignments, int count) {// Слова присваиваний уже имеют вид ИМЯ=значение - копировать нечего
+    char **base = var_envp();
+    size_t base_count = 0;
+    while (base[base_count] != NULL) {
+        base_count++;
+    }
+
+    char **envp = malloc((base_count + count + 1) * sizeof(char *));
+    if (envp == NULL) {
+        return NULL;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < base_count; i++) {
+        int overridden = 0;
+        for (int j = 0; j < count && !overridden; j++) {
+            overridden = same_name(base[i], assignments[j]);
+        }
+        if (!overridden) {
+            envp[n++] = base[i];
+        }
+    }
+    for (int j = 0; j < count; j++) {
+        int repeated = 0;// A=1 A=2 cmd - действует последнее
+        for (int k = j + 1; k < count && !repeated; k++) {
+            repeated = same_name(assignments[j], assignments[k]);
+        }
+        if (!repeated) {
+            envp[n++] = assignments[j];
+        }
+    }
+    envp[n] = NULL;
+    return envp;
+}
+
+
+int var_assignment_count(char **argv) {
+    int count = 0;
+    while (argv[count] != NULL) {
+        const char *equals = strchr(argv[count], '=');
+        if (equals == NULL || !var_valid_name(argv[count], equals - argv[count])) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+
+int var_assign(char **assignments, int count) {
+    vars_init();
+    int status = 0;
+    for (int i = 0; i < count; i++) {
+        size_t length = strcspn(assignments[i], "=");
+        if (store(assignments[i], length, assignments[i] + length + 1, 0, 0) < 0) {
+            status = 1;
+        }
+    }
+    return status;
+}
+
+
+var_saved_t *var_assign_temporary(char **assignments, int count) {
+    vars_init();
+    var_saved_t *saved = calloc(1, sizeof(var_saved_t) + count * sizeof(saved->items[0]));
+    if (saved == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < count; i++) {
+        size_t length = strcspn(assignments[i], "=");
+        var_t *var = lookup(assignments[i], length, hash_name(assignments[i], length));
+
+        saved->items[i].name = strndup(assignments[i], length);
+        if (var != NULL) {
+            saved->items[i].existed = 1;
+            saved->items[i].flags = var->flags;
+            saved->items[i].value = var->has_value ? strdup(var->entry + length + 1) : NULL;
+        }
+        saved->count = i + 1;
+        store(assignments[i], length, assignments[i] + length + 1, VAR_EXPORT, 0);// Видна и командам, которые запустит source
+    }
+    return saved;
+}
+
+
+void var_restore(var_saved_t *saved) {
+    if (saved == NULL) {
+        return;
+    }
+    for (int i = saved->count - 1; i >= 0; i--) {// С конца: A=1 A=2 cmd вернет самое первое значение
+        const char *name = saved->items[i].name;
+        if (name == NULL) {
+            continue;
+        }
+        if (saved->items[i].existed) {
+            store(name, strlen(name), saved->items[i].value, saved->items[i].flags, 1);
+        } else {
+            var_unset(name);
+        }
+        free(saved->items[i].name);
+        free(saved->items[i].value);
+    }
+    free(saved);
+}
+
+
+void var_set_status(int status) {
+    if (status != last_status) {
+        last_status = status;
+        snprintf(status_text, sizeof(status_text), "%d", status);
+    }
+}
+
+
+int var_status(void) {
+    return last_status;
+}
+
+
+void var_set_last_background(pid_t pid) {
+    snprintf(background_text, sizeof(background_text), "%d", (int)pid);
+}
+
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+
+static void print_exported(builtin_io_t *io) {// Как export -p в bash, по алфавиту
+    char **entries = malloc((var_count + 1) * sizeof(char *));
+    if (entries == NULL) {
+        bio_perror(io, "export");
+        return;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+        for (var_t *var = buckets[i]; var != NULL; var = var->next) {
+            if (var->flags & VAR_EXPORT) {
+                entries[n++] = var->entry;
+            }
+        }
+    }
+    qsort(entries, n, sizeof(char *), compare_entries);
+
+    for (size_t i = 0; i < n; i++) {
+        size_t length = strcspn(entries[i], "=");
+        bio_puts(io, "export ");
+        bio_write(io, entries[i], length);
+        if (entries[i][length] == '=') {
+            bio_puts(io, "=\"");
+            for (const char *p = entries[i] + length + 1; *p != '\0'; p++) {
+                if (strchr("\"\\$`", *p) != NULL) {
+                    bio_write(io, "\\", 1);
+                }
+                bio_write(io, p, 1);
+            }
+            bio_write(io, "\"", 1);
+        }
+        bio_write(io, "\n", 1);
+    }
+    free(entries);
+}
+
+
+int builtin_export(char **argv, builtin_io_t *io) {//export [-n] [имя[=значение] ...]
+    vars_init();
+    int unexport = 0;
+    int i = 1;
+    for (; argv[i] != NULL && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(argv[i], "-n") == 0) {
+            unexport = 1;
+        } else if (strcmp(argv[i], "-p") != 0) {
+            bio_error(io, "export: %s: неизвестный параметр\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if (argv[i] == NULL) {
+        print_exported(io);
+        return 0;
+    }
+
+    int status = 0;
+    for (; argv[i] != NULL; i++) {
+        size_t length = strcspn(argv[i], "=");
+        if (!var_valid_name(argv[i], length)) {
+            bio_error(io, "export: `%s': неверное имя переменной\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        if (argv[i][length] == '=') {
+            store(argv[i], length, argv[i] + length + 1, 0, 0);
+        }
+        char *name = strndup(argv[i], length);
+        if (name == NULL || var_export(name, !unexport) < 0) {
+            status = 1;
+        }
+        free(name);
+    }
+    return status;
+}
+
+
+int builtin_unset(char **argv, builtin_io_t *io) {//unset [-v] имя ...
+    int i = 1;
+    if (argv[i] != NULL && strcmp(argv[i], "-v") == 0) {
+        i++;
+    } else if (argv[i] != NULL && strcmp(argv[i], "-f") == 0) {
+        bio_error(io, "unset: -f: функций в shell нет\n");
+        return 2;
+    }
+
+    int status = 0;
+    for (; argv[i] != NULL; i++) {
+        if (var_unset(argv[i]) < 0) {
+            bio_error(io, "unset: `%s': неверное имя переменной\n", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}